@@ -0,0 +1,751 @@
+/* Copyright (C) 2002-2006 Stephen Kennedy <stevek@gnome.org>
+ * Copyright (C) 2009, 2012-2013 Kai Willadsen <kai.willadsen@gmail.com>
+ * Copyright (C) 2014 Christoph Brill <egore911@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+#include <algorithm>
+
+#include "diffchunks.h"
+#include "util/bits.h"
+
+/*! Lowest set bit of i, the span of a Fenwick tree node */
+static inline size_t low_bit(size_t i) {
+    return i & (~i + 1);
+}
+
+ShiftTree::ShiftTree(size_t size) : size(size) {}
+
+void ShiftTree::reset(size_t size) {
+    this->size = size;
+    std::vector<int>().swap(this->tree);
+}
+
+bool ShiftTree::pending() const {
+    return not this->tree.empty();
+}
+
+void ShiftTree::add(size_t from, int delta) {
+    if (delta == 0) {
+        return;
+    }
+    if (this->tree.empty()) {
+        this->tree.assign(this->size + 1, 0);
+    }
+    for (size_t i = from + 1; i < this->tree.size(); i += low_bit(i)) {
+        this->tree[i] += delta;
+    }
+}
+
+int ShiftTree::at(size_t index) const {
+    if (this->tree.empty()) {
+        return 0;
+    }
+    int sum = 0;
+    for (size_t i = index + 1; i > 0; i -= low_bit(i)) {
+        sum += this->tree[i];
+    }
+    return sum;
+}
+
+std::vector<int> ShiftTree::totals() const {
+    if (this->tree.empty()) {
+        return std::vector<int>(this->size, 0);
+    }
+    size_t n = this->size;
+    std::vector<int> result(this->tree.begin() + 1, this->tree.end());
+    // Turn the tree back into the deltas it was built from, then take
+    // their running sums
+    for (size_t i = n; i > 0; i--) {
+        size_t parent = i + low_bit(i);
+        if (parent <= n) {
+            result[parent - 1] -= result[i - 1];
+        }
+    }
+    for (size_t i = 1; i < n; i++) {
+        result[i] += result[i - 1];
+    }
+    return result;
+}
+
+DiffChunks::DiffChunks() {}
+
+DiffChunks::DiffChunks(const difflib::chunk_list_t& chunks) : chunks(chunks), shift_a(chunks.size()), shift_b(chunks.size()) {}
+
+void DiffChunks::fold() {
+    if (not this->shift_a.pending() and not this->shift_b.pending()) {
+        return;
+    }
+    std::vector<int> a = this->shift_a.totals();
+    std::vector<int> b = this->shift_b.totals();
+    for (size_t i = 0; i < this->chunks.size(); i++) {
+        difflib::chunk_t& c = this->chunks[i];
+        c = difflib::chunk_t(c.tag, c.i1 + a[i], c.i2 + a[i], c.j1 + b[i], c.j2 + b[i]);
+    }
+    this->shift_a.reset(this->chunks.size());
+    this->shift_b.reset(this->chunks.size());
+}
+
+size_t DiffChunks::size() const {
+    return this->chunks.size();
+}
+
+bool DiffChunks::empty() const {
+    return this->chunks.empty();
+}
+
+void DiffChunks::clear() {
+    this->chunks.clear();
+    this->shift_a.reset(0);
+    this->shift_b.reset(0);
+}
+
+difflib::chunk_t DiffChunks::operator[](size_t index) const {
+    const difflib::chunk_t& c = this->chunks[index];
+    // Unsigned arithmetic wraps, so a chunk whose stored position went
+    // "below zero" still comes out right
+    uint32_t a = this->shift_a.at(index);
+    uint32_t b = this->shift_b.at(index);
+    return difflib::chunk_t(c.tag, c.i1 + a, c.i2 + a, c.j1 + b, c.j2 + b);
+}
+
+difflib::chunk_list_t DiffChunks::slice(size_t lo, size_t hi) const {
+    difflib::chunk_list_t result;
+    result.reserve(hi - lo);
+    for (size_t i = lo; i < hi; i++) {
+        result.push_back((*this)[i]);
+    }
+    return result;
+}
+
+difflib::chunk_list_t DiffChunks::to_list() const {
+    DiffChunks copy(*this);
+    copy.fold();
+    return copy.chunks;
+}
+
+const difflib::chunk_list_t& DiffChunks::list() {
+    this->fold();
+    return this->chunks;
+}
+
+void DiffChunks::shift(size_t from, int delta_a, int delta_b) {
+    if (from >= this->chunks.size()) {
+        return;
+    }
+    this->shift_a.add(from, delta_a);
+    this->shift_b.add(from, delta_b);
+}
+
+void DiffChunks::splice(size_t lo, size_t hi, const difflib::chunk_list_t& replacement) {
+    assert(lo <= hi and hi <= this->chunks.size());
+    if (replacement.size() == hi - lo) {
+        // Store the new chunks less the shifts their slots will get
+        for (size_t i = 0; i < replacement.size(); i++) {
+            const difflib::chunk_t& c = replacement[i];
+            uint32_t a = this->shift_a.at(lo + i);
+            uint32_t b = this->shift_b.at(lo + i);
+            this->chunks[lo + i] = difflib::chunk_t(c.tag, c.i1 - a, c.i2 - a, c.j1 - b, c.j2 - b);
+        }
+        return;
+    }
+    this->fold();
+    this->chunks.erase(this->chunks.begin() + lo, this->chunks.begin() + hi);
+    this->chunks.insert(this->chunks.begin() + lo, replacement.begin(), replacement.end());
+    this->shift_a.reset(this->chunks.size());
+    this->shift_b.reset(this->chunks.size());
+}
+
+size_t DiffChunks::locate(bool side_b, int line) const {
+    size_t lo = 0;
+    size_t hi = this->chunks.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        difflib::chunk_t c = (*this)[mid];
+        if (int(side_b ? c.j2 : c.i2) > line) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+void ShiftTree::resize(size_t size) {
+    assert(this->tree.empty());
+    this->size = size;
+}
+
+size_t ShiftTree::memory_used() const {
+    return this->tree.capacity() * sizeof(int);
+}
+
+void ChunkIndex::clear() {
+    this->starts.clear();
+    this->ends.clear();
+    this->chunks.clear();
+    this->shift.reset(0);
+}
+
+size_t ChunkIndex::size() const {
+    return this->chunks.size();
+}
+
+int ChunkIndex::start_at(size_t index) const {
+    return this->starts[index] + this->shift.at(index);
+}
+
+int ChunkIndex::end_at(size_t index) const {
+    return this->ends[index] + this->shift.at(index);
+}
+
+size_t ChunkIndex::entry_of(int chunk) const {
+    return std::lower_bound(this->chunks.begin(), this->chunks.end(), chunk) - this->chunks.begin();
+}
+
+void ChunkIndex::fold() {
+    if (not this->shift.pending()) {
+        return;
+    }
+    std::vector<int> totals = this->shift.totals();
+    for (size_t i = 0; i < this->chunks.size(); i++) {
+        this->starts[i] += totals[i];
+        this->ends[i] += totals[i];
+    }
+    this->shift.reset(this->chunks.size());
+}
+
+void ChunkIndex::add(int start, int end, int chunk) {
+    assert(this->starts.empty() or this->start_at(this->starts.size() - 1) <= start);
+    this->fold();
+    this->starts.push_back(start);
+    this->ends.push_back(start == end ? end + 1 : end);
+    this->chunks.push_back(chunk);
+    this->shift.resize(this->chunks.size());
+}
+
+std::array<int, 3> ChunkIndex::locate(int line) const {
+    // Where chunks overlap, which only an empty one claiming the line
+    // after it can, the later chunk wins
+    size_t lo = 0;
+    size_t after = this->chunks.size();
+    while (lo < after) {
+        size_t mid = lo + (after - lo) / 2;
+        if (this->start_at(mid) > line) {
+            after = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    int next = after < this->chunks.size() ? this->chunks[after] : -1;
+    if (after == 0) {
+        return {-1, -1, next};
+    }
+    size_t at = after - 1;
+    if (line < this->end_at(at)) {
+        return {this->chunks[at], at > 0 ? this->chunks[at - 1] : -1, next};
+    }
+    return {-1, this->chunks[at], next};
+}
+
+std::vector<int> ChunkIndex::intersecting(int lo, int hi) const {
+    std::vector<int> result;
+    // Ends are sorted too, as chunks in a pane don't overlap but for
+    // the line an empty chunk claims
+    size_t i = 0;
+    size_t n = this->chunks.size();
+    while (i < n) {
+        size_t mid = i + (n - i) / 2;
+        if (this->end_at(mid) > lo) {
+            n = mid;
+        } else {
+            i = mid + 1;
+        }
+    }
+    for (; i < this->chunks.size() and this->start_at(i) < hi; i++) {
+        result.push_back(this->chunks[i]);
+    }
+    return result;
+}
+
+void ChunkIndex::shift_lines(int chunk, int delta) {
+    size_t from = this->entry_of(chunk);
+    if (from < this->chunks.size()) {
+        this->shift.add(from, delta);
+    }
+}
+
+void ChunkIndex::splice(int lo, int hi, int count, const ChunkIndex& replacement) {
+    assert(not replacement.shift.pending());
+    size_t first = this->entry_of(lo);
+    size_t last = this->entry_of(hi);
+    int renumber = lo + count - hi;
+    if (replacement.size() == last - first and renumber == 0) {
+        // Store the new entries less the shifts their slots will get
+        for (size_t i = 0; i < replacement.size(); i++) {
+            int shifted = this->shift.at(first + i);
+            this->starts[first + i] = replacement.starts[i] - shifted;
+            this->ends[first + i] = replacement.ends[i] - shifted;
+            this->chunks[first + i] = replacement.chunks[i];
+        }
+        return;
+    }
+    this->fold();
+    this->starts.erase(this->starts.begin() + first, this->starts.begin() + last);
+    this->starts.insert(this->starts.begin() + first, replacement.starts.begin(), replacement.starts.end());
+    this->ends.erase(this->ends.begin() + first, this->ends.begin() + last);
+    this->ends.insert(this->ends.begin() + first, replacement.ends.begin(), replacement.ends.end());
+    this->chunks.erase(this->chunks.begin() + first, this->chunks.begin() + last);
+    this->chunks.insert(this->chunks.begin() + first, replacement.chunks.begin(), replacement.chunks.end());
+    for (size_t i = first + replacement.size(); i < this->chunks.size(); i++) {
+        this->chunks[i] += renumber;
+    }
+    this->shift.reset(this->chunks.size());
+}
+
+DiffMerger::DiffMerger(const difflib::chunk_list_t& seq0, const difflib::chunk_list_t& seq1) : seq{{&seq0, &seq1}}, pos{{0, 0}} {}
+
+bool DiffMerger::next(std::array<ChunkSpan, 2>& group) {
+    const difflib::chunk_list_t& seq0 = *this->seq[0];
+    const difflib::chunk_list_t& seq1 = *this->seq[1];
+    bool more0 = this->pos[0] < seq0.size();
+    bool more1 = this->pos[1] < seq1.size();
+    if (not more0 and not more1) {
+        return false;
+    }
+
+    // Start from whichever change comes first, inserts first if both
+    // start at the same line
+    int high_seq;
+    if (not more0) {
+        high_seq = 1;
+    } else if (not more1) {
+        high_seq = 0;
+    } else {
+        const difflib::chunk_t& c0 = seq0[this->pos[0]];
+        const difflib::chunk_t& c1 = seq1[this->pos[1]];
+        high_seq = int(c0.i1 > c1.i1);
+        if (c0.i1 == c1.i1) {
+            if (c0.tag == difflib::Tag::insert) {
+                high_seq = 0;
+            } else if (c1.tag == difflib::Tag::insert) {
+                high_seq = 1;
+            }
+        }
+    }
+    std::array<size_t, 2> start = this->pos;
+    const difflib::chunk_t& high_diff = (*this->seq[high_seq])[this->pos[high_seq]++];
+    uint32_t high_mark = high_diff.i2;
+    int other_seq = 1 - high_seq;
+
+    // Take in changes from the other diff for as long as they overlap,
+    // switching sides whenever one reaches further
+    while (this->pos[other_seq] < this->seq[other_seq]->size()) {
+        const difflib::chunk_t& other_diff = (*this->seq[other_seq])[this->pos[other_seq]];
+        if (high_mark < other_diff.i1) {
+            break;
+        }
+        if (high_mark == other_diff.i1 and
+            not (high_diff.tag == difflib::Tag::insert and other_diff.tag == difflib::Tag::insert)) {
+            break;
+        }
+        this->pos[other_seq]++;
+        if (high_mark < other_diff.i2) {
+            std::swap(high_seq, other_seq);
+            high_mark = other_diff.i2;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        const difflib::chunk_t* data = this->seq[i]->data();
+        group[i] = ChunkSpan(data + start[i], data + this->pos[i]);
+    }
+    return true;
+}
+
+MergeCache::MergeCache() : mergeable{{0, 0}} {}
+
+MergeCache::MergeCache(const std::vector<entry_type>& entries) : mergeable{{0, 0}} {
+    this->reserve(entries.size());
+    for (const entry_type& entry : entries) {
+        this->push_back(entry);
+    }
+}
+
+size_t MergeCache::size() const {
+    return this->starts[1].size();
+}
+
+bool MergeCache::empty() const {
+    return this->starts[1].empty();
+}
+
+void MergeCache::clear() {
+    for (std::vector<difflib::Tag>& column : this->tags) {
+        column.clear();
+    }
+    for (int pane = 0; pane < 3; pane++) {
+        this->starts[pane].clear();
+        this->ends[pane].clear();
+    }
+    this->conflict_bits.clear();
+    this->split_middles.clear();
+    for (ShiftTree& shift : this->shifts) {
+        shift.reset(0);
+    }
+    this->mergeable = {{0, 0}};
+}
+
+void MergeCache::reserve(size_t size) {
+    for (std::vector<difflib::Tag>& column : this->tags) {
+        column.reserve(size);
+    }
+    for (int pane = 0; pane < 3; pane++) {
+        this->starts[pane].reserve(size);
+        this->ends[pane].reserve(size);
+    }
+    this->conflict_bits.reserve((size + 63) / 64);
+}
+
+void MergeCache::push_back(const entry_type& entry) {
+    const difflib::chunk_t& c0 = entry.first;
+    const difflib::chunk_t& c1 = entry.second;
+    assert(c0.tag != difflib::Tag::none or c0 == difflib::EMPTY_CHUNK);
+    assert(c1.tag != difflib::Tag::none or c1 == difflib::EMPTY_CHUNK);
+    this->fold();
+    size_t index = this->size();
+    this->tags[0].push_back(c0.tag);
+    this->tags[1].push_back(c1.tag);
+    const difflib::chunk_t& middle = c0.tag != difflib::Tag::none ? c0 : c1;
+    this->starts[1].push_back(middle.i1);
+    this->ends[1].push_back(middle.i2);
+    this->starts[0].push_back(c0.j1);
+    this->ends[0].push_back(c0.j2);
+    this->starts[2].push_back(c1.j1);
+    this->ends[2].push_back(c1.j2);
+    if (c0.tag != difflib::Tag::none and c1.tag != difflib::Tag::none and (c0.i1 != c1.i1 or c0.i2 != c1.i2)) {
+        this->split_middles.push_back(SplitMiddle{uint32_t(index), c1.i1, c1.i2});
+    }
+    if (index % 64 == 0) {
+        this->conflict_bits.push_back(0);
+    }
+    if (c0.tag == difflib::Tag::conflict or c1.tag == difflib::Tag::conflict) {
+        this->conflict_bits.back() |= uint64_t(1) << (index % 64);
+    }
+    for (ShiftTree& shift : this->shifts) {
+        shift.resize(index + 1);
+    }
+    this->count_mergeable(index, index + 1, 1);
+}
+
+void MergeCache::count_mergeable(size_t lo, size_t hi, int sign) {
+    for (int side = 0; side < 2; side++) {
+        for (size_t i = lo; i < hi; i++) {
+            difflib::Tag tag = this->tags[side][i];
+            if (tag != difflib::Tag::none and tag != difflib::Tag::conflict) {
+                this->mergeable[side] += sign;
+            }
+        }
+    }
+}
+
+void MergeCache::update_conflict_bits(size_t index) {
+    this->conflict_bits.resize((this->size() + 63) / 64);
+    for (size_t i = index; i < this->size(); i++) {
+        uint64_t bit = uint64_t(1) << (i % 64);
+        if (this->tags[0][i] == difflib::Tag::conflict or this->tags[1][i] == difflib::Tag::conflict) {
+            this->conflict_bits[i / 64] |= bit;
+        } else {
+            this->conflict_bits[i / 64] &= ~bit;
+        }
+    }
+}
+
+void MergeCache::fold() {
+    for (int pane = 0; pane < 3; pane++) {
+        if (not this->shifts[pane].pending()) {
+            continue;
+        }
+        std::vector<int> totals = this->shifts[pane].totals();
+        for (size_t i = 0; i < this->size(); i++) {
+            this->starts[pane][i] += totals[i];
+            this->ends[pane][i] += totals[i];
+        }
+        if (pane == 1) {
+            for (SplitMiddle& split : this->split_middles) {
+                split.start += totals[split.index];
+                split.end += totals[split.index];
+            }
+        }
+        this->shifts[pane].reset(this->size());
+    }
+}
+
+std::pair<uint32_t, uint32_t> MergeCache::side_middle(size_t index, int side) const {
+    if (side == 1 and not this->split_middles.empty() and this->tags[0][index] != difflib::Tag::none) {
+        std::vector<SplitMiddle>::const_iterator it = std::lower_bound(
+            this->split_middles.begin(), this->split_middles.end(), index,
+            [](const SplitMiddle& split, size_t index) { return split.index < index; });
+        if (it != this->split_middles.end() and it->index == index) {
+            uint32_t shift = this->shifts[1].at(index);
+            return std::pair<uint32_t, uint32_t>(it->start + shift, it->end + shift);
+        }
+    }
+    return std::pair<uint32_t, uint32_t>(this->start(index, 1), this->end(index, 1));
+}
+
+MergeCache::entry_type MergeCache::operator[](size_t index) const {
+    return entry_type(this->chunk(index, 0), this->chunk(index, 1));
+}
+
+difflib::chunk_t MergeCache::chunk(size_t index, int side) const {
+    difflib::Tag tag = this->tags[side][index];
+    if (tag == difflib::Tag::none) {
+        return difflib::EMPTY_CHUNK;
+    }
+    std::pair<uint32_t, uint32_t> middle = this->side_middle(index, side);
+    int pane = side * 2;
+    return difflib::chunk_t(tag, middle.first, middle.second, this->start(index, pane), this->end(index, pane));
+}
+
+difflib::Tag MergeCache::tag(size_t index, int side) const {
+    return this->tags[side][index];
+}
+
+uint32_t MergeCache::start(size_t index, int pane) const {
+    // Unsigned arithmetic wraps, as in DiffChunks
+    return this->starts[pane][index] + uint32_t(this->shifts[pane].at(index));
+}
+
+uint32_t MergeCache::end(size_t index, int pane) const {
+    return this->ends[pane][index] + uint32_t(this->shifts[pane].at(index));
+}
+
+bool MergeCache::is_conflict(size_t index) const {
+    return (this->conflict_bits[index / 64] >> (index % 64)) & 1;
+}
+
+size_t MergeCache::next_conflict(size_t index) const {
+    size_t word = index / 64;
+    if (word >= this->conflict_bits.size()) {
+        return this->size();
+    }
+    // Skip whole words of entries without conflicts
+    uint64_t bits = this->conflict_bits[word] & (~uint64_t(0) << (index % 64));
+    while (bits == 0) {
+        if (++word == this->conflict_bits.size()) {
+            return this->size();
+        }
+        bits = this->conflict_bits[word];
+    }
+    return word * 64 + lowest_bit(bits);
+}
+
+size_t MergeCache::previous_conflict(size_t index) const {
+    if (this->empty()) {
+        return this->size();
+    }
+    index = std::min(index, this->size() - 1);
+    size_t word = index / 64;
+    uint64_t bits = this->conflict_bits[word] & (~uint64_t(0) >> (63 - index % 64));
+    while (bits == 0) {
+        if (word-- == 0) {
+            return this->size();
+        }
+        bits = this->conflict_bits[word];
+    }
+    return word * 64 + highest_bit(bits);
+}
+
+size_t MergeCache::mergeable_count(int side) const {
+    return this->mergeable[side];
+}
+
+size_t MergeCache::locate_middle(int line) const {
+    size_t lo = 0;
+    size_t hi = this->size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (int(this->start(mid, 1)) > line) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+void MergeCache::shift(size_t from, int pane, int delta) {
+    if (from < this->size()) {
+        this->shifts[pane].add(from, delta);
+    }
+}
+
+void MergeCache::replace_split_middles(size_t lo, size_t hi, size_t count, const std::vector<SplitMiddle>& splits) {
+    std::vector<SplitMiddle>::iterator first = std::lower_bound(
+        this->split_middles.begin(), this->split_middles.end(), lo,
+        [](const SplitMiddle& split, size_t index) { return split.index < index; });
+    std::vector<SplitMiddle>::iterator last = std::lower_bound(
+        first, this->split_middles.end(), hi,
+        [](const SplitMiddle& split, size_t index) { return split.index < index; });
+    first = this->split_middles.erase(first, last);
+    for (std::vector<SplitMiddle>::iterator it = first; it != this->split_middles.end(); ++it) {
+        it->index = uint32_t(it->index + lo + count - hi);
+    }
+    this->split_middles.insert(first, splits.begin(), splits.end());
+}
+
+void MergeCache::splice(size_t lo, size_t hi, const MergeCache& replacement) {
+    assert(lo <= hi and hi <= this->size());
+    this->count_mergeable(lo, hi, -1);
+    std::vector<SplitMiddle> splits;
+    for (size_t i = 0; i < replacement.size(); i++) {
+        if (replacement.tags[0][i] != difflib::Tag::none) {
+            std::pair<uint32_t, uint32_t> middle = replacement.side_middle(i, 1);
+            if (replacement.tags[1][i] != difflib::Tag::none and
+                middle != std::pair<uint32_t, uint32_t>(replacement.start(i, 1), replacement.end(i, 1))) {
+                splits.push_back(SplitMiddle{uint32_t(lo + i), middle.first, middle.second});
+            }
+        }
+    }
+
+    if (replacement.size() == hi - lo) {
+        // Store the new entries less the shifts their slots will get
+        for (size_t i = 0; i < replacement.size(); i++) {
+            for (int side = 0; side < 2; side++) {
+                this->tags[side][lo + i] = replacement.tags[side][i];
+            }
+            for (int pane = 0; pane < 3; pane++) {
+                uint32_t shift = this->shifts[pane].at(lo + i);
+                this->starts[pane][lo + i] = replacement.start(i, pane) - shift;
+                this->ends[pane][lo + i] = replacement.end(i, pane) - shift;
+            }
+        }
+        for (SplitMiddle& split : splits) {
+            uint32_t shift = this->shifts[1].at(split.index);
+            split.start -= shift;
+            split.end -= shift;
+        }
+        this->replace_split_middles(lo, hi, hi - lo, splits);
+        for (size_t i = lo; i < hi; i++) {
+            uint64_t bit = uint64_t(1) << (i % 64);
+            if (this->tags[0][i] == difflib::Tag::conflict or this->tags[1][i] == difflib::Tag::conflict) {
+                this->conflict_bits[i / 64] |= bit;
+            } else {
+                this->conflict_bits[i / 64] &= ~bit;
+            }
+        }
+        this->count_mergeable(lo, hi, 1);
+        return;
+    }
+
+    // Moving the tail is linear anyway, so pending shifts are folded first
+    this->fold();
+    this->replace_split_middles(lo, hi, replacement.size(), splits);
+    for (int side = 0; side < 2; side++) {
+        std::vector<difflib::Tag>& column = this->tags[side];
+        column.erase(column.begin() + lo, column.begin() + hi);
+        column.insert(column.begin() + lo, replacement.tags[side].begin(), replacement.tags[side].end());
+    }
+    for (int pane = 0; pane < 3; pane++) {
+        std::vector<uint32_t> starts;
+        std::vector<uint32_t> ends;
+        for (size_t i = 0; i < replacement.size(); i++) {
+            starts.push_back(replacement.start(i, pane));
+            ends.push_back(replacement.end(i, pane));
+        }
+        this->starts[pane].erase(this->starts[pane].begin() + lo, this->starts[pane].begin() + hi);
+        this->starts[pane].insert(this->starts[pane].begin() + lo, starts.begin(), starts.end());
+        this->ends[pane].erase(this->ends[pane].begin() + lo, this->ends[pane].begin() + hi);
+        this->ends[pane].insert(this->ends[pane].begin() + lo, ends.begin(), ends.end());
+    }
+    for (ShiftTree& shift : this->shifts) {
+        shift.reset(this->size());
+    }
+    this->update_conflict_bits(lo);
+    this->count_mergeable(lo, lo + replacement.size(), 1);
+}
+
+size_t MergeCache::memory_used() const {
+    size_t bytes = 0;
+    for (const std::vector<difflib::Tag>& column : this->tags) {
+        bytes += column.capacity() * sizeof(difflib::Tag);
+    }
+    for (int pane = 0; pane < 3; pane++) {
+        bytes += (this->starts[pane].capacity() + this->ends[pane].capacity()) * sizeof(uint32_t);
+    }
+    bytes += this->conflict_bits.capacity() * sizeof(uint64_t);
+    bytes += this->split_middles.capacity() * sizeof(SplitMiddle);
+    for (const ShiftTree& shift : this->shifts) {
+        bytes += shift.memory_used();
+    }
+    return bytes;
+}
+
+MergeCache::const_iterator MergeCache::begin() const {
+    return const_iterator(this, 0);
+}
+
+MergeCache::const_iterator MergeCache::end() const {
+    return const_iterator(this, this->size());
+}
+
+ChunkDelta::ChunkDelta() : modified(-1) {}
+
+bool ChunkDelta::empty() const {
+    return this->removed.empty() and this->added.empty() and this->modified < 0;
+}
+
+/*! Add index to ranges, extending the last range if it ends there */
+static void add_to_ranges(std::vector<std::pair<size_t, size_t>>& ranges, size_t index) {
+    if (not ranges.empty() and ranges.back().second == index) {
+        ranges.back().second += 1;
+    } else {
+        ranges.push_back(std::pair<size_t, size_t>(index, index + 1));
+    }
+}
+
+/*! Lines of a merge cache entry in the middle pane, to order entries by */
+static std::pair<uint32_t, uint32_t> middle_lines(const MergeCache& cache, size_t index) {
+    return std::pair<uint32_t, uint32_t>(cache.start(index, 1), cache.end(index, 1));
+}
+
+ChunkDelta merge_cache_delta(const MergeCache& old_cache, const MergeCache& new_cache, int changed) {
+    ChunkDelta delta;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < old_cache.size() or j < new_cache.size()) {
+        if (i < old_cache.size() and j < new_cache.size() and old_cache[i] == new_cache[j]) {
+            if (int(i) == changed) {
+                delta.modified = j;
+            }
+            i++;
+            j++;
+            continue;
+        }
+        bool take_old = j == new_cache.size() or
+                        (i < old_cache.size() and middle_lines(old_cache, i) <= middle_lines(new_cache, j));
+        bool take_new = i == old_cache.size() or
+                        (j < new_cache.size() and middle_lines(new_cache, j) <= middle_lines(old_cache, i));
+        if (take_old) {
+            add_to_ranges(delta.removed, i++);
+        }
+        if (take_new) {
+            add_to_ranges(delta.added, j++);
+        }
+    }
+    return delta;
+}
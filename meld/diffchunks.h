@@ -0,0 +1,455 @@
+/* Copyright (C) 2002-2006 Stephen Kennedy <stevek@gnome.org>
+ * Copyright (C) 2009, 2012-2013 Kai Willadsen <kai.willadsen@gmail.com>
+ * Copyright (C) 2014 Christoph Brill <egore911@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MELD__DIFFCHUNKS_H__
+#define __MELD__DIFFCHUNKS_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "difflib/src/difflib.h"
+
+/*!
+ * Shifts pending on the entries of a list, as a Fenwick tree over indices
+ *
+ * Shifting every entry from an index onwards and reading the total shift
+ * of any one entry both take O(log n). Lists fold the shifts into their
+ * entries, with totals(), when they have to move them anyway. The tree
+ * only takes memory while shifts are pending.
+ */
+class ShiftTree {
+private:
+    size_t size;
+    /*! 1-based tree of the shifts starting at each entry, empty if there are none */
+    std::vector<int> tree;
+
+public:
+    explicit ShiftTree(size_t size = 0);
+
+    /*! Drop every shift, for a list of size entries */
+    void reset(size_t size);
+
+    /*! Whether any entry has been shifted since the last reset() */
+    bool pending() const;
+
+    /*! Shift entries from index from onwards by delta */
+    void add(size_t from, int delta);
+
+    /*! Total shift of the index-th entry */
+    int at(size_t index) const;
+
+    /*! Total shift of every entry, in order, in a single linear pass */
+    std::vector<int> totals() const;
+
+    /*! Make room for entries added at the end; nothing may be pending */
+    void resize(size_t size);
+
+    /*! Bytes taken by the tree */
+    size_t memory_used() const;
+};
+
+/*!
+ * The chunks of one two-way diff, kept in order and shifted lazily
+ *
+ * An edit moves every chunk after it by the number of lines it added or
+ * removed. Rather than rewriting all of those, the shift is recorded in
+ * a ShiftTree for each side, so that shifting the tail of the list and
+ * reading any one chunk both take O(log n).
+ *
+ * Replacing a range of chunks by as many new ones takes O(k log n).
+ * Replacing it by a different number of chunks has to move the tail of
+ * the vector anyway; the pending shifts are folded into the chunks as
+ * that happens, in a single linear pass.
+ */
+class DiffChunks {
+private:
+    /*! Chunks as they were before any pending shift */
+    difflib::chunk_list_t chunks;
+    ShiftTree shift_a;
+    ShiftTree shift_b;
+
+    /*! Apply pending shifts to chunks and empty the trees */
+    void fold();
+
+public:
+    DiffChunks();
+    explicit DiffChunks(const difflib::chunk_list_t& chunks);
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    /*! The index-th chunk, with every shift applied */
+    difflib::chunk_t operator[](size_t index) const;
+
+    /*! Chunks lo to hi, with every shift applied, without folding */
+    difflib::chunk_list_t slice(size_t lo, size_t hi) const;
+
+    /*! All chunks, with every shift applied */
+    difflib::chunk_list_t to_list() const;
+
+    /*! All chunks, folding every pending shift into them first */
+    const difflib::chunk_list_t& list();
+
+    /*! Move chunks from index from onwards by delta_a and delta_b lines */
+    void shift(size_t from, int delta_a, int delta_b);
+
+    /*! Replace chunks lo to hi with replacement, given in final positions */
+    void splice(size_t lo, size_t hi, const difflib::chunk_list_t& replacement);
+
+    /*!
+     * Index of the first chunk ending after line, or size()
+     *
+     * Chunk ends are compared on the a side (i2), or on the b side (j2)
+     * if side_b is set. Both are non-decreasing along a diff, so this is
+     * a binary search.
+     */
+    size_t locate(bool side_b, int line) const;
+};
+
+/*!
+ * Where the chunks of a comparison lie in one pane
+ *
+ * Chunks are added in order as line ranges of the pane, and kept as
+ * sorted arrays of their bounds, so that finding the chunk at a line or
+ * the chunks in a range of lines is a binary search. This takes memory
+ * in proportion to the number of chunks rather than of lines.
+ *
+ * Like DiffChunks, the lines of the chunks after an edit are shifted
+ * lazily, and the index can be patched for just the chunks an edit
+ * replaced.
+ */
+class ChunkIndex {
+private:
+    std::vector<int> starts;
+    /*! Ends of the chunks, with empty ones claiming the line after them */
+    std::vector<int> ends;
+    std::vector<int> chunks;
+    /*! Lines the entries have moved by since they were stored */
+    ShiftTree shift;
+
+    int start_at(size_t index) const;
+    int end_at(size_t index) const;
+    /*! Index of the first entry for chunk or a later one */
+    size_t entry_of(int chunk) const;
+    void fold();
+
+public:
+    void clear();
+
+    size_t size() const;
+
+    /*!
+     * Add chunk, which covers lines start to end of the pane
+     *
+     * Chunks must be added in order. An empty chunk, an insertion on the
+     * other side, is found at the line following it.
+     */
+    void add(int start, int end, int chunk);
+
+    /*!
+     * The chunk at line, and the chunks before and after it in this pane
+     *
+     * Between chunks, the first is -1 and the others are the chunks on
+     * either side. Missing chunks are -1.
+     */
+    std::array<int, 3> locate(int line) const;
+
+    /*! Chunks with lines in lo to hi, in order */
+    std::vector<int> intersecting(int lo, int hi) const;
+
+    /*! Move the lines of chunk and every later one by delta */
+    void shift_lines(int chunk, int delta);
+
+    /*!
+     * Replace the entries of chunks lo to hi with those of replacement
+     *
+     * The comparison now has count chunks where it had chunks lo to hi,
+     * and replacement holds those of them with lines in this pane,
+     * numbered as they are now. Later chunks are renumbered to match.
+     */
+    void splice(int lo, int hi, int count, const ChunkIndex& replacement);
+};
+
+/*! A borrowed run of consecutive chunks of a chunk list */
+struct ChunkSpan {
+    const difflib::chunk_t* first;
+    const difflib::chunk_t* last;
+
+    ChunkSpan() : first(nullptr), last(nullptr) {}
+    ChunkSpan(const difflib::chunk_t* first, const difflib::chunk_t* last) : first(first), last(last) {}
+
+    const difflib::chunk_t* begin() const {
+        return this->first;
+    }
+    const difflib::chunk_t* end() const {
+        return this->last;
+    }
+    size_t size() const {
+        return this->last - this->first;
+    }
+    bool empty() const {
+        return this->first == this->last;
+    }
+    const difflib::chunk_t& front() const {
+        return *this->first;
+    }
+    const difflib::chunk_t& back() const {
+        return *(this->last - 1);
+    }
+    const difflib::chunk_t& operator[](size_t index) const {
+        return this->first[index];
+    }
+};
+
+/*!
+ * Pair up the text1 -> text0 and text1 -> text2 diffs of a comparison
+ *
+ * Each call to next() gives the next group of chunks that overlap, or
+ * touch, in the middle pane, as a span of either diff. Only one of the
+ * two is non-empty, with a single chunk, unless the diffs overlap there
+ * and have to be merged. This is a single forward pass over both diffs
+ * that allocates nothing; the diffs must outlive it and stay unchanged.
+ */
+class DiffMerger {
+private:
+    std::array<const difflib::chunk_list_t*, 2> seq;
+    std::array<size_t, 2> pos;
+
+public:
+    DiffMerger(const difflib::chunk_list_t& seq0, const difflib::chunk_list_t& seq1);
+
+    /*! Set group to the next group of chunks; false once there are none */
+    bool next(std::array<ChunkSpan, 2>& group);
+};
+
+/*!
+ * The merge cache of a comparison, kept as a struct of arrays
+ *
+ * Each entry pairs the chunk from the middle pane to pane 0 with the one
+ * to pane 2, either of which may be EMPTY_CHUNK. Rather than 40 byte
+ * pairs of chunks, entries are stored column by column: a byte array of
+ * tags per side, arrays of start and end lines per pane, and a bitset of
+ * the entries in conflict. Scanning one column, to find conflicts or
+ * mergeable changes or to index a pane, then only reads that column.
+ *
+ * Both sides of an entry nearly always cover the same lines of the middle
+ * pane, so those are stored once. The rare entries whose sides differ
+ * there keep the lines of side 1 in a short sorted list of their own.
+ * Entries are read back as pairs of chunks, by value, so indexing and
+ * iterating work as they did on a vector of pairs.
+ *
+ * As in DiffChunks, the entries after an edit are shifted lazily, one
+ * ShiftTree per pane, and splice() replaces just the entries an edit
+ * touched.
+ */
+class MergeCache {
+public:
+    typedef std::pair<difflib::chunk_t, difflib::chunk_t> entry_type;
+
+    /*! Iterates over the entries, giving each as a pair of chunks */
+    class const_iterator {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef entry_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef void pointer;
+        typedef entry_type reference;
+
+        const_iterator() : cache(nullptr), index(0) {}
+        const_iterator(const MergeCache* cache, size_t index) : cache(cache), index(index) {}
+
+        entry_type operator*() const {
+            return (*this->cache)[this->index];
+        }
+        entry_type operator[](difference_type n) const {
+            return (*this->cache)[this->index + n];
+        }
+        const_iterator& operator++() {
+            this->index++;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator previous = *this;
+            this->index++;
+            return previous;
+        }
+        const_iterator& operator--() {
+            this->index--;
+            return *this;
+        }
+        const_iterator operator--(int) {
+            const_iterator previous = *this;
+            this->index--;
+            return previous;
+        }
+        const_iterator& operator+=(difference_type n) {
+            this->index += n;
+            return *this;
+        }
+        const_iterator& operator-=(difference_type n) {
+            this->index -= n;
+            return *this;
+        }
+        const_iterator operator+(difference_type n) const {
+            return const_iterator(this->cache, this->index + n);
+        }
+        const_iterator operator-(difference_type n) const {
+            return const_iterator(this->cache, this->index - n);
+        }
+        difference_type operator-(const const_iterator& other) const {
+            return difference_type(this->index) - difference_type(other.index);
+        }
+        bool operator==(const const_iterator& other) const {
+            return this->index == other.index;
+        }
+        bool operator!=(const const_iterator& other) const {
+            return this->index != other.index;
+        }
+        bool operator<(const const_iterator& other) const {
+            return this->index < other.index;
+        }
+
+    private:
+        const MergeCache* cache;
+        size_t index;
+    };
+
+private:
+    /*! Tags of the chunks to pane 0 and to pane 2, none for EMPTY_CHUNK */
+    std::array<std::vector<difflib::Tag>, 2> tags;
+    /*! Lines of each pane, with those of the middle pane taken from side 0 if it's there */
+    std::array<std::vector<uint32_t>, 3> starts;
+    std::array<std::vector<uint32_t>, 3> ends;
+    std::vector<uint64_t> conflict_bits;
+    /*! Lines each pane's entries have moved by since they were stored */
+    std::array<ShiftTree, 3> shifts;
+    /*! Number of entries with a chunk other than a conflict, on each side */
+    std::array<size_t, 2> mergeable;
+
+    /*! Lines of side 1 in the middle pane, for entries where they aren't those of side 0 */
+    struct SplitMiddle {
+        uint32_t index;
+        uint32_t start;
+        uint32_t end;
+    };
+    std::vector<SplitMiddle> split_middles;
+
+    std::pair<uint32_t, uint32_t> side_middle(size_t index, int side) const;
+    /*! Put splits in place of those of entries lo to hi, which are now count entries */
+    void replace_split_middles(size_t lo, size_t hi, size_t count, const std::vector<SplitMiddle>& splits);
+    void count_mergeable(size_t lo, size_t hi, int sign);
+    /*! Work out the conflict bits of entries from index onwards */
+    void update_conflict_bits(size_t index);
+    void fold();
+
+public:
+    MergeCache();
+    explicit MergeCache(const std::vector<entry_type>& entries);
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    void reserve(size_t size);
+
+    /*! Add an entry after the last one */
+    void push_back(const entry_type& entry);
+
+    /*! The index-th entry, as the pair of chunks it was added as */
+    entry_type operator[](size_t index) const;
+
+    /*! The chunk of the index-th entry to pane 0, for side 0, or to pane 2 */
+    difflib::chunk_t chunk(size_t index, int side) const;
+
+    /*! Tag of the chunk to pane 0, for side 0, or to pane 2; none if there's no chunk */
+    difflib::Tag tag(size_t index, int side) const;
+
+    /*!
+     * Lines of the index-th entry in pane, from start to end
+     *
+     * Every entry has lines in the middle pane. In pane 0 or 2, the lines
+     * of an entry without a chunk on that side mean nothing.
+     */
+    uint32_t start(size_t index, int pane) const;
+    uint32_t end(size_t index, int pane) const;
+
+    /*! Whether either chunk of the index-th entry is a conflict */
+    bool is_conflict(size_t index) const;
+
+    /*! Index of the first conflict at or after index, or size() */
+    size_t next_conflict(size_t index) const;
+
+    /*! Index of the last conflict at or before index, or size() if there's none */
+    size_t previous_conflict(size_t index) const;
+
+    /*! Number of entries with a chunk on side other than a conflict */
+    size_t mergeable_count(int side) const;
+
+    /*!
+     * Index of the first entry starting after line in the middle pane, or size()
+     *
+     * Entries are in order of their middle pane lines, so this is a
+     * binary search.
+     */
+    size_t locate_middle(int line) const;
+
+    /*! Move the lines of entries from index from onwards in pane by delta */
+    void shift(size_t from, int pane, int delta);
+
+    /*! Replace entries lo to hi with those of replacement, given in final positions */
+    void splice(size_t lo, size_t hi, const MergeCache& replacement);
+
+    /*! Bytes allocated for the entries */
+    size_t memory_used() const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+};
+
+/*!
+ * What changed between two versions of a merge cache
+ *
+ * Ranges are of indices, first to second, into the old cache for the
+ * entries that are gone and into the new cache for those that are new.
+ * Entries in neither kept their place relative to the edit.
+ */
+struct ChunkDelta {
+    std::vector<std::pair<size_t, size_t>> removed;
+    std::vector<std::pair<size_t, size_t>> added;
+    /*! Index in the new cache of the entry the edit was made in, or -1 */
+    int modified;
+
+    ChunkDelta();
+
+    bool empty() const;
+};
+
+/*!
+ * Compare two merge caches in a single sweep
+ *
+ * Both caches are in order of their lines in the middle pane, so this is
+ * a merge of two sorted lists. old_cache should already be offset by the
+ * edit, and changed is the index in it of the entry the edit was made
+ * in, or -1.
+ */
+extern ChunkDelta merge_cache_delta(const MergeCache& old_cache, const MergeCache& new_cache, int changed);
+
+#endif
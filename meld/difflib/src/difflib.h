@@ -38,6 +38,7 @@
 #include <tuple>
 #include <algorithm>
 #include <memory>
+#include <cstdint>
 #include <vector>
 
 namespace difflib {
@@ -51,10 +52,173 @@ using std::tie;
 // Exposed types
 using match_t = tuple<size_t, size_t, size_t>;
 using match_list_t = std::vector<match_t>;  // A vector to speed up copying
-using chunk_t = tuple<std::string, size_t, size_t, size_t, size_t>;
+// The kind of change an opcode describes. conflict is only produced by
+// three-way merging, move only by moved-block detection on top of a
+// diff, and none only by EMPTY_CHUNK.
+enum class Tag : uint8_t {
+  none,
+  equal,
+  replace,
+  delete_,
+  insert,
+  conflict,
+  move
+};
+
+// An opcode: a[i1:i2] relates to b[j1:j2] as tag says. This is a plain
+// 20 byte value, so copying, comparing and storing chunks never touches
+// the heap.
+struct chunk_t {
+  Tag tag;
+  uint32_t i1;
+  uint32_t i2;
+  uint32_t j1;
+  uint32_t j2;
+
+  chunk_t() = default;
+  chunk_t(Tag tag, size_t i1, size_t i2, size_t j1, size_t j2)
+    : tag(tag), i1(i1), i2(i2), j1(j1), j2(j2) {}
+
+  bool operator==(chunk_t const& other) const {
+    return tag == other.tag and i1 == other.i1 and i2 == other.i2 and j1 == other.j1 and j2 == other.j2;
+  }
+  bool operator!=(chunk_t const& other) const {
+    return not (*this == other);
+  }
+  bool operator<(chunk_t const& other) const {
+    return std::tie(tag, i1, i2, j1, j2) < std::tie(other.tag, other.i1, other.i2, other.j1, other.j2);
+  }
+};
 using chunk_list_t = std::vector<chunk_t>;
 
-chunk_t const EMPTY_CHUNK("", 0, 0, 0, 0);
+chunk_t const EMPTY_CHUNK(Tag::none, 0, 0, 0, 0);
+
+// Compatibility with the Python style (tag, i1, i2, j1, j2) opcodes, whose
+// tags are the strings "equal", "replace", "delete", "insert", "conflict",
+// "move" and, for EMPTY_CHUNK, "".
+using tuple_chunk_t = tuple<std::string, size_t, size_t, size_t, size_t>;
+
+inline char const* tag_name(Tag tag) {
+  static char const* const names[] = {"", "equal", "replace", "delete", "insert", "conflict", "move"};
+  return names[static_cast<uint8_t>(tag)];
+}
+
+inline Tag tag_from_name(std::string const& name) {
+  for (uint8_t tag = static_cast<uint8_t>(Tag::equal); tag <= static_cast<uint8_t>(Tag::move); ++tag) {
+    if (name == tag_name(static_cast<Tag>(tag)))
+      return static_cast<Tag>(tag);
+  }
+  return Tag::none;
+}
+
+inline tuple_chunk_t to_tuple(chunk_t const& chunk) {
+  return tuple_chunk_t(tag_name(chunk.tag), chunk.i1, chunk.i2, chunk.j1, chunk.j2);
+}
+
+inline chunk_t from_tuple(tuple_chunk_t const& chunk) {
+  return chunk_t(tag_from_name(std::get<0>(chunk)), std::get<1>(chunk), std::get<2>(chunk),
+                 std::get<3>(chunk), std::get<4>(chunk));
+}
+
+// A forward range over the opcodes a list of matching blocks describes,
+// produced one at a time instead of into a vector. It borrows the blocks,
+// so it is only valid until its matcher is destroyed or given new
+// sequences. skip_equal leaves out the "equal" opcodes. A block of size 0
+// only ends the change before it, so several lists, each terminated by its
+// own sentinel, can be concatenated without changes spanning them.
+class opcode_range {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = chunk_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = chunk_t const*;
+    using reference = chunk_t const&;
+
+    iterator() = default;
+    iterator(match_list_t const* blocks, bool skip_equal): blocks_(blocks), skip_equal_(skip_equal), done_(false) {
+      advance();
+    }
+
+    reference operator*() const { return chunk_; }
+    pointer operator->() const { return &chunk_; }
+
+    iterator& operator++() {
+      advance();
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator previous = *this;
+      advance();
+      return previous;
+    }
+
+    bool operator==(iterator const& other) const {
+      return done_ == other.done_ and (done_ or (blocks_ == other.blocks_ and step_ == other.step_));
+    }
+    bool operator!=(iterator const& other) const {
+      return not (*this == other);
+    }
+
+   private:
+    // Each block takes two steps: the change before it, then the block
+    // itself as an "equal" opcode. Steps that describe nothing are skipped.
+    void advance() {
+      size_t const steps = 2 * blocks_->size();
+      while (step_ < steps) {
+        size_t ai, bj, size;
+        std::tie(ai, bj, size) = (*blocks_)[step_ / 2];
+        if (step_++ % 2 == 0) {
+          Tag tag = Tag::none;
+          if (i_ < ai and j_ < bj) {
+            tag = Tag::replace;
+          } else if (i_ < ai) {
+            tag = Tag::delete_;
+          } else if (j_ < bj) {
+            tag = Tag::insert;
+          }
+          if (tag != Tag::none) {
+            chunk_ = chunk_t(tag, i_, ai, j_, bj);
+            return;
+          }
+        } else {
+          i_ = ai+size;
+          j_ = bj+size;
+          if (size and not skip_equal_) {
+            chunk_ = chunk_t(Tag::equal, ai, i_, bj, j_);
+            return;
+          }
+        }
+      }
+      done_ = true;
+    }
+
+    match_list_t const* blocks_ = nullptr;
+    bool skip_equal_ = false;
+    bool done_ = true;
+    size_t step_ = 0;
+    size_t i_ = 0;
+    size_t j_ = 0;
+    chunk_t chunk_ = EMPTY_CHUNK;
+  };
+
+  opcode_range(match_list_t const& blocks, bool skip_equal = false): blocks_(&blocks), skip_equal_(skip_equal) {}
+
+  iterator begin() const { return iterator(blocks_, skip_equal_); }
+  iterator end() const { return iterator(); }
+
+ private:
+  match_list_t const* blocks_;
+  bool skip_equal_;
+};
+
+// The best ratio() two sequences of these lengths could have
+inline double length_ratio(size_t a_size, size_t b_size) {
+  size_t length = a_size+b_size;
+  if(length==0) return 1.0;
+  return 2.*std::min(a_size, b_size)/length;
+}
 
 // This trait checks if a given type is a standard collection of hashable types
 // SFINAE ftw
@@ -106,15 +270,16 @@ template <class T = std::string> class SequenceMatcher {
   using hashable_type = typename T::value_type;
   using junk_function_type = std::function<bool(hashable_type const&)>;
 
+  // The index of b is built by the first find_longest_match, so matchers
+  // that override get_matching_blocks() never pay for it.
   SequenceMatcher(T const& a, T const& b, junk_function_type is_junk = nullptr, bool auto_junk = true): a_(a), b_(b), is_junk_(is_junk), auto_junk_(auto_junk) {
-    j2len_.resize(b.size()+1);
-    chain_b();
   }
 
   SequenceMatcher(SequenceMatcher<T> const&) = delete;
   SequenceMatcher& operator= (SequenceMatcher<T> const&) = delete;
   SequenceMatcher(SequenceMatcher<T>&&) = default;
   SequenceMatcher& operator= (SequenceMatcher<T>&&) = default;
+  virtual ~SequenceMatcher() = default;
 
   std::size_t auto_junk_minsize() const { return auto_junk_minsize_; }
   void set_auto_junk_minsize(std::size_t value) { auto_junk_minsize_ = value; }
@@ -124,16 +289,20 @@ template <class T = std::string> class SequenceMatcher {
     set_seq2(b);
   }
 
+  // To compare many sequences against one, set it with set_seq2 once and
+  // the others with set_seq1: the index of b, and all scratch space, is
+  // then kept between them.
   void set_seq1(T const& a) { 
     a_ = a;
+    a_indexed_ = false;
     matching_blocks_ = nullptr;
     opcodes_ = nullptr;
   }
 
   void set_seq2(T const& b) {
     b_ = b;
-    j2len_.resize(b.size()+1);
-    chain_b();
+    a_indexed_ = false;
+    b_indexed_ = false;
     matching_blocks_ = nullptr;
     opcodes_ = nullptr;
   }
@@ -142,28 +311,59 @@ template <class T = std::string> class SequenceMatcher {
     size_t sum = 0;
     size_t length = a_.size()+b_.size();
     if(length==0) return 1.0;
-    for(match_t  m : get_matching_blocks())
+    for(match_t const& m : matching_blocks())
         sum+=std::get<2>(m);
     return 2.*sum/length;
   } 
+
+  // An upper bound on ratio(): the elements a and b have in common,
+  // counted as multisets and ignoring order. Linear time, and hash free
+  // once b is indexed.
+  double quick_ratio() {
+    size_t length = a_.size()+b_.size();
+    if(length==0) return 1.0;
+    index();
+    std::vector<size_t> avail(ids_.size(), 0);
+    for(uint32_t id : b_ids_) ++avail[id];
+    size_t matches = 0;
+    for(uint32_t id : a_ids_) {
+      if (id != no_id && avail[id]) {
+        --avail[id];
+        ++matches;
+      }
+    }
+    return 2.*matches/length;
+  }
+
+  // A looser upper bound on ratio(), from the lengths alone
+  double real_quick_ratio() const {
+    return length_ratio(a_.size(), b_.size());
+  }
   
   match_t find_longest_match(size_t a_low, size_t a_high, size_t b_low, size_t b_high) {
     using std::begin;
     using std::end;
 
 
+    index();
+
     size_t best_i = a_low;
     size_t best_j = b_low;
     size_t best_size = 0;
     
     // Find longest junk free match
     {
+      size_t const* positions = positions_.data();
       j2_values_to_erase_.clear();
       for(size_t i = a_low; i < a_high; ++i) {
         j2_values_to_affect_.clear();
 
-        for(size_t j : b2j_[a_[i]]) {
-          if (j < b_low) continue;
+        // Elements missing from b have an empty row
+        uint32_t id = a_ids_[i];
+        size_t const* row_end = positions + (id == no_id ? 0 : offsets_[id+1]);
+        size_t const* row = id == no_id ? row_end : std::lower_bound(positions + offsets_[id], row_end, b_low);
+        for(; row != row_end; ++row) {
+          size_t j = *row;
           if (j >= b_high) break;
           size_t k = j2len_[j] + 1;
           j2_values_to_affect_.emplace_back(j+1,k);
@@ -193,7 +393,7 @@ template <class T = std::string> class SequenceMatcher {
         best_i > a_low  
         && best_j > b_low 
         && this->a_[best_i-1] == this->b_[best_j-1] 
-        && isjunk == b2j_.count(b_[best_j-1])
+        && isjunk == b_junk_[b_ids_[best_j-1]]
       ) {
         --best_i; --best_j; ++best_size;
       }
@@ -206,7 +406,7 @@ template <class T = std::string> class SequenceMatcher {
         (best_i+best_size) < a_high  
         && (best_j+best_size) < b_high 
         && this->a_[best_i+best_size] == this->b_[best_j+best_size]
-        && isjunk == b2j_.count(b_[best_j + best_size])
+        && isjunk == b_junk_[b_ids_[best_j + best_size]]
       ) {
         ++best_size;
       }
@@ -223,7 +423,9 @@ template <class T = std::string> class SequenceMatcher {
     return make_tuple(best_i, best_j, best_size);
   }
 
-  match_list_t get_matching_blocks() {
+  // The matching blocks, borrowed from the cache instead of copied. They
+  // stay valid until the matcher is destroyed or given new sequences.
+  virtual match_list_t const& matching_blocks() {
     // The following are tuple extracting aliases
     using std::get;
 
@@ -274,6 +476,17 @@ template <class T = std::string> class SequenceMatcher {
     return *matching_blocks_;
   }
 
+  match_list_t get_matching_blocks() {
+    return matching_blocks();
+  }
+
+  // The opcodes, computed one at a time as the range is walked rather than
+  // stored; see get_opcodes() for their meaning. With skip_equal, only the
+  // changes are produced.
+  opcode_range opcodes(bool skip_equal = false) {
+    return opcode_range(opcode_blocks(), skip_equal);
+  }
+
   /*!
    * \brief Return list of 5-tuples describing how to turn a into b.
    *
@@ -281,26 +494,23 @@ template <class T = std::string> class SequenceMatcher {
    * has i1 == j1 == 0, and remaining tuples have i1 == the i2 from the
    * tuple preceding it, and likewise for j1 == the previous j2.
    *
-   * The tags are strings, with these meanings:
+   * The tags have these meanings:
    *
-   * 'replace':  a[i1:i2] should be replaced by b[j1:j2]
-   * 'delete':   a[i1:i2] should be deleted.
+   * replace:  a[i1:i2] should be replaced by b[j1:j2]
+   * delete_:  a[i1:i2] should be deleted.
    *             Note that j1==j2 in this case.
-   * 'insert':   b[j1:j2] should be inserted at a[i1:i1].
+   * insert:   b[j1:j2] should be inserted at a[i1:i1].
    *             Note that i1==i2 in this case.
-   * 'equal':    a[i1:i2] == b[j1:j2]
+   * equal:    a[i1:i2] == b[j1:j2]
    *
    * std::string a = "qabxcd";
    * std::string b = "abycdf";
    * auto s = MakeSequenceMatcher(None, a, b)
    * for (auto const& opcode : s.get_opcodes()) {
-   *  std::string tag;
-   *  std::size_t i1,i2,j1,j2;
-   *  std::tie(tag, i1, i2, j1, j2) = opcode;
    *  std::cout
-   *    << std::setw(7) << tag
-   *    << " a[" << i1 << ":" << i2 << " (" << a.substr(i1, i2-i1) << ")"
-   *    << " b[" << j1 << ":" << j2 << " (" << b.substr(j1, j2-j1) << ")"
+   *    << std::setw(7) << tag_name(opcode.tag)
+   *    << " a[" << opcode.i1 << ":" << opcode.i2 << " (" << a.substr(opcode.i1, opcode.i2-opcode.i1) << ")"
+   *    << " b[" << opcode.j1 << ":" << opcode.j2 << " (" << b.substr(opcode.j1, opcode.j2-opcode.j1) << ")"
    *    << "\n";
    * }
    *  
@@ -311,46 +521,10 @@ template <class T = std::string> class SequenceMatcher {
    *  insert a[6:6] () b[5:6] (f)
    */
   chunk_list_t get_opcodes() {
-    using std::get;
-
-    if (opcodes_)
-      return *opcodes_;
-
-    size_t i = 0;
-    size_t j = 0;
-    opcodes_.reset(new chunk_list_t);
-    for (match_t const& m : get_matching_blocks()) {
-      size_t ai, bj, size;
-      std::tie(ai, bj, size) = m;
-
-      // invariant:  we've pumped out correct diffs to change
-      // a[:i] into b[:j], and the next matching block is
-      // a[ai:ai+size] == b[bj:bj+size].  So we need to pump
-      // out a diff to change a[i:ai] into b[j:bj], pump out
-      // the matching block, and move (i,j) beyond the match
-      std::string tag;
-      if (i < ai and j < bj) {
-        tag = "replace";
-      } else if (i < ai) {
-        tag = "delete";
-      } else if (j < bj) {
-        tag = "insert";
-      }
-
-      if (!tag.empty()) {
-        opcodes_->emplace_back(tag, i, ai, j, bj);
-      }
-
-      i = ai+size;
-      j = bj+size;
-
-      // the list of matching blocks is terminated by a
-      // sentinel with size 0
-      if (size) {
-        opcodes_->emplace_back("equal", ai, i, bj, j);
-      }
+    if (!opcodes_) {
+      opcode_range range = opcodes();
+      opcodes_.reset(new chunk_list_t(range.begin(), range.end()));
     }
-
     return *opcodes_;
   }
 
@@ -361,52 +535,98 @@ template <class T = std::string> class SequenceMatcher {
   std::unique_ptr<match_list_t> matching_blocks_;
   std::unique_ptr<chunk_list_t> opcodes_;
 
+  // The blocks opcodes() walks. Matchers that must keep opcodes from
+  // spanning some boundaries return a list with a sentinel at each.
+  virtual match_list_t const& opcode_blocks() {
+    return matching_blocks();
+  }
+
  private:
-  using b2j_t = std::unordered_map<hashable_type, std::vector<size_t>>;
-  using junk_set_t = std::unordered_set<hashable_type>;
+  static uint32_t const no_id = UINT32_MAX;
+
+  // Build the index of b if set_seq2 invalidated it, and look up the
+  // elements of a in it if set_seq1 did
+  void index() {
+    if (!b_indexed_) {
+      chain_b();
+      b_indexed_ = true;
+    }
+    if (!a_indexed_) {
+      a_ids_.resize(a_.size());
+      for(size_t i = 0; i < a_.size(); ++i) {
+        auto it = ids_.find(a_[i]);
+        a_ids_[i] = it == ids_.end() ? no_id : it->second;
+      }
+      a_indexed_ = true;
+    }
+  }
 
+  // Index b as a compressed sparse row table: every distinct element gets
+  // an ID, and the ascending positions of ID k in b are
+  // positions_[offsets_[k]] to positions_[offsets_[k+1]]. Junk and popular
+  // elements get empty rows. Two passes over b, one to count and one to
+  // fill, and no allocation when the buffers are already large enough.
   void chain_b() {
-    size_t index=0;
-   
-    // Counting occurences
-    b2j_.clear();
-    for(hashable_type const& elem : b_) b2j_[elem].push_back(index++);
-        
+    // Counting occurences, row k's count in offsets_[k+1]
+    ids_.clear();
+    offsets_.assign(1, 0);
+    b_ids_.resize(b_.size());
+    for(size_t j = 0; j < b_.size(); ++j) {
+      auto inserted = ids_.emplace(b_[j], static_cast<uint32_t>(offsets_.size()-1));
+      if (inserted.second) offsets_.push_back(0);
+      b_ids_[j] = inserted.first->second;
+      ++offsets_[b_ids_[j]+1];
+    }
+    size_t const count = ids_.size();
+
     // Purge junk elements
-    junk_set_.clear();
+    b_junk_.assign(count, false);
+    b_purged_.assign(count, false);
     if (is_junk_) {
-      for(auto it = b2j_.begin(); it != b2j_.end();) {
-        if(is_junk_(it->first)) {
-          junk_set_.insert(it->first);
-          it = b2j_.erase(it);
-        }
-        else {
-          ++it;
+      for(auto const& elem : ids_) {
+        if(is_junk_(elem.first)) {
+          b_junk_[elem.second] = true;
+          b_purged_[elem.second] = true;
         }
       }
     }
     
     // Purge popular elements that are not junk
-    popular_set_.clear();
     if (auto_junk_ && auto_junk_minsize_ <= b_.size()) {
       size_t ntest = b_.size()/100 + 1;
-      for(auto it = b2j_.begin(); it != b2j_.end();) {
-        if (ntest < it->second.size()) {
-          popular_set_.insert(it->first);
-          it = b2j_.erase(it);
-        }
-        else {
-          ++it;
-        }
+      for(size_t k = 0; k < count; ++k) {
+        if (ntest < offsets_[k+1]) b_purged_[k] = true;
       }
     }
+
+    // Turn counts into row starts, shifted by one so that filling the
+    // rows leaves offsets_[k+1] at the end of row k
+    size_t start = 0;
+    for(size_t k = 0; k < count; ++k) {
+      size_t rows = b_purged_[k] ? 0 : offsets_[k+1];
+      offsets_[k+1] = start;
+      start += rows;
+    }
+    positions_.resize(start);
+    for(size_t j = 0; j < b_.size(); ++j) {
+      uint32_t id = b_ids_[j];
+      if (!b_purged_[id]) positions_[offsets_[id+1]++] = j;
+    }
+
+    j2len_.resize(b_.size()+1);
   }
 
   bool auto_junk_ = true;
   std::size_t auto_junk_minsize_ = 200u;
-  b2j_t b2j_;
-  junk_set_t junk_set_;
-  junk_set_t popular_set_;
+  bool a_indexed_ = false;
+  bool b_indexed_ = false;
+  std::unordered_map<hashable_type, uint32_t> ids_;
+  std::vector<uint32_t> a_ids_;
+  std::vector<uint32_t> b_ids_;
+  std::vector<size_t> offsets_;
+  std::vector<size_t> positions_;
+  std::vector<bool> b_junk_;
+  std::vector<bool> b_purged_;
 
   // Cache to avoid reallocations
   std::vector<size_t> j2len_;
@@ -414,6 +634,75 @@ template <class T = std::string> class SequenceMatcher {
   std::vector<std::pair<size_t, size_t>> j2_values_to_erase_;
 };
 
+// A bottom-k MinHash sketch: the k smallest distinct hashes of all runs of
+// `shingle` consecutive elements of a sequence. Sketches are plain values
+// computed in one pass, so they can be cached per file, and two of them
+// estimate how similar their sequences are without reading them again.
+struct sketch_t {
+  std::vector<uint64_t> hashes;  // ascending, at most k of them
+  size_t k = 0;
+  size_t length = 0;
+};
+
+// splitmix64's finaliser, to spread std::hash values, which are often
+// the identity for integers, over all 64 bits
+inline uint64_t mix_hash(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+template <class T> sketch_t make_sketch(T const& seq, size_t k = 128, size_t shingle = 4) {
+  std::hash<typename T::value_type> hasher;
+  std::vector<uint64_t> elements;
+  elements.reserve(seq.size());
+  for(auto const& elem : seq) elements.push_back(mix_hash(hasher(elem)));
+
+  // Sequences shorter than a shingle are one shingle
+  size_t width = std::min(shingle, elements.size());
+  std::set<uint64_t> smallest;
+  for(size_t i = 0; width && i + width <= elements.size(); ++i) {
+    uint64_t h = 0;
+    for(size_t m = 0; m < width; ++m) h = mix_hash(h ^ elements[i+m]);
+    if (smallest.size() < k) {
+      smallest.insert(h);
+    } else if (h < *smallest.rbegin() && smallest.insert(h).second) {
+      smallest.erase(std::prev(smallest.end()));
+    }
+  }
+
+  sketch_t sketch;
+  sketch.hashes.assign(smallest.begin(), smallest.end());
+  sketch.k = k;
+  sketch.length = seq.size();
+  return sketch;
+}
+
+// Estimated Jaccard similarity of the shingle sets of two sketched
+// sequences: the share of the k smallest hashes of their union that
+// both have. Sketches must use the same shingle length.
+inline double sketch_similarity(sketch_t const& a, sketch_t const& b) {
+  size_t k = std::min(a.k, b.k);
+  size_t i = 0;
+  size_t j = 0;
+  size_t seen = 0;
+  size_t shared = 0;
+  while (seen < k && (i < a.hashes.size() || j < b.hashes.size())) {
+    if (j == b.hashes.size() || (i < a.hashes.size() && a.hashes[i] < b.hashes[j])) {
+      ++i;
+    } else if (i == a.hashes.size() || b.hashes[j] < a.hashes[i]) {
+      ++j;
+    } else {
+      ++shared;
+      ++i;
+      ++j;
+    }
+    ++seen;
+  }
+  if (seen == 0) return a.length == b.length ? 1.0 : 0.0;
+  return double(shared)/seen;
+}
+
 template <class T> auto MakeSequenceMatcher(
   T const& a
   , T const& b
@@ -64,8 +64,11 @@ void DiffMap::setup(Gtk::Scrollbar* scrollbar, std::function<std::vector<std::tu
     this->queue_draw();
 }
 
-void DiffMap::on_diffs_changed(std::tuple<std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::pair<difflib::chunk_t, difflib::chunk_t>>) {
-    this->_cached_map.clear();
+void DiffMap::on_diffs_changed(const ChunkDelta& delta) {
+    // Edits that only moved chunks along leave the map as it was
+    if (not delta.removed.empty() or not delta.added.empty()) {
+        this->_cached_map.clear();
+    }
 }
 
 void DiffMap::set_color_scheme(std::pair<std::map<Glib::ustring, Gdk::RGBA>, std::map<Glib::ustring, Gdk::RGBA>> color_map) {
@@ -21,9 +21,9 @@
 
 #include <gtkmm.h>
 #include <functional>
-#include <set>
 
 #include "difflib/src/difflib.h"
+#include "diffchunks.h"
 
 class DiffMap : public Gtk::DrawingArea {
 private:
@@ -50,7 +50,7 @@ public:
 
     void setup(Gtk::Scrollbar* scrollbar, std::function<std::vector<std::tuple<Glib::ustring, int, int>>()> change_chunk_fn, std::pair<std::map<Glib::ustring, Gdk::RGBA>, std::map<Glib::ustring, Gdk::RGBA>> color_map);
 
-    void on_diffs_changed(std::tuple<std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::pair<difflib::chunk_t, difflib::chunk_t>>);
+    void on_diffs_changed(const ChunkDelta& delta);
 
     void set_color_scheme(std::pair<std::map<Glib::ustring, Gdk::RGBA>, std::map<Glib::ustring, Gdk::RGBA>> color_map);
 
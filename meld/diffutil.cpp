@@ -18,273 +18,156 @@
 
 #include <gtkmm.h>
 #include <set>
+#include <atomic>
 #include <cassert>
+#include <thread>
+#include <exception>
+#include <limits>
 
 #include "matchers.h"
-#include "meldbuffer.h"
 #include "diffutil.h"
 #include "conf.h"
+#include "util/compat.h"
 
-static std::map<std::string, std::string> opcode_reverse = {
-    {"replace", "replace"},
-    {"insert", "delete"},
-    {"delete", "insert"},
-    {"conflict", "conflict"},
-    {"equal", "equal"}
-};
-
-
-static difflib::chunk_t reverse_chunk(const difflib::chunk_t& chunk) {
-    std::string tag = opcode_reverse[std::get<0>(chunk)];
-    return difflib::chunk_t(tag, std::get<3>(chunk), std::get<4>(chunk), std::get<1>(chunk), std::get<2>(chunk));
-}
-
-
-static std::pair<size_t, size_t> _find_blank_lines(std::string txt, const size_t& lo_, const size_t& hi_) {
-    size_t lo = lo_;
-    size_t hi = hi_;
-    while (lo < hi and not txt[lo]) {
-        lo += 1;
-    }
-    while (lo < hi and not txt[hi - 1]) {
-        hi -= 1;
+static difflib::Tag reverse_tag(difflib::Tag tag) {
+    if (tag == difflib::Tag::insert) {
+        return difflib::Tag::delete_;
+    } else if (tag == difflib::Tag::delete_) {
+        return difflib::Tag::insert;
     }
-    return std::pair<size_t, size_t>(lo, hi);
+    return tag;
 }
 
 
-static difflib::chunk_t consume_blank_lines(const difflib::chunk_t chunk, std::vector<std::string> texts, int pane1, int pane2) {
-    if (chunk == difflib::EMPTY_CHUNK) {
-        return difflib::EMPTY_CHUNK;
-    }
+static difflib::chunk_t reverse_chunk(const difflib::chunk_t& chunk) {
+    return difflib::chunk_t(reverse_tag(chunk.tag), chunk.j1, chunk.j2, chunk.i1, chunk.i2);
+}
 
-    std::string tag = std::get<0>(chunk);
-    std::pair<size_t, size_t> tmp;
-    tmp = _find_blank_lines(texts[pane1], std::get<1>(chunk), std::get<2>(chunk));
-    int c1 = tmp.first;
-    int c2 = tmp.second;
-    tmp = _find_blank_lines(texts[pane2], std::get<3>(chunk), std::get<4>(chunk));
-    int c3 = tmp.first;
-    int c4 = tmp.second;
 
-    if (c1 == c2 and c3 == c4) {
-        return difflib::EMPTY_CHUNK;
-    }
-    if (c1 == c2 and tag == "replace") {
-        tag = "insert";
-    } else if (c3 == c4 and tag == "replace") {
-        tag = "delete";
+struct _Differ::DiffJob {
+    TextSnapshot text1;
+    TextSnapshot textx;
+    int normalisation;
+    std::string algorithm;
+    std::chrono::milliseconds time_limit;
+    int move_min_lines;
+    MatchControl control;
+    difflib::chunk_list_t chunks;
+    bool approximate;
+    std::atomic<bool> done;
+    std::thread thread;
+
+    explicit DiffJob(Glib::Dispatcher& dispatcher) : control([&dispatcher] () { dispatcher.emit(); }), approximate(false), done(false) {}
+
+    /*! Intern the lines and work out the diff, on this job's thread, and wake the dispatcher */
+    void run(Glib::Dispatcher& dispatcher) {
+        try {
+            // The differ's line table belongs to the GUI thread, so each job
+            // has one of its own; IDs only need to match within the job
+            LineInterner interner;
+            interner.set_normalisation(this->normalisation);
+            std::vector<uint32_t> numbers1;
+            std::vector<uint32_t> numbersx;
+            line_ids_t lines1 = interner.intern_lines(this->text1.lines(0, this->text1.size()), 0, &numbers1);
+            line_ids_t linesx = interner.intern_lines(this->textx.lines(0, this->textx.size()), 0, &numbersx);
+
+            std::unique_ptr<MyersSequenceMatcher<line_ids_t>> matcher = make_matcher(this->algorithm, lines1, linesx);
+            matcher->set_time_limit(this->time_limit);
+            matcher->set_control(&this->control);
+            if (this->move_min_lines > 0) {
+                difflib::chunk_list_t changes = find_moves(matcher->get_difference_opcodes(), lines1, linesx, this->move_min_lines);
+                for (const difflib::chunk_t& c : changes) {
+                    this->chunks.push_back(map_chunk_lines(c, numbers1, 0, numbersx, 0));
+                }
+            } else {
+                for (const difflib::chunk_t& c : matcher->opcodes(true)) {
+                    this->chunks.push_back(map_chunk_lines(c, numbers1, 0, numbersx, 0));
+                }
+            }
+            this->approximate = matcher->approximate();
+        } catch (std::exception &) {
+            // Left to escape, this would end the program; an empty diff
+            // marked approximate still lets the differ finish and join
+            this->chunks.clear();
+            this->approximate = true;
+        }
+        this->done = true;
+        dispatcher.emit();
     }
-    return difflib::chunk_t(tag, c1, c2, c3, c4);
-}
-
+};
 
 _Differ::_Differ() : Glib::Object() {
     // Internally, diffs are stored from text1 -> text0 and text1 -> text2.
     this->num_sequences = 0;
     this->seqlength = {0, 0, 0};
     this->ignore_blanks = false;
+    this->normalisation = NORMALISE_NONE;
+    this->move_min_lines = 0;
+    this->algorithm = "myers";
+    this->time_limit = std::chrono::milliseconds::max();
     this->_initialised = false;
+    this->_approximate = false;
     this->_has_mergeable_changes = {false, false, false, false};
-    for (size_t seq = 0; seq < 3; seq++) {
-        _line_cache.push_back({});
-    }
+    this->_jobs_pending = false;
+    this->_job_dispatcher.connect(sigc::mem_fun(this, &_Differ::_on_job_dispatch));
 }
 
 _Differ::~_Differ() {
+    this->cancel();
+    // The jobs wake the dispatcher, so they can't outlive it
+    for (std::unique_ptr<DiffJob>& job : this->_cancelled_jobs) {
+        job->thread.join();
+    }
 }
 
-void _Differ::_update_merge_cache(std::vector<std::string> texts) {
+void _Differ::_update_merge_cache(const std::vector<TextSnapshot>& texts) {
     this->_merge_cache.clear();
     if (this->num_sequences == 3) {
-        for (std::pair<difflib::chunk_t, difflib::chunk_t> c : this->_merge_diffs(this->diffs.first, this->diffs.second, texts)) {
-             this->_merge_cache.push_back(c);
-        }
+        this->_merge_diffs(this->diffs.first.list(), this->diffs.second.list(), texts, this->_merge_cache);
     } else {
-        for (difflib::chunk_t c :this->diffs.first) {
+        const difflib::chunk_list_t& diffs = this->diffs.first.list();
+        this->_merge_cache.reserve(diffs.size());
+        for (const difflib::chunk_t& c : diffs) {
             this->_merge_cache.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(c, difflib::EMPTY_CHUNK));
         }
     }
 
-    if (this->ignore_blanks) {
-        // We don't handle altering the chunk-type of conflicts in three-way
-        // comparisons where e.g., pane 1 and 3 differ in blank lines
-        for (size_t i = 0; i < this->_merge_cache.size(); i++) {
-            std::pair<difflib::chunk_t, difflib::chunk_t> c = this->_merge_cache[i];
-            this->_merge_cache[i] = std::pair<difflib::chunk_t, difflib::chunk_t>(consume_blank_lines(c.first, texts, 1, 0),
-                                                                                  consume_blank_lines(c.second, texts, 1, 2));
-        }
-        std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> tmp;
-        for (std::pair<difflib::chunk_t, difflib::chunk_t> x : this->_merge_cache) {
-            if (x.first != difflib::EMPTY_CHUNK || x.second != difflib::EMPTY_CHUNK) {
-                tmp.push_back(x);
-            }
-        }
-        this->_merge_cache = tmp;
-    }
-
-    // Calculate chunks that were added (in the new but not the old merge
-    // cache), removed (in the old but not the new merge cache) and changed
-    // (where the edit actually occurred, *and* the chunk is still around).
-    // This information is used by the inline highlighting mechanism to
-    // avoid re-highlighting existing chunks.
-    std::set<std::pair<difflib::chunk_t, difflib::chunk_t>> tmp(this->_merge_cache.begin(), this->_merge_cache.end());
-    std::set<std::pair<difflib::chunk_t, difflib::chunk_t>> removed_chunks = this->_old_merge_cache;
-    for (auto x : tmp) {
-        std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>::iterator it;
-        for (it = removed_chunks.begin(); it != removed_chunks.end(); ++it) {
-            auto y = *it;
-            if (x == y) {
-                removed_chunks.erase(it);
-                break;
-            }
-        }
-    }
-    std::set<std::pair<difflib::chunk_t, difflib::chunk_t>> added_chunks = tmp;
-    for (auto x : this->_old_merge_cache) {
-        std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>::iterator it;
-        for (it = added_chunks.begin(); it != added_chunks.end(); ++it) {
-            auto y = *it;
-            if (x == y) {
-                added_chunks.erase(it);
-                break;
-            }
-        }
-    }
-    std::pair<difflib::chunk_t, difflib::chunk_t> modified_chunks = this->_changed_chunks;
-    if (std::find(removed_chunks.begin(), removed_chunks.end(), modified_chunks) != removed_chunks.end()) {
-        modified_chunks = { difflib::EMPTY_CHUNK,  difflib::EMPTY_CHUNK };
-    }
-    std::tuple<std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::pair<difflib::chunk_t, difflib::chunk_t>> chunk_changes(removed_chunks, added_chunks, modified_chunks);
-
-    bool mergeable0 = false;
-    bool mergeable1 = false;
-    for (std::pair<difflib::chunk_t, difflib::chunk_t> p : this->_merge_cache) {
-        difflib::chunk_t c0 = p.first;
-        difflib::chunk_t c1 = p.second;
-        mergeable0 = mergeable0 or (c0 != difflib::EMPTY_CHUNK and std::get<0>(c0) != "conflict");
-        mergeable1 = mergeable1 or (c1 != difflib::EMPTY_CHUNK and std::get<0>(c1) != "conflict");
-        if (mergeable0 and mergeable1) {
-            break;
-        }
-    }
-    this->_has_mergeable_changes = {false, mergeable0, mergeable1, false};
-
-    // Conflicts can only occur when there are three panes, and will always
-    // involve the middle pane.
-    this->conflicts.clear();
-    for (size_t i = 0; i < this->_merge_cache.size(); i++) {
-        std::pair<difflib::chunk_t, difflib::chunk_t> p = this->_merge_cache[i];
-        difflib::chunk_t c1 = p.first;
-        difflib::chunk_t c2 = p.second;
-        if ((c1 != difflib::EMPTY_CHUNK and std::get<0>(c1) == "conflict") or
-           (c2 != difflib::EMPTY_CHUNK and std::get<0>(c2) == "conflict")) {
-            this->conflicts.push_back(i);
-        }
+    // The whole cache was rebuilt, so every entry counts as added rather
+    // than comparing all of them with what was there before; only
+    // change_sequence() works out what actually changed, within its window
+    this->_old_merge_cache.clear();
+    ChunkDelta delta;
+    if (not this->_merge_cache.empty()) {
+        delta.added.push_back(std::pair<size_t, size_t>(0, this->_merge_cache.size()));
     }
 
-    this->_update_line_cache();
-    this->signal_diffs_changed().emit(chunk_changes);
+    this->_update_chunk_index();
+    this->_merge_cache_changed(delta);
 }
 
-int _Differ::_find_next(const int last_chunk, int diff, int seq, int current) {
-    int next_chunk = -1;
-    if (seq == 1 and current + 1 < last_chunk) {
-        next_chunk = current + 1;
-    } else {
-        for (int j = current + 1; j < last_chunk; j++) {
-            if ((diff == 0 ? this->_merge_cache[j].first : this->_merge_cache[j].second) != difflib::EMPTY_CHUNK) {
-                next_chunk = j;
-                break;
+/*! Index the entries of cache, numbered from base, by where they lie in each pane */
+static void index_entries(const MergeCache& cache, int base, std::array<ChunkIndex, 3>& index) {
+    for (size_t i = 0; i < cache.size(); i++) {
+        // Every entry has lines in the middle pane
+        for (int pane = 0; pane < 3; pane++) {
+            if (pane == 1 or cache.tag(i, pane / 2) != difflib::Tag::none) {
+                index[pane].add(cache.start(i, pane), cache.end(i, pane), base + i);
             }
         }
     }
-    return next_chunk;
 }
 
-void _Differ::_update_line_cache() {
-    for (size_t i = 0; i < this->seqlength.size(); i++) {
-        int l = this->seqlength[i];
-        // seqlength + 1 for after-last-line requests, which we do
-        std::vector<std::array<int, 3>> tmp;
-        for (int i = 0; i < l + 1; i++) {
-            tmp.push_back(std::array<int, 3>());
-        }
-        this->_line_cache[i] = tmp;
-    }
-
-    int last_chunk = this->_merge_cache.size();
-
-    std::vector<int> prev = {-1, -1, -1};
-    std::vector<int> next = {_find_next(last_chunk, 0, 0, -1), _find_next(last_chunk, 0, 1, -1), _find_next(last_chunk, 1, 2, -1)};
-    std::vector<int> old_end = {0, 0, 0};
-
-    for (size_t i = 0; i < this->_merge_cache.size(); i++) {
-        std::pair<difflib::chunk_t, difflib::chunk_t> c = this->_merge_cache[i];
-        std::vector<std::vector<int>> seq_params = {{0, 0, 3, 4}, {0, 1, 1, 2}, {1, 2, 3, 4}};
-        for (std::vector<int> _x : seq_params) {
-            int diff = _x[0];
-            int seq = _x[1];
-            int lo = _x[2];
-            int hi = _x[3];
-            if ((diff == 0 ? c.first : c.second) == difflib::EMPTY_CHUNK) {
-                if (seq == 1) {
-                    diff = 1;
-                } else {
-                    continue;
-                }
-            }
-
-            int start;
-            if (lo == 1) {
-                start = std::get<1>(diff == 0 ? c.first : c.second);
-            } else if (lo == 2) {
-                start = std::get<2>(diff == 0 ? c.first : c.second);
-            } else if (lo == 3) {
-                start = std::get<3>(diff == 0 ? c.first : c.second);
-            } else if (lo == 4) {
-                start = std::get<4>(diff == 0 ? c.first : c.second);
-            }
-            int end;
-            if (hi == 1) {
-                end = std::get<1>(diff == 0 ? c.first : c.second);
-            } else if (hi == 2) {
-                end = std::get<2>(diff == 0 ? c.first : c.second);
-            } else if (hi == 3) {
-                end = std::get<3>(diff == 0 ? c.first : c.second);
-            } else if (hi == 4) {
-                end = std::get<4>(diff == 0 ? c.first : c.second);
-            }
-            int last = old_end[seq];
-            if (start > last) {
-                for (int i = last; i < start; i++) {
-                    this->_line_cache[seq][i] = { 0, prev[seq], next[seq] };
-                }
-            }
-
-            // For insert chunks, claim the subsequent line.
-            if (start == end) {
-                end += 1;
-            }
-
-            next[seq] = _find_next(last_chunk, diff, seq, i);
-            for (int i = start; i < end; i++) {
-                this->_line_cache[seq][i] = { i, prev[seq], next[seq] };
-            }
-            prev[seq] = i;
-            old_end[seq] = end;
-        }
+void _Differ::_update_chunk_index() {
+    for (ChunkIndex& index : this->_chunk_index) {
+        index.clear();
     }
+    index_entries(this->_merge_cache, 0, this->_chunk_index);
+}
 
-    for (int seq = 0; seq < 3; seq++) {
-        int last = old_end[seq];
-        int end = this->_line_cache[seq].size();
-        if (last < end) {
-            for (int i = last; i < end; i++) {
-                this->_line_cache[seq][i] = { 0, prev[seq], next[seq] };
-            }
-        }
-    }
+void _Differ::_merge_cache_changed(const ChunkDelta& delta) {
+    this->_has_mergeable_changes = {false, this->_merge_cache.mergeable_count(0) > 0,
+                                    this->_merge_cache.mergeable_count(1) > 0, false};
+    this->signal_diffs_changed().emit(delta);
 }
 
 /*! Offset a chunk by o1/o2 if it's after the inserted lines */
@@ -292,44 +175,105 @@ difflib::chunk_t _Differ::offset(const difflib::chunk_t& c, int start, int o1, i
     if (c == difflib::EMPTY_CHUNK) {
         return difflib::EMPTY_CHUNK;
     }
-    size_t start_a = std::get<1>(c) + (std::get<1>(c) > start ? o1 : 0);
-    size_t end_a = std::get<2>(c) + (std::get<2>(c) > start ? o1 : 0);
-    size_t start_b = std::get<3>(c) + (std::get<3>(c) > start ? o2 : 0);
-    size_t end_b = std::get<4>(c) + (std::get<4>(c) > start ? o2 : 0);
-    return difflib::chunk_t(std::get<0>(c), start_a, end_a, start_b, end_b);
+    size_t start_a = c.i1 + (c.i1 > start ? o1 : 0);
+    size_t end_a = c.i2 + (c.i2 > start ? o1 : 0);
+    size_t start_b = c.j1 + (c.j1 > start ? o2 : 0);
+    size_t end_b = c.j2 + (c.j2 > start ? o2 : 0);
+    return difflib::chunk_t(c.tag, start_a, end_a, start_b, end_b);
 }
 
-void _Differ::change_sequence(int sequence, int startidx, int sizechange, std::vector<std::string> texts) {
+/*!
+ * Widen lo and hi, lines of the middle pane, until no chunk of either
+ * diff covers them
+ *
+ * DiffMerger only groups chunks that touch in the middle pane, so
+ * merging the chunks between two such lines gives just the entries
+ * merging everything would.
+ */
+static std::pair<int, int> merge_window(const std::pair<DiffChunks, DiffChunks>& diffs, int num_diffs, int lo, int hi) {
+    bool widened = true;
+    while (widened) {
+        widened = false;
+        for (int i = 0; i < num_diffs; i++) {
+            const DiffChunks& chunks = i == 0 ? diffs.first : diffs.second;
+            size_t at = chunks.locate(false, lo - 1);
+            if (at < chunks.size() and int(chunks[at].i1) <= lo) {
+                lo = chunks[at].i1 - 1;
+                widened = true;
+            }
+            at = chunks.locate(false, hi - 1);
+            if (at < chunks.size() and int(chunks[at].i1) <= hi) {
+                hi = chunks[at].i2 + 1;
+                widened = true;
+            }
+        }
+    }
+    return std::pair<int, int>(lo, hi);
+}
+
+void _Differ::change_sequence(int sequence, int startidx, int sizechange, const std::vector<TextSnapshot>& texts) {
     assert(sequence == 0 || sequence == 1 || sequence == 2);
+    if (this->_jobs_pending) {
+        // The diffs under way are of text that's gone; start over
+        this->set_sequences_iter(texts);
+        return;
+    }
+    // Lines of the middle pane that were diffed again, as they are now
+    std::pair<int, int> dirty(std::numeric_limits<int>::max(), -1);
     if (sequence == 0 or sequence == 1) {
-        this->_change_sequence(0, sequence, startidx, sizechange, texts);
+        std::pair<int, int> range1 = this->_change_sequence(0, sequence, startidx, sizechange, texts);
+        dirty = std::pair<int, int>(std::min(dirty.first, range1.first), std::max(dirty.second, range1.second));
     }
     if (sequence == 2 or (sequence == 1 and this->num_sequences == 3)) {
-        this->_change_sequence(1, sequence, startidx, sizechange, texts);
+        std::pair<int, int> range1 = this->_change_sequence(1, sequence, startidx, sizechange, texts);
+        dirty = std::pair<int, int>(std::min(dirty.first, range1.first), std::max(dirty.second, range1.second));
     }
     this->seqlength[sequence] += sizechange;
 
+    // Only the entries between the nearest lines around the re-diffed
+    // ones that no chunk covers are merged again. The merge cache is in
+    // order of middle pane lines, so those are found as the lines were
+    // before the change.
+    int num_diffs = std::max(this->num_sequences - 1, 0);
+    std::pair<int, int> window = merge_window(this->diffs, num_diffs, dirty.first - 1, dirty.second + 1);
+    size_t lo = this->_merge_cache.locate_middle(window.first);
+    size_t hi = this->_merge_cache.locate_middle(window.second - (sequence == 1 ? sizechange : 0));
+    difflib::chunk_list_t seq0 = this->diffs.first.slice(this->diffs.first.locate(false, window.first),
+                                                         this->diffs.first.locate(false, window.second));
+    MergeCache merged;
+    if (this->num_sequences == 3) {
+        difflib::chunk_list_t seq1 = this->diffs.second.slice(this->diffs.second.locate(false, window.first),
+                                                              this->diffs.second.locate(false, window.second));
+        this->_merge_diffs(seq0, seq1, texts, merged);
+    } else {
+        for (const difflib::chunk_t& c : seq0) {
+            merged.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(c, difflib::EMPTY_CHUNK));
+        }
+    }
+
     // Calculate the expected differences in the chunk set if no cascading
     // changes occur, making sure to not include the changed chunk itself
     this->_old_merge_cache.clear();
-    this->_changed_chunks = std::pair<difflib::chunk_t, difflib::chunk_t>(difflib::EMPTY_CHUNK, difflib::EMPTY_CHUNK);
-    bool chunk_changed = false;
-    for (std::pair<difflib::chunk_t, difflib::chunk_t> _x : this->_merge_cache) {
+    this->_old_merge_cache.reserve(hi - lo);
+    int changed = -1;
+    for (size_t i = lo; i < hi; i++) {
+        std::pair<difflib::chunk_t, difflib::chunk_t> _x = this->_merge_cache[i];
         difflib::chunk_t c1 = _x.first;
         difflib::chunk_t c2 = _x.second;
+        bool chunk_changed = false;
         if (sequence == 0) {
-            if (c1 != difflib::EMPTY_CHUNK and std::get<3>(c1) <= startidx && startidx < std::get<4>(c1)) {
+            if (c1 != difflib::EMPTY_CHUNK and c1.j1 <= startidx && startidx < c1.j2) {
                 chunk_changed = true;
             }
             c1 = offset(c1, startidx, 0, sizechange);
         } else if (sequence == 2) {
-            if (c2 != difflib::EMPTY_CHUNK and std::get<3>(c2) <= startidx && startidx < std::get<4>(c2)) {
+            if (c2 != difflib::EMPTY_CHUNK and c2.j1 <= startidx && startidx < c2.j2) {
                 chunk_changed = true;
             }
             c2 = offset(c2, startidx, 0, sizechange);
         } else {
             // Middle sequence changes alter both chunks
-            if (c1 != difflib::EMPTY_CHUNK and std::get<1>(c1) <= startidx && startidx < std::get<2>(c1)) {
+            if (c1 != difflib::EMPTY_CHUNK and c1.i1 <= startidx && startidx < c1.i2) {
                 chunk_changed = true;
             }
             c1 = offset(c1, startidx, sizechange, 0);
@@ -338,39 +282,36 @@ void _Differ::change_sequence(int sequence, int startidx, int sizechange, std::v
             }
         }
         if (chunk_changed) {
-#if 0
-            assert(not this->_changed_chunks);
-#endif
-            this->_changed_chunks = std::pair<difflib::chunk_t, difflib::chunk_t>(c1, c2);
-            chunk_changed = false;
+            assert(changed < 0);
+            changed = this->_old_merge_cache.size();
         }
-        this->_old_merge_cache.insert(std::pair<difflib::chunk_t, difflib::chunk_t>(c1, c2));
+        this->_old_merge_cache.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(c1, c2));
+    }
+    ChunkDelta delta = merge_cache_delta(this->_old_merge_cache, merged, changed);
+    for (std::pair<size_t, size_t>& range : delta.added) {
+        range.first += lo;
+        range.second += lo;
+    }
+    if (delta.modified >= 0) {
+        delta.modified += lo;
     }
 
-    this->_update_merge_cache(texts);
+    // Later entries move by the lines added, in O(log n)
+    std::array<ChunkIndex, 3> index;
+    index_entries(merged, lo, index);
+    this->_merge_cache.shift(hi, sequence, sizechange);
+    this->_merge_cache.splice(lo, hi, merged);
+    this->_chunk_index[sequence].shift_lines(hi, sizechange);
+    for (int pane = 0; pane < 3; pane++) {
+        this->_chunk_index[pane].splice(lo, hi, merged.size(), index[pane]);
+    }
+    this->_merge_cache_changed(delta);
 }
 
 /*! Find the index of the chunk which contains line. */
 int _Differ::_locate_chunk(int whichdiffs, int sequence, int line) {
-    int high_index = 2 + 2 * int(sequence != 1);
-    difflib::chunk_list_t _x = whichdiffs == 0 ? this->diffs.first : this->diffs.second;
-    for (size_t i = 0; i < _x.size(); i++) {
-        difflib::chunk_t c = _x[i];
-        int tmp;
-        if (high_index == 1) {
-            tmp = std::get<1>(c);
-        } else if (high_index == 2) {
-            tmp = std::get<2>(c);
-        } else if (high_index == 3) {
-            tmp = std::get<3>(c);
-        } else if (high_index == 4) {
-            tmp = std::get<4>(c);
-        }
-        if (line < tmp) {
-            return i;
-        }
-    }
-    return (whichdiffs == 0 ? this->diffs.first : this->diffs.second).size();
+    const DiffChunks& diffs = whichdiffs == 0 ? this->diffs.first : this->diffs.second;
+    return diffs.locate(sequence != 1, line);
 }
 
 /*!
@@ -381,7 +322,7 @@ int _Differ::_locate_chunk(int whichdiffs, int sequence, int line) {
  */
 difflib::chunk_t _Differ::get_chunk(int index, int from_pane, int to_pane) {
     int sequence = int(from_pane == 2 or to_pane == 2);
-    difflib::chunk_t chunk = sequence == 0 ? this->_merge_cache[index].first : this->_merge_cache[index].second;
+    difflib::chunk_t chunk = this->_merge_cache.chunk(index, sequence);
     if (from_pane == 0 || from_pane == 2) {
         if (chunk == difflib::EMPTY_CHUNK) {
             return difflib::EMPTY_CHUNK;
@@ -389,7 +330,7 @@ difflib::chunk_t _Differ::get_chunk(int index, int from_pane, int to_pane) {
         return reverse_chunk(chunk);
     } else {
         if (!to_pane and chunk == difflib::EMPTY_CHUNK) {
-            chunk = this->_merge_cache[index].second;
+            chunk = this->_merge_cache.chunk(index, 1);
         }
         return chunk;
     }
@@ -397,8 +338,9 @@ difflib::chunk_t _Differ::get_chunk(int index, int from_pane, int to_pane) {
 
 /*! Find the index of the chunk which contains line. */
 std::array<int, 3> _Differ::locate_chunk(int pane, int line) {
-    if (pane >= 0 && pane < 3 && line < this->_line_cache[pane].size()) {
-        return this->_line_cache[pane][line];
+    // seqlength + 1 for after-last-line requests, which we do
+    if (pane >= 0 && pane < int(this->seqlength.size()) && line >= 0 && line <= this->seqlength[pane]) {
+        return this->_chunk_index[pane].locate(line);
     } else {
         return {-1, -1, -1};
     }
@@ -408,17 +350,27 @@ int _Differ::diff_count() {
     return this->_merge_cache.size();
 }
 
+int _Differ::next_conflict(int chunk) {
+    size_t conflict = this->_merge_cache.next_conflict(chunk);
+    return conflict < this->_merge_cache.size() ? int(conflict) : -1;
+}
+
+int _Differ::previous_conflict(int chunk) {
+    size_t conflict = this->_merge_cache.previous_conflict(chunk);
+    return conflict < this->_merge_cache.size() ? int(conflict) : -1;
+}
+
 std::pair<bool, bool> _Differ::has_mergeable_changes(int which) {
     return std::pair<bool, bool>(this->_has_mergeable_changes[which], this->_has_mergeable_changes[which + 1]);
 }
 
 difflib::chunk_t _Differ::offset(const difflib::chunk_t& c, int o1, int o2) {
-    return difflib::chunk_t(std::get<0>(c), std::get<1>(c) + o1, std::get<2>(c) + o1,
-                                            std::get<3>(c) + o2, std::get<4>(c) + o2);
+    return difflib::chunk_t(c.tag, c.i1 + o1, c.i2 + o1,
+                                            c.j1 + o2, c.j2 + o2);
 }
 
-void _Differ::_change_sequence(int which, int sequence, int startidx, int sizechange, std::vector<std::string> texts) {
-    difflib::chunk_list_t diffs = which == 0 ? this->diffs.first : this->diffs.second;
+std::pair<int, int> _Differ::_change_sequence(int which, int sequence, int startidx, int sizechange, const std::vector<TextSnapshot>& texts) {
+    DiffChunks& diffs = which == 0 ? this->diffs.first : this->diffs.second;
     std::array<int, 3> lines_added = {0, 0, 0};
     lines_added[sequence] = sizechange;
     int loidx = this->_locate_chunk(which, sequence, startidx);
@@ -431,7 +383,7 @@ void _Differ::_change_sequence(int which, int sequence, int startidx, int sizech
     std::pair<int, int> lorange;
     if (loidx > 0) {
         loidx -= 1;
-        lorange = std::pair<int, int>(std::get<3>(diffs[loidx]), std::get<1>(diffs[loidx]));
+        lorange = std::pair<int, int>(diffs[loidx].j1, diffs[loidx].i1);
     } else {
         lorange = std::pair<int, int>(0, 0);
     }
@@ -439,50 +391,74 @@ void _Differ::_change_sequence(int which, int sequence, int startidx, int sizech
     std::pair<int, int> hirange;
     if (hiidx < diffs.size()) {
         hiidx += 1;
-        hirange = std::pair<int, int>(std::get<4>(diffs[hiidx - 1]), std::get<2>(diffs[hiidx - 1]));
+        hirange = std::pair<int, int>(diffs[hiidx - 1].j2, diffs[hiidx - 1].i2);
     } else {
         hirange = std::pair<int, int>(this->seqlength[x], this->seqlength[1]);
     }
     std::pair<int, int> rangex = std::pair<int, int>(lorange.first, hirange.first + lines_added[x]);
     std::pair<int, int> range1 = std::pair<int, int>(lorange.second, hirange.second + lines_added[1]);
     assert(rangex.first <= rangex.second and range1.first <= range1.second);
-    std::string linesx = texts[x].substr(rangex.first, rangex.second);
-    std::string lines1 = texts[1].substr(range1.first, range1.second);
-
-    MyersSequenceMatcher tmp(lines1, linesx);
-    difflib::chunk_list_t newdiffs = tmp.get_difference_opcodes();
-    for (size_t i = 0; i < newdiffs.size(); i++) {
-        difflib::chunk_t c = newdiffs[i];
-        newdiffs[i] = offset(c, range1.first, rangex.first);
+    // Only the lines of the window are compared, so the table needn't
+    // remember anything else. Once old versions of edited lines outnumber
+    // the lines of the panes, start it over rather than let it grow.
+    size_t total_lines = 0;
+    for (int length : this->seqlength) {
+        total_lines += length;
+    }
+    if (this->_interner.size() > total_lines) {
+        this->_interner.clear();
+    }
+    // Blank lines are skipped, if ignored, and lines normalised while they
+    // are interned, so chunks are mapped back to real line numbers
+    this->_interner.set_normalisation(this->normalisation | (this->ignore_blanks ? NORMALISE_SKIP_BLANK : 0));
+    std::vector<uint32_t> numbersx;
+    std::vector<uint32_t> numbers1;
+    line_ids_t linesx = this->_intern_lines(texts[x], rangex.first, rangex.second, &numbersx);
+    line_ids_t lines1 = this->_intern_lines(texts[1], range1.first, range1.second, &numbers1);
+
+    std::unique_ptr<MyersSequenceMatcher<line_ids_t>> matcher = make_matcher(this->algorithm, lines1, linesx);
+    matcher->set_time_limit(this->time_limit);
+    difflib::chunk_list_t newdiffs;
+    if (this->move_min_lines > 0) {
+        // Moves are only looked for within the re-diffed range
+        difflib::chunk_list_t changes = find_moves(matcher->get_difference_opcodes(), lines1, linesx, this->move_min_lines);
+        for (const difflib::chunk_t& c : changes) {
+            newdiffs.push_back(map_chunk_lines(c, numbers1, range1.first, numbersx, rangex.first));
+        }
+    } else {
+        for (const difflib::chunk_t& c : matcher->opcodes(true)) {
+            newdiffs.push_back(map_chunk_lines(c, numbers1, range1.first, numbersx, rangex.first));
+        }
     }
+    this->_approximate = this->_approximate or matcher->approximate();
 
-#if 0
-    if (hiidx < len(this->diffs[which])) {
-        offset_diffs = [offset(c, lines_added[1], lines_added[x]) for c
-                                              in this->diffs[which][hiidx:]];
-        this->diffs[which][hiidx:] = offset_diffs;
-    }
-    this->diffs[which][loidx:hiidx] = newdiffs;
-#endif
+    // Only the chunks in the re-diffed window are rewritten; the rest
+    // move by the lines added, in O(log n)
+    diffs.shift(hiidx, lines_added[1], lines_added[x]);
+    diffs.splice(loidx, hiidx, newdiffs);
+    return range1;
+}
+
+line_ids_t _Differ::_intern_lines(const TextSnapshot& text, int lo, int hi, std::vector<uint32_t>* line_numbers) {
+    return this->_interner.intern_lines(text.lines(lo, hi), lo, line_numbers);
 }
 
 std::pair<int, int> _Differ::_range_from_lines(int textindex, std::pair<int, int> lines) {
-    int lo_line = lines.first;
-    int hi_line = lines.second;
-    std::array<int, 3> top_chunk = this->locate_chunk(textindex, lo_line);
-    int start = top_chunk[0];
-    if (!start) {
-        start = top_chunk[2];
-    }
-    std::array<int, 3> bottom_chunk = this->locate_chunk(textindex, hi_line);
-    int end = bottom_chunk[0];
-    if (!end) {
-        end = bottom_chunk[1];
-    }
-    return std::pair<int, int>(start, end);
+    // Lines past the end still see the chunks before them
+    int lo_line = std::min(lines.first, this->seqlength[textindex]);
+    int hi_line = std::min(lines.second, this->seqlength[textindex]);
+    std::vector<int> chunks = this->_chunk_index[textindex].intersecting(lo_line, hi_line + 1);
+    if (chunks.empty()) {
+        return std::pair<int, int>(-1, -1);
+    }
+    return std::pair<int, int>(chunks.front(), chunks.back());
+}
+
+const MergeCache& _Differ::previous_changes() const {
+    return this->_old_merge_cache;
 }
 
-std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> _Differ::all_changes() {
+const MergeCache& _Differ::all_changes() const {
     return this->_merge_cache;
 }
 
@@ -490,40 +466,27 @@ std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> _Differ::all_changes(
 difflib::chunk_list_t _Differ::pair_changes(int fromindex, int toindex, std::vector<int> lines) {
     difflib::chunk_list_t result;
 
-    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> merge_cache;
-    if (std::find(lines.begin(), lines.end(), 0) == lines.end()) {
-        std::pair<int, int> tmp = this->_range_from_lines(fromindex, std::pair<int, int>(lines[0], lines[1]));
-        int start1 = tmp.first;
-        int end1 = tmp.second;
-        tmp = this->_range_from_lines(toindex, std::pair<int, int>(lines[2], lines[3]));
-        int start2 = tmp.first;
-        int end2 = tmp.second;
-        if ((start1 < 0 or end1 < 0) and
-            (start2 < 0 or end2 < 0)) {
+    size_t start = 0;
+    size_t end = this->_merge_cache.size();
+    if (std::find(lines.begin(), lines.end(), -1) == lines.end()) {
+        std::pair<int, int> range1 = this->_range_from_lines(fromindex, std::pair<int, int>(lines[0], lines[1]));
+        std::pair<int, int> range2 = this->_range_from_lines(toindex, std::pair<int, int>(lines[2], lines[3]));
+        if (range1.first < 0 and range2.first < 0) {
             return result;
+        } else if (range1.first < 0) {
+            range1 = range2;
+        } else if (range2.first < 0) {
+            range2 = range1;
         }
-#if 0
-        start = min([x for x in (start1, start2) if x is not None]);
-        end = max([x for x in (end1, end2) if x is not None]);
-        merge_cache = this->_merge_cache[start:end + 1];
-#endif
-    } else {
-        merge_cache = this->_merge_cache;
+        start = std::min(range1.first, range2.first);
+        end = std::max(range1.second, range2.second) + 1;
     }
 
-    if (fromindex == 1) {
-        int seq = toindex; // 2
-        for (std::pair<difflib::chunk_t, difflib::chunk_t> c : merge_cache) {
-            if ((seq == 0 ? c.first : c.second) != difflib::EMPTY_CHUNK) {
-                result.push_back(seq == 0 ? c.first : c.second);
-            }
-        }
-    } else {
-        int seq = fromindex; // 2
-        for (std::pair<difflib::chunk_t, difflib::chunk_t> c : merge_cache) {
-            if ((seq == 0 ? c.first : c.second) != difflib::EMPTY_CHUNK) {
-                result.push_back(reverse_chunk(seq == 0 ? c.first : c.second));
-            }
+    int seq = fromindex == 1 ? toindex : fromindex;
+    for (size_t i = start; i < end; i++) {
+        difflib::chunk_t c = this->_merge_cache.chunk(i, seq / 2);
+        if (c != difflib::EMPTY_CHUNK) {
+            result.push_back(fromindex == 1 ? c : reverse_chunk(c));
         }
     }
     return result;
@@ -532,31 +495,25 @@ difflib::chunk_list_t _Differ::pair_changes(int fromindex, int toindex, std::vec
 /*! Give changes for single file only. do not return 'equal' hunks. */
 difflib::chunk_list_t _Differ::single_changes(int textindex, std::pair<int, int> lines) {
     difflib::chunk_list_t result;
-#if 0
-    if (None not in lines) {
-        std::pair<int, int> tmp = this->_range_from_lines(textindex, lines);
-        start = tmp.first;
-        end = tmp.second;
-        if (start < 0 or end < 0) {
-            return difflib::EMPTY_CHUNK;
-        }
-        merge_cache = this->_merge_cache[start:end + 1];
+    std::vector<int> chunks;
+    if (lines.first >= 0 and lines.second >= 0) {
+        chunks = this->_chunk_index[textindex].intersecting(lines.first, lines.second + 1);
     } else {
-        merge_cache = this->_merge_cache;
+        for (size_t i = 0; i < this->_merge_cache.size(); i++) {
+            chunks.push_back(i);
+        }
     }
-    if (textindex == 0 || textindex == 2) {
-        int seq = textindex; // 2
-        for (int cs : merge_cache) {
-            if (cs[seq]) {
-                result.push_back(reverse_chunk(cs[seq]));
+    for (int i : chunks) {
+        std::pair<difflib::chunk_t, difflib::chunk_t> cs = this->_merge_cache[i];
+        if (textindex == 0 || textindex == 2) {
+            const difflib::chunk_t& c = textindex == 0 ? cs.first : cs.second;
+            if (c != difflib::EMPTY_CHUNK) {
+                result.push_back(reverse_chunk(c));
             }
-        }
-    } else {
-        for (int cs : merge_cache) {
-            result.push_back(cs[0] or cs[1]);
+        } else {
+            result.push_back(cs.first != difflib::EMPTY_CHUNK ? cs.first : cs.second);
         }
     }
-#endif
     return result;
 }
 
@@ -565,158 +522,178 @@ bool _Differ::sequences_identical() {
     return this->diffs.first.empty() && this->diffs.second.empty() and this->_initialised;
 }
 
-std::array<int, 6> _Differ::_merge_blocks(std::array<difflib::chunk_list_t, 2> _using) {
-    const int LO = 1;
-    const int HI = 2;
-    int lowc = std::min(std::get<LO>(_using[0][0]), std::get<LO>(_using[1][0]));
-    int highc = std::max(std::get<HI>(_using[0][-1]), std::get<HI>(_using[1][-1]));
-    std::vector<int> low;
-    std::vector<int> high;
+bool _Differ::is_approximate() {
+    return this->_approximate;
+}
+
+std::array<int, 6> _Differ::_merge_blocks(const std::array<ChunkSpan, 2>& _using) {
+    int lowc = std::min(_using[0].front().i1, _using[1].front().i1);
+    int highc = std::max(_using[0].back().i2, _using[1].back().i2);
+    std::array<int, 2> low;
+    std::array<int, 2> high;
     for (int i = 0; i < 2; i++) {
-        difflib::chunk_t d = _using[i][0];
-        low.push_back(lowc - std::get<LO>(d) + std::get<2 + LO>(d));
-        d = _using[i][-1];
-        high.push_back(highc - std::get<HI>(d) + std::get<2 + HI>(d));
+        const difflib::chunk_t& first = _using[i].front();
+        low[i] = lowc - first.i1 + first.j1;
+        const difflib::chunk_t& last = _using[i].back();
+        high[i] = highc - last.i2 + last.j2;
     }
     return std::array<int, 6>{low[0], high[0], lowc, highc, low[1], high[1]};
 }
 
-/*! Automatically merge two sequences of change blocks */
-std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> _Differ::_auto_merge(std::array<difflib::chunk_list_t, 2> _using, std::vector<std::string> texts) {
-    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> result;
-    for (;;) { // FIXME: unknown because yield
-        int l0, h0, l1, h1, l2, h2;
-        std::array<int, 6> tmp = this->_merge_blocks(_using);
-        l0 = tmp[0];
-        h0 = tmp[1];
-        l1 = tmp[2];
-        h1 = tmp[3];
-        l2 = tmp[4];
-        h2 = tmp[5];
-        std::string tag;
-#if 0
-        if (h0 - l0 == h2 - l2 and texts[0][l0:h0] == texts[2][l2:h2]) {
-            if (l1 != h1 and l0 == h0) {
-                tag = "delete";
-            } else if (l1 != h1) {
-                tag = "replace";
-            } else {
-                tag = "insert";
-            }
-        } else {
-#endif
-            tag = "conflict";
-#if 0
-        }
-#endif
-        difflib::chunk_t out0(tag, l1, h1, l0, h0);
-        difflib::chunk_t out1(tag, l1, h1, l2, h2);
-        result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
+void _Differ::_auto_merge(const std::array<ChunkSpan, 2>& _using, const std::vector<TextSnapshot>& texts,
+                          std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>>& out) {
+    std::array<int, 6> tmp = this->_merge_blocks(_using);
+    int l0 = tmp[0];
+    int h0 = tmp[1];
+    int l1 = tmp[2];
+    int h1 = tmp[3];
+    int l2 = tmp[4];
+    int h2 = tmp[5];
+
+    // Both sides made the same change if they ended up with the same
+    // lines; most conflicts differ early, so compare line by line
+    bool same = h0 - l0 == h2 - l2;
+    for (int i = 0; same and i < h0 - l0; i++) {
+        // Lines past the end of a text compare as empty
+        size_t line0 = l0 + i;
+        size_t line2 = l2 + i;
+        same = (line0 < texts[0].size() ? texts[0][line0] : text_view()) ==
+               (line2 < texts[2].size() ? texts[2][line2] : text_view());
+    }
+    difflib::Tag tag;
+    if (not same) {
+        tag = difflib::Tag::conflict;
+    } else if (l1 != h1 and l0 == h0) {
+        tag = difflib::Tag::delete_;
+    } else if (l1 != h1) {
+        tag = difflib::Tag::replace;
+    } else {
+        tag = difflib::Tag::insert;
     }
-    return result;
+    out.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(difflib::chunk_t(tag, l1, h1, l0, h0),
+                                                                difflib::chunk_t(tag, l1, h1, l2, h2)));
 }
 
-std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> _Differ::_merge_diffs(difflib::chunk_list_t seq0, difflib::chunk_list_t seq1, std::vector<std::string> texts) {
-    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> result;
-    std::vector<difflib::chunk_list_t>seq = {seq0, seq1};
-#if 0
-    while (seq0.size() or seq1.size()) {
-        int high_seq;
-        if (seq0.empty()) {
-            high_seq = 1;
-        } else if (seq1.empty()) {
-            high_seq = 0;
-        } else {
-            high_seq = int(std::get<1>(seq0[0]) > std::get<1>(seq1[0]));
-            if (std::get<1>(seq0[0]) == std::get<1>(seq1[0])) {
-                if (std::get<0>(seq0[0]) == "insert") {
-                    high_seq = 0;
-                } else if (std::get<0>(seq1[0]) == "insert") {
-                    high_seq = 1;
-                }
-            }
-        }
-
-        high_diff = seq[high_seq].pop(0);
-        int high_mark = std::get<2>(high_diff);
-        int other_seq;
-        if (high_seq == 1) {
-            other_seq = 0;
-        } else {
-            other_seq = 1;
-        }
-
-        std::array<difflib::chunk_list_t, 2> _using;
-        _using[high_seq].push_back(high_diff);
-
-        while (seq[other_seq]) {
-            difflib::chunk_t other_diff = seq[other_seq][0];
-            if (high_mark < std::get<1>(other_diff)) {
-                break;
-            }
-            if (high_mark == std::get<1>(other_diff) and
-               not (std::get<0>(high_diff) == std::get<0>(other_diff) == "insert")) {
-                break;
-            }
-
-            _using[other_seq].push_back(other_diff);
-            seq[other_seq].pop(0);
-
-            if (high_mark < std::get<2>(other_diff)) {
-                high_seq, other_seq = other_seq, high_seq;
-                high_mark = std::get<2>(other_diff);
-            }
-        }
-
-        if (_using[0].size() == 0) {
+void _Differ::_merge_diffs(const difflib::chunk_list_t& seq0, const difflib::chunk_list_t& seq1, const std::vector<TextSnapshot>& texts,
+                           MergeCache& out) {
+    DiffMerger merger(seq0, seq1);
+    std::array<ChunkSpan, 2> _using;
+    // Overlapping changes are merged here first, so that _auto_merge()
+    // overrides can still rework the entries they just added
+    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> merged;
+    while (merger.next(_using)) {
+        if (_using[0].empty()) {
             assert(_using[1].size() == 1);
-            result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(nullptr, _using[1][0]);
-        } else if (_using[1].size() == 0) {
+            out.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(difflib::EMPTY_CHUNK, _using[1].front()));
+        } else if (_using[1].empty()) {
             assert(_using[0].size() == 1);
-            result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(_using[0][0], nullptr));
+            out.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(_using[0].front(), difflib::EMPTY_CHUNK));
         } else {
-            for (std::pair<difflib::chunk_t, difflib::chunk_t> c : this->_auto_merge(_using, texts)) {
-                result.push_back(c);
+            merged.clear();
+            this->_auto_merge(_using, texts, merged);
+            for (const std::pair<difflib::chunk_t, difflib::chunk_t>& entry : merged) {
+                out.push_back(entry);
             }
         }
     }
-#endif
-    return result;
 }
 
-void _Differ::set_sequences_iter(std::vector<BufferLines*> sequences) {
+void _Differ::set_sequences_iter(const std::vector<TextSnapshot>& sequences) {
     assert(0 <= sequences.size() && sequences.size() <= 3);
+    this->cancel();
     this->diffs.first.clear();
     this->diffs.second.clear();
     this->num_sequences = sequences.size();
     this->seqlength.clear();
-#if 0
-    for (std::string s : sequences) {
-        this->seqlength.push_back(s.length());
+    this->_approximate = false;
+    this->_initialised = false;
+    this->_old_merge_cache.clear();
+    for (const TextSnapshot& s : sequences) {
+        this->seqlength.push_back(s.size());
     }
 
+    // Lines of the texts diffed before are of no more use
+    this->_interner.clear();
     for (int i = 0; i < this->num_sequences - 1; i++) {
-        MyersSequenceMatcher<std::string>* matcher;
-        if (!this->syncpoints.empty()) {
-            std::vector<std::pair<int, int>> syncpoints;
-            for (int s : this->syncpoints) {
-                syncpoints.push_back(std::pair<int, int>(s[i][0](), s[i][1]()));
-            }
-            matcher = new SyncPointMyersSequenceMatcher<MeldBuffer*>(0,
-                                         sequences[1], sequences[i * 2],
-                                         syncpoints);
+        std::unique_ptr<DiffJob> job(new DiffJob(this->_job_dispatcher));
+        job->text1 = sequences[1];
+        job->textx = sequences[i * 2];
+        job->normalisation = this->normalisation | (this->ignore_blanks ? NORMALISE_SKIP_BLANK : 0);
+        job->algorithm = this->algorithm;
+        job->time_limit = this->time_limit;
+        job->move_min_lines = this->move_min_lines;
+        this->_jobs.push_back(std::move(job));
+    }
+    this->_job_texts = sequences;
+    this->_jobs_pending = true;
+    for (std::unique_ptr<DiffJob>& job : this->_jobs) {
+        job->thread = std::thread(&DiffJob::run, job.get(), std::ref(this->_job_dispatcher));
+    }
+    if (this->_jobs.empty()) {
+        // Nothing to diff, but finish from the main loop all the same
+        this->_job_dispatcher.emit();
+    }
+}
+
+void _Differ::_on_job_dispatch() {
+    // Cancelled jobs that have since given up are joined here, so that
+    // cancel() never waits for a thread
+    for (size_t i = 0; i < this->_cancelled_jobs.size();) {
+        if (this->_cancelled_jobs[i]->done) {
+            this->_cancelled_jobs[i]->thread.join();
+            this->_cancelled_jobs.erase(this->_cancelled_jobs.begin() + i);
         } else {
-            matcher = new MyersSequenceMatcher<MeldBuffer*>(0, sequences[1], sequences[i * 2]);
+            i++;
         }
-        matcher->initialise();
-        this->diffs[i] = matcher.get_difference_opcodes();
     }
+    if (not this->_jobs_pending) {
+        // Left over from jobs that were cancelled
+        return;
+    }
+    float progress = 0;
+    bool done = true;
+    for (const std::unique_ptr<DiffJob>& job : this->_jobs) {
+        done = done and job->done;
+        progress += job->done ? 1 : job->control.progress();
+    }
+    if (not done) {
+        this->m_signal_diff_progress.emit(progress / this->_jobs.size());
+        return;
+    }
+
+    for (size_t i = 0; i < this->_jobs.size(); i++) {
+        DiffJob& job = *this->_jobs[i];
+        job.thread.join();
+        (i == 0 ? this->diffs.first : this->diffs.second) = DiffChunks(job.chunks);
+        this->_approximate = this->_approximate or job.approximate;
+    }
+    this->_jobs.clear();
+    this->_jobs_pending = false;
+    std::vector<TextSnapshot> texts;
+    texts.swap(this->_job_texts);
     this->_initialised = true;
-    this->_update_merge_cache(sequences);
-#endif
+    this->_update_merge_cache(texts);
+    this->m_signal_diffs_ready.emit();
+}
+
+bool _Differ::busy() const {
+    return this->_jobs_pending;
+}
+
+void _Differ::cancel() {
+    // Cancelled matchers give up within milliseconds, and wake the
+    // dispatcher when they do
+    for (std::unique_ptr<DiffJob>& job : this->_jobs) {
+        job->control.cancel();
+        this->_cancelled_jobs.push_back(std::move(job));
+    }
+    this->_jobs.clear();
+    this->_job_texts.clear();
+    this->_jobs_pending = false;
 }
 
 void _Differ::clear() {
+    this->cancel();
     this->diffs.first.clear();
     this->diffs.second.clear();
     this->seqlength.clear();
@@ -724,10 +701,9 @@ void _Differ::clear() {
         this->seqlength.push_back(0);
     }
     this->_initialised = false;
+    this->_approximate = false;
     this->_old_merge_cache.clear();
-    std::vector<std::string> tmp;
-    for (int i = 0; i < this->num_sequences; i++) {
-        tmp.push_back("");
-    }
+    this->_interner.clear();
+    std::vector<TextSnapshot> tmp(this->num_sequences);
     this->_update_merge_cache(tmp);
 }
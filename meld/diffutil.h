@@ -20,53 +20,101 @@
 #define __MELD__DIFFUTIL_H__
 
 #include <gtkmm.h>
-#include <set>
 #include <array>
+#include <chrono>
+#include <memory>
 #include "difflib/src/difflib.h"
-#include "meldbuffer.h"
+#include "diffchunks.h"
+#include "matchers.h"
+#include "textsnapshot.h"
 
 /*! Utility class to hold diff2 or diff3 chunks */
 class _Differ : public Glib::Object {
 public:
     std::vector<int> unresolved;
-    typedef sigc::signal<void, std::tuple<std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::pair<difflib::chunk_t, difflib::chunk_t>>> type_signal_diffs_changed;
+    /*! Emitted with what changed in the merge cache, see previous_changes() */
+    typedef sigc::signal<void, const ChunkDelta&> type_signal_diffs_changed;
     type_signal_diffs_changed signal_diffs_changed() {
         return m_signal_diffs_changed;
     }
     type_signal_diffs_changed m_signal_diffs_changed;
+    /*! Emitted with the fraction done, from 0 to 1, of the diffs set_sequences_iter() started */
+    typedef sigc::signal<void, float> type_signal_diff_progress;
+    type_signal_diff_progress signal_diff_progress() {
+        return m_signal_diff_progress;
+    }
+    type_signal_diff_progress m_signal_diff_progress;
+    /*! Emitted once the diffs set_sequences_iter() started are all in */
+    typedef sigc::signal<void> type_signal_diffs_ready;
+    type_signal_diffs_ready signal_diffs_ready() {
+        return m_signal_diffs_ready;
+    }
+    type_signal_diffs_ready m_signal_diffs_ready;
 private:
     int num_sequences;
     std::vector<int> seqlength;
-    std::pair<difflib::chunk_list_t, difflib::chunk_list_t> diffs;
+    /*! Changes from text1 to text0 and from text1 to text2 */
+    std::pair<DiffChunks, DiffChunks> diffs;
 public:
     std::vector<int> syncpoints;
-    std::vector<int> conflicts;
 private:
-    std::set<std::pair<difflib::chunk_t, difflib::chunk_t>> _old_merge_cache;
-    std::pair<difflib::chunk_t, difflib::chunk_t> _changed_chunks;
-    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> _merge_cache;
-    std::vector<std::vector<std::array<int, 3>>> _line_cache;
+    /*! The merge cache entries the last change replaced, offset by it */
+    MergeCache _old_merge_cache;
+    MergeCache _merge_cache;
+    /*! Where each merge cache entry lies in each pane */
+    std::array<ChunkIndex, 3> _chunk_index;
 public:
+    /*! Leave blank lines out of the comparison, as NORMALISE_SKIP_BLANK */
     bool ignore_blanks;
+    /*! LineNormalisation flags applied to every line before comparing */
+    int normalisation;
+    /*! Shortest run of lines shown as moved rather than changed; 0 for none */
+    int move_min_lines;
+    /*! Line matcher to use, one of the diff-algorithm setting choices */
+    std::string algorithm;
+    /*! Time each line matcher may take before settling for an approximate result */
+    std::chrono::milliseconds time_limit;
 private:
     bool _initialised;
+    bool _approximate;
     std::array<bool, 4> _has_mergeable_changes;
+    /*! A pairwise diff being worked out on a thread of its own */
+    struct DiffJob;
+    std::vector<std::unique_ptr<DiffJob>> _jobs;
+    /*! Jobs cancelled but maybe still running, joined once they're done */
+    std::vector<std::unique_ptr<DiffJob>> _cancelled_jobs;
+    bool _jobs_pending;
+    /*! The texts _jobs are diffing, for the merge cache once they finish */
+    std::vector<TextSnapshot> _job_texts;
+    /*! Woken from the jobs' threads as they progress and finish */
+    Glib::Dispatcher _job_dispatcher;
+
+    void _on_job_dispatch();
+    /*! Update what depends on the whole merge cache, and tell handlers about delta */
+    void _merge_cache_changed(const ChunkDelta& delta);
+protected:
+    /*! Line IDs for the lines change_sequence() diffs again, so that matchers compare integers */
+    LineInterner _interner;
 
 public:
 
     _Differ();
     virtual ~_Differ();
 
-    void _update_merge_cache(std::vector<std::string> texts);
-
-    int _find_next(const int last_chunk, int diff, int seq, int current);
+    void _update_merge_cache(const std::vector<TextSnapshot>& texts);
 
-    void _update_line_cache();
+    void _update_chunk_index();
 
     /*! Offset a chunk by o1/o2 if it's after the inserted lines */
     difflib::chunk_t offset(const difflib::chunk_t& c, int start, int o1, int o2);
 
-    void change_sequence(int sequence, int startidx, int sizechange, std::vector<std::string> texts);
+    /*!
+        Update the diffs after sizechange lines were added at startidx of sequence
+
+        Only the chunks around the change are diffed and merged again;
+        those after it are moved along lazily.
+     */
+    void change_sequence(int sequence, int startidx, int sizechange, const std::vector<TextSnapshot>& texts);
 
     /*! Find the index of the chunk which contains line. */
     int _locate_chunk(int whichdiffs, int sequence, int line);
@@ -79,37 +127,83 @@ public:
      */
     difflib::chunk_t get_chunk(int index, int from_pane, int to_pane = -1);
 
-    /*! Find the index of the chunk which contains line. */
+    /*!
+        Find the index of the chunk which contains line
+
+        Also gives the chunks before and after it in pane, as
+        ChunkIndex::locate() does. Lines past the end of the pane have
+        no chunks at all.
+     */
     std::array<int, 3> locate_chunk(int pane, int line);
 
     int diff_count();
 
+    /*! Index of the first conflict at or after chunk, or -1 */
+    int next_conflict(int chunk);
+
+    /*! Index of the last conflict at or before chunk, or -1 */
+    int previous_conflict(int chunk);
+
     std::pair<bool, bool> has_mergeable_changes(int which);
 
     difflib::chunk_t offset(const difflib::chunk_t& c, int o1, int o2);
 
-    void _change_sequence(int which, int sequence, int startidx, int sizechange, std::vector<std::string> texts);
+    /*! Diff again around the change, giving the middle pane lines that were diffed */
+    std::pair<int, int> _change_sequence(int which, int sequence, int startidx, int sizechange, const std::vector<TextSnapshot>& texts);
+
+    /*! Intern lines lo to hi of text using the shared line table */
+    line_ids_t _intern_lines(const TextSnapshot& text, int lo, int hi, std::vector<uint32_t>* line_numbers = nullptr);
 
     std::pair<int, int> _range_from_lines(int textindex, std::pair<int, int> lines);
 
-    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> all_changes();
+    /*!
+        The merge cache entries the last change replaced, offset by it
+
+        ChunkDelta::removed indexes this, so that signal_diffs_changed()
+        handlers can find the chunks that are gone. After a full diff it
+        is empty.
+     */
+    const MergeCache& previous_changes() const;
+
+    const MergeCache& all_changes() const;
 
     /*! Give all changes between file1 and either file0 or file2. */
-    difflib::chunk_list_t pair_changes(int fromindex, int toindex, std::vector<int> lines = {0, 0, 0, 0});
+    difflib::chunk_list_t pair_changes(int fromindex, int toindex, std::vector<int> lines = {-1, -1, -1, -1});
 
     /*! Give changes for single file only. do not return 'equal' hunks. */
-    difflib::chunk_list_t single_changes(int textindex, std::pair<int, int> lines = {0, 0});
+    difflib::chunk_list_t single_changes(int textindex, std::pair<int, int> lines = {-1, -1});
 
     bool sequences_identical();
 
-    std::array<int, 6> _merge_blocks(std::array<difflib::chunk_list_t, 2> _using);
+    /*! Whether any current diff ran out of time_limit and may not be minimal */
+    bool is_approximate();
+
+    std::array<int, 6> _merge_blocks(const std::array<ChunkSpan, 2>& _using);
 
-    /*! Automatically merge two sequences of change blocks */
-    virtual std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> _auto_merge(std::array<difflib::chunk_list_t, 2> _using, std::vector<std::string> texts);
+    /*! Automatically merge two sequences of change blocks, appending to out */
+    virtual void _auto_merge(const std::array<ChunkSpan, 2>& _using, const std::vector<TextSnapshot>& texts,
+                             std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>>& out);
+
+    /*! Merge the diffs from text1 to text0 and text2, appending to out */
+    void _merge_diffs(const difflib::chunk_list_t& seq0, const difflib::chunk_list_t& seq1, const std::vector<TextSnapshot>& texts,
+                      MergeCache& out);
+
+    /*!
+        Start working out the diffs between sequences
+
+        The 1 -> 0 and 1 -> 2 diffs, interning their lines included, are
+        each run on a thread of their own, while signal_diff_progress()
+        reports how far they have got. The diffs are in place once
+        signal_diffs_ready() is emitted; until then there are none.
+        Starting again, or changing a sequence, cancels the diffs under way.
+     */
+    void set_sequences_iter(const std::vector<TextSnapshot>& sequences);
 
-    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> _merge_diffs(difflib::chunk_list_t seq0, difflib::chunk_list_t seq1, std::vector<std::string> texts);
+    /*! Whether set_sequences_iter() is still working out diffs */
+    bool busy() const;
 
-    void set_sequences_iter(std::vector<BufferLines*> sequences);
+    /*! Stop any diffs set_sequences_iter() started, without waiting for their threads, and leave none */
+    void cancel();
 
     void clear();
 };
@@ -41,65 +41,86 @@
 #include "vcview.h"
 #include "const.h"
 
-int process_pool = 0;
-CachedSequenceMatcher::CachedSequenceMatcher() {
-    if (!this->process_pool) {
-#if MULTITHREADING
-#ifdef _WINDOWS
-        CachedSequenceMatcher::process_pool = ThreadPool(None);
-#else
-        // maxtasksperchild is new in Python 2.7; this is for 2.6 compat
-        try {
-            CachedSequenceMatcher::process_pool = Pool(
-                None, matchers.init_worker, maxtasksperchild=1);
-        } catch (TypeError &e) {
-            CachedSequenceMatcher::process_pool = Pool(
-                None, matchers.init_worker);
-        }
-#endif
-#endif
-    }
-    this->cache.clear();
+/*! Threads shared by every comparison for inline matching */
+static MatcherPool& inline_pool() {
+    static MatcherPool pool;
+    return pool;
+}
+
+/*! Bytes of inline match results kept across all comparisons */
+static const size_t inline_cache_budget = 16 << 20;
+
+struct CachedSequenceMatcher::Inbox {
+    std::mutex mutex;
+    std::vector<std::pair<InlineMatchCache::key_type, difflib::chunk_list_t>> results;
+    /*! Woken as results come in; null once the matcher is gone */
+    Glib::Dispatcher* dispatcher;
+};
+
+CachedSequenceMatcher::CachedSequenceMatcher() : inbox(std::make_shared<Inbox>()) {
+    this->inbox->dispatcher = &this->dispatcher;
+    this->dispatcher.connect(sigc::mem_fun(this, &CachedSequenceMatcher::on_results));
+}
+
+CachedSequenceMatcher::~CachedSequenceMatcher() {
+    inline_pool().cancel(this);
+    // Jobs still running hold on to the inbox, but have no one to tell
+    std::lock_guard<std::mutex> lock(this->inbox->mutex);
+    this->inbox->dispatcher = nullptr;
+}
+
+InlineMatchCache& CachedSequenceMatcher::shared_cache() {
+    static InlineMatchCache cache(inline_cache_budget);
+    return cache;
 }
 
 void CachedSequenceMatcher::match(Glib::ustring text1, Glib::ustring textn, std::function<void(difflib::chunk_list_t)> cb) {
-    if (this->cache.count(std::pair<Glib::ustring, Glib::ustring>(text1, textn)) > 0) {
-        this->cache[std::pair<Glib::ustring, Glib::ustring>(text1, textn)].second = time(0);
-        // FIXME: This idle should be totally unnecessary, and yet nothing
-        // gets highlighted without it, even though everything in the
-        // callback appears to run identically.
-#if MULTITHREADING
-        GLib.idle_add(lambda: cb(this->cache[std::pair<Glib::ustring, Glib::ustring>(text1, textn)].first));
-#else
-        cb(this->cache[std::pair<Glib::ustring, Glib::ustring>(text1, textn)].first);
-    #endif
-    } else {
-#if MULTITHREADING
-        def inline_cb(opcodes):
-            this->cache[(text1, textn)] = [opcodes, time.time()]
-            GLib.idle_add(lambda: cb(opcodes))
-        this->process_pool.apply_async(matchers.matcher_worker,
-                                      (text1, textn),
-                                      callback=inline_cb);
-#else
-        difflib::chunk_list_t opcodes = matcher_worker(text1, textn);
-        this->cache[std::pair<Glib::ustring, Glib::ustring>(text1, textn)] = std::pair<difflib::chunk_list_t, time_t>(opcodes, time(0));
+    key_type key = InlineMatchCache::key(text1.raw(), textn.raw());
+    difflib::chunk_list_t opcodes;
+    if (shared_cache().lookup(key, opcodes)) {
         cb(opcodes);
-#endif
+        return;
+    }
+    std::vector<std::function<void(difflib::chunk_list_t)>>& waiting = this->pending[key];
+    waiting.push_back(cb);
+    if (waiting.size() > 1) {
+        return;
     }
+    std::shared_ptr<Inbox> inbox = this->inbox;
+    inline_pool().submit(this, text1.raw(), textn.raw(), [inbox, key](const difflib::chunk_list_t& opcodes) {
+        std::lock_guard<std::mutex> lock(inbox->mutex);
+        if (inbox->dispatcher) {
+            inbox->results.push_back(std::make_pair(key, opcodes));
+            inbox->dispatcher->emit();
+        }
+    });
 }
 
-void CachedSequenceMatcher::clean(size_t size_hint) {
-    if (this->cache.size() < size_hint * 3) {
-        return;
+void CachedSequenceMatcher::on_results() {
+    std::vector<std::pair<key_type, difflib::chunk_list_t>> results;
+    {
+        std::lock_guard<std::mutex> lock(this->inbox->mutex);
+        results.swap(this->inbox->results);
     }
-#if 0
-    items = this->cache.items();
-    items.sort(key=lambda it: it[1][1]);
-    for (int item : items[:-size_hint * 2]) {
-        del this->cache[item[0]];
+    for (const std::pair<key_type, difflib::chunk_list_t>& result : results) {
+        // An empty result is what a failed match delivers: hand it to
+        // the callbacks, but don't keep it for the next lookup
+        if (not result.second.empty()) {
+            shared_cache().insert(result.first, result.second);
+        }
+        std::map<key_type, std::vector<std::function<void(difflib::chunk_list_t)>>>::iterator waiting = this->pending.find(result.first);
+        if (waiting == this->pending.end()) {
+            continue;
+        }
+        std::vector<std::function<void(difflib::chunk_list_t)>> callbacks;
+        callbacks.swap(waiting->second);
+        this->pending.erase(waiting);
+        // Each callback checks that its text is still there, and drops
+        // the result if it was edited or went away in the meantime
+        for (const std::function<void(difflib::chunk_list_t)>& cb : callbacks) {
+            cb(result.second);
+        }
     }
-#endif
 }
 
 struct TaskEntry {
@@ -272,6 +293,8 @@ FileDiff::FileDiff(int num_panes, SchedulerBase& scheduler) : MeldDoc(scheduler,
     this->_scroll_lock = false;
     this->linediffer = new _Differ();
     this->force_highlight = false;
+    this->force_exact = false;
+    this->diff_is_refresh = false;
     this->in_nested_textview_gutter_expose = false;
     this->_cached_match = new CachedSequenceMatcher();
     for (Glib::RefPtr<Gtk::TextBuffer> buf : this->textbuffer) {
@@ -358,6 +381,8 @@ FileDiff::FileDiff(int num_panes, SchedulerBase& scheduler) : MeldDoc(scheduler,
         t->signal_focus_out_event().connect(sigc::mem_fun(this, &FileDiff::on_current_diff_changed));
     }
     this->linediffer->signal_diffs_changed().connect(sigc::mem_fun(this, &FileDiff::on_diffs_changed));
+    this->linediffer->signal_diff_progress().connect(sigc::mem_fun(this, &FileDiff::on_diff_progress));
+    this->linediffer->signal_diffs_ready().connect(sigc::mem_fun(this, &FileDiff::on_diffs_ready));
     this->undosequence->signal_checkpointed().connect(sigc::mem_fun(this, &FileDiff::on_undo_checkpointed));
     this->signal_next_conflict_changed().connect(sigc::mem_fun(this, &FileDiff::on_next_conflict_changed));
 
@@ -401,11 +426,14 @@ SIGSEGV
 
 #if 0
     this->connect("notify::ignore-blank-lines", this->refresh_comparison)
+    this->connect("notify::diff-algorithm", this->refresh_comparison)
 #endif
     meldsettings->signal_changed().connect(sigc::mem_fun(this, &FileDiff::on_setting_changed));
 }
 
 FileDiff::~FileDiff() {
+    // Inline matches still under way call back into this
+    delete this->_cached_match;
 }
 
 int FileDiff::get_keymask() {
@@ -477,11 +505,13 @@ void FileDiff::on_style_updated() {
     this->fill_colors["delete"] =                  lookup(style, "insert-bg", "DarkSeaGreen1"),
     this->fill_colors["conflict"] =                lookup(style, "conflict-bg", "Pink"),
     this->fill_colors["replace"] =                 lookup(style, "replace-bg", "#ddeeff"),
+    this->fill_colors["move"] =                    lookup(style, "move-bg", "#eee0fa"),
     this->fill_colors["current-chunk-highlight"] = lookup(style, "current-chunk-highlight", "#ffffff");
     this->line_colors["insert"] =                  lookup(style, "insert-outline", "#77f077"),
     this->line_colors["delete"] =                  lookup(style, "insert-outline", "#77f077"),
     this->line_colors["conflict"] =                lookup(style, "conflict-outline", "#f0768b"),
     this->line_colors["replace"] =                 lookup(style, "replace-outline", "#8bbff3");
+    this->line_colors["move"] =                    lookup(style, "move-outline", "#b98ee6");
     this->highlight_color = lookup(style, "current-line-highlight", "#ffff00");
     this->syncpoint_color = lookup(style, "syncpoint-outline", "#555555");
 
@@ -607,17 +637,8 @@ void FileDiff::on_cursor_position_changed(Glib::RefPtr<Gtk::TextBuffer> buf, int
             this->m_signal_next_diff_changed.emit(prev >= 0, next_ >= 0);
         }
 
-        int prev_conflict = -1;
-        int next_conflict = -1;
-        for (int conflict : this->linediffer->conflicts) {
-            if (prev >= 0 and conflict <= prev) {
-                prev_conflict = conflict;
-            }
-            if (next_ >= 0 and conflict >= next_) {
-                next_conflict = conflict;
-                break;
-            }
-        }
+        int prev_conflict = prev >= 0 ? this->linediffer->previous_conflict(prev) : -1;
+        int next_conflict = next_ >= 0 ? this->linediffer->next_conflict(next_) : -1;
         if (prev_conflict != this->cursor->prev_conflict or
            next_conflict != this->cursor->next_conflict or force) {
             this->m_signal_next_conflict_changed.emit(prev_conflict >= 0, next_conflict >= 0);
@@ -634,7 +655,7 @@ void FileDiff::on_cursor_position_changed(Glib::RefPtr<Gtk::TextBuffer> buf, int
 
 bool FileDiff::on_current_diff_changed(GdkEventFocus* event) {
     int pane = this->_get_focused_pane();
-    int chunk_id = 0;
+    int chunk_id = -1;
     if (pane != -1) {
         // While this *should* be redundant, it's possible for focus pane
         // and cursor pane to be different in several situations.
@@ -679,8 +700,8 @@ bool FileDiff::on_current_diff_changed(GdkEventFocus* event) {
                          this->textview[pane + 1]->get_editable();
         if (pane == 0 or pane == 2) {
             difflib::chunk_t chunk = this->linediffer->get_chunk(chunk_id, pane);
-            bool insert_chunk = std::get<1>(chunk) == std::get<2>(chunk);
-            bool delete_chunk = std::get<3>(chunk) == std::get<4>(chunk);
+            bool insert_chunk = chunk.i1 == chunk.i2;
+            bool delete_chunk = chunk.j1 == chunk.j2;
             push_left = editable_left and not insert_chunk;
             push_right = editable_right and not insert_chunk;
             pull_left = pane == 2 and editable and not delete_chunk;
@@ -694,10 +715,10 @@ bool FileDiff::on_current_diff_changed(GdkEventFocus* event) {
             if (this->num_panes == 3) {
                 chunk2 = this->linediffer->get_chunk(chunk_id, 1, 2);
             }
-            bool left_mid_exists = chunk0 != difflib::EMPTY_CHUNK and std::get<1>(chunk0) != std::get<2>(chunk0);
-            bool left_exists = chunk0 != difflib::EMPTY_CHUNK and std::get<3>(chunk0) != std::get<4>(chunk0);
-            bool right_mid_exists = chunk2 != difflib::EMPTY_CHUNK and std::get<1>(chunk2) != std::get<2>(chunk2);
-            bool right_exists = chunk2 != difflib::EMPTY_CHUNK and std::get<3>(chunk2) != std::get<4>(chunk2);
+            bool left_mid_exists = chunk0 != difflib::EMPTY_CHUNK and chunk0.i1 != chunk0.i2;
+            bool left_exists = chunk0 != difflib::EMPTY_CHUNK and chunk0.j1 != chunk0.j2;
+            bool right_mid_exists = chunk2 != difflib::EMPTY_CHUNK and chunk2.i1 != chunk2.i2;
+            bool right_exists = chunk2 != difflib::EMPTY_CHUNK and chunk2.j1 != chunk2.j2;
             push_left = editable_left and left_mid_exists;
             push_right = editable_right and right_mid_exists;
             pull_left = editable and left_exists;
@@ -749,7 +770,7 @@ void FileDiff::on_next_conflict(GdkScrollDirection direction) {
 
     Glib::RefPtr<Gtk::TextBuffer> buf = this->textbuffer[this->cursor->pane];
     difflib::chunk_t chunk = this->linediffer->get_chunk(target, this->cursor->pane);
-    buf->place_cursor(buf->get_iter_at_line(std::get<1>(chunk)));
+    buf->place_cursor(buf->get_iter_at_line(chunk.i1));
     this->textview[this->cursor->pane]->scroll_to(
         buf->get_insert(), 0.1, 0.5, 0.5);
 }
@@ -766,7 +787,7 @@ void FileDiff::push_change(int direction) {
     int src = this->_get_focused_pane();
     int dst = src + direction;
     difflib::chunk_t chunk = this->linediffer->get_chunk(this->cursor->chunk, src, dst);
-    assert(src != -1 and this->cursor->chunk);
+    assert(src != -1 and this->cursor->chunk >= 0);
     assert(dst == 0 || dst == 1 || dst == 2);
     assert(chunk != difflib::EMPTY_CHUNK);
     this->replace_chunk(src, dst, chunk);
@@ -784,7 +805,7 @@ void FileDiff::pull_change(int direction) {
     int dst = this->_get_focused_pane();
     int src = dst + direction;
     difflib::chunk_t chunk = this->linediffer->get_chunk(this->cursor->chunk, src, dst);
-    assert(dst != -1 and this->cursor->chunk);
+    assert(dst != -1 and this->cursor->chunk >= 0);
     assert(src == 0 || src == 1 || src == 2);
     assert(chunk != difflib::EMPTY_CHUNK);
     this->replace_chunk(src, dst, chunk);
@@ -810,7 +831,7 @@ void FileDiff::copy_change(int direction, int copy_direction) {
     int src = this->_get_focused_pane();
     int dst = src + direction;
     difflib::chunk_t chunk = this->linediffer->get_chunk(this->cursor->chunk, src, dst);
-    assert(src != -1 and this->cursor->chunk);
+    assert(src != -1 and this->cursor->chunk >= 0);
     assert(dst == 0 || dst == 1 || dst == 2);
     assert(chunk != difflib::EMPTY_CHUNK);
     bool copy_up;
@@ -870,7 +891,7 @@ void FileDiff::merge_all_non_conflicting_changes() {
 void FileDiff::delete_change() {
     int pane = this->_get_focused_pane();
     difflib::chunk_t chunk = this->linediffer->get_chunk(this->cursor->chunk, pane);
-    assert(pane != -1 and this->cursor->chunk);
+    assert(pane != -1 and this->cursor->chunk >= 0);
     assert(chunk != difflib::EMPTY_CHUNK);
     this->delete_chunk(pane, chunk);
 }
@@ -901,33 +922,33 @@ difflib::chunk_t FileDiff::_synth_chunk(int pane0, int pane1, int line) {
     std::array<int, 3> t = this->linediffer->locate_chunk(pane0, line);
     int prev = t[1];
     int next_ = t[2];
-    if (prev) {
+    if (prev >= 0) {
         while (prev >= 0) {
             prev_chunk0 = this->linediffer->get_chunk(prev, pane0, pane1);
             prev_chunk1 = this->linediffer->get_chunk(prev, pane1, pane0);
             if (prev_chunk0 != difflib::EMPTY_CHUNK && prev_chunk1 != difflib::EMPTY_CHUNK) {
-                start0 = std::get<2>(prev_chunk0);
-                start1 = std::get<2>(prev_chunk1);
+                start0 = prev_chunk0.i2;
+                start1 = prev_chunk1.i2;
                 break;
             }
             prev -= 1;
         }
     }
 
-    if (next_) {
+    if (next_ >= 0) {
         while (next_ < this->linediffer->diff_count()) {
             next_chunk0 = this->linediffer->get_chunk(next_, pane0, pane1);
             next_chunk1 = this->linediffer->get_chunk(next_, pane1, pane0);
             if (next_chunk0 != difflib::EMPTY_CHUNK && next_chunk1 != difflib::EMPTY_CHUNK) {
-                end0 = std::get<1>(next_chunk0);
-                end1 = std::get<1>(next_chunk1);
+                end0 = next_chunk0.i1;
+                end1 = next_chunk1.i1;
                 break;
             }
             next_ += 1;
         }
     }
 
-    return difflib::chunk_t("Same", start0, end0, start1, end1);
+    return difflib::chunk_t(difflib::Tag::equal, start0, end0, start1, end1);
 }
 
 int FileDiff::_corresponding_chunk_line(int chunk, int line, int pane, int new_pane) {
@@ -945,17 +966,17 @@ int FileDiff::_corresponding_chunk_line(int chunk, int line, int pane, int new_p
     // chunk; if we establish the start/end of that chunk in both panes, we
     // can figure out what our new offset should be.
     difflib::chunk_t cur_chunk = difflib::EMPTY_CHUNK;
-    if (chunk) {
+    if (chunk >= 0) {
         cur_chunk = this->linediffer->get_chunk(chunk, pane, new_pane);
     }
 
     if (cur_chunk == difflib::EMPTY_CHUNK) {
         cur_chunk = this->_synth_chunk(pane, new_pane, line);
     }
-    int cur_start = std::get<1>(cur_chunk);
-    int cur_end = std::get<2>(cur_chunk);
-    int new_start = std::get<3>(cur_chunk);
-    int new_end = std::get<4>(cur_chunk);
+    int cur_start = cur_chunk.i1;
+    int cur_end = cur_chunk.i2;
+    int new_start = cur_chunk.j1;
+    int new_end = cur_chunk.j2;
 
     // If the new buffer's current cursor is already in the correct chunk,
     // assume that we have in-progress editing, and don't move it.
@@ -964,12 +985,12 @@ int FileDiff::_corresponding_chunk_line(int chunk, int line, int pane, int new_p
 
     int cursor_chunk = std::get<0>(this->linediffer->locate_chunk(new_pane, cursor_line));
     bool already_in_chunk;
-    if (cursor_chunk) {
+    if (cursor_chunk >= 0) {
         already_in_chunk = cursor_chunk == chunk;
     } else {
         difflib::chunk_t cursor_chunk = this->_synth_chunk(pane, new_pane, cursor_line);
-        already_in_chunk = std::get<3>(cursor_chunk) == new_start and
-                           std::get<4>(cursor_chunk) == new_end;
+        already_in_chunk = cursor_chunk.j1 == new_start and
+                           cursor_chunk.j2 == new_end;
     }
 
     int new_line;
@@ -1032,14 +1053,10 @@ bool FileDiff::on_textview_focus_out_event(GdkEventFocus* event) {
 
 void FileDiff::_after_text_modified(Glib::RefPtr<MeldBuffer> buffer, int startline, int sizechange) {
     if (this->num_panes > 1) {
-#if 0
-        int pane = find(this->textbuffer.begin(), this->textbuffer.end(), &buffer) - this->textbuffer.begin();
-#endif
+        int pane = std::find(this->textbuffer.begin(), this->textbuffer.end(), buffer) - this->textbuffer.begin();
         if (this->linediffer->syncpoints.empty()) {
-#if 0
             this->linediffer->change_sequence(pane, startline, sizechange,
-                                             this->buffer_filtered);
-#endif
+                                             this->_buffer_snapshots());
         }
         // FIXME: diff-changed signal for the current buffer would be cleaner
         int focused_pane = this->_get_focused_pane();
@@ -1051,6 +1068,14 @@ void FileDiff::_after_text_modified(Glib::RefPtr<MeldBuffer> buffer, int startli
     }
 }
 
+std::vector<TextSnapshot> FileDiff::_buffer_snapshots() {
+    std::vector<TextSnapshot> texts;
+    for (int i = 0; i < this->num_panes; i++) {
+        texts.push_back(this->textbuffer[i]->snapshot());
+    }
+    return texts;
+}
+
 std::string FileDiff::_filter_text(std::string txt) {
 
     std::function<std::string(std::ssub_match)> killit = [&] (std::ssub_match sm) {
@@ -1080,7 +1105,7 @@ std::string FileDiff::_filter_text(std::string txt) {
 #if 0
         try {
 #endif
-            if (filt->active) {
+            if (filt->active and filt->normalisation == NORMALISE_NONE) {
                 const std::regex re = std::regex("\\s+");
                 std::for_each(std::sregex_token_iterator(txt.begin(), txt.end(), re, {0,-1}),
                               std::sregex_token_iterator(),
@@ -1230,6 +1255,8 @@ Gtk::ResponseType FileDiff::on_delete_event(int appquit) {
         for (sigc::connection h : this->settings_handlers) {
             h.disconnect();
         }
+        // Nobody is left to see diffs still being worked out
+        this->linediffer->cancel();
     }
     // TODO: Base the return code on something meaningful for VC tools
     this->signal_close().emit(0);
@@ -1674,42 +1701,30 @@ void FileDiff::_load_files(std::vector<std::string> files, std::vector<Glib::Ref
 }
 
 void FileDiff::_diff_files(bool refresh) {
-#if 0
-    yield _("[%s] Computing differences") % this->label_text;
-#endif
-    std::vector<BufferLines*> texts(this->buffer_filtered.begin(), this->buffer_filtered.begin() + this->num_panes);
+    std::vector<TextSnapshot> texts = this->_buffer_snapshots();
     this->linediffer->ignore_blanks = settings->get_boolean("ignore-blank-lines");
-    this->linediffer->set_sequences_iter(texts);
-
-    if (not refresh) {
-        std::array<int, 3> tmp = this->linediffer->locate_chunk(1, 0);
-        int chunk = tmp[0];
-        int prev = tmp[1];
-        int next_ = tmp[2];
-        this->cursor->next = chunk;
-        if (this->cursor->next) {
-            this->cursor->next = next_;
-        }
-        for (Glib::RefPtr<Gtk::TextBuffer> buf : this->textbuffer) {
-            buf->place_cursor(buf->begin());
-        }
-
-        if (this->cursor->next) {
-            this->scheduler.add_task([this] () { this->next_diff(GDK_SCROLL_DOWN, true); }, true);
-        } else {
-            Glib::RefPtr<Gtk::TextBuffer> buf;
-            if (this->num_panes > 1) {
-                buf = this->textbuffer[1];
-            } else {
-                buf = this->textbuffer[0];
-            }
-            this->on_cursor_position_changed(buf, 0, true);
+    this->linediffer->normalisation = NORMALISE_NONE;
+    for (FilterEntry* f : this->text_filters) {
+        if (f->active) {
+            this->linediffer->normalisation |= f->normalisation;
         }
     }
-
-    this->queue_draw();
+    this->linediffer->algorithm = settings->get_string("diff-algorithm");
+    // Moves only make sense between two panes; three-way merging pairs
+    // changes up by position
+    this->linediffer->move_min_lines = this->num_panes == 2 ? 3 : 0;
+    // Rather than freeze on pathological files, settle for an approximate
+    // diff and offer to redo it properly.
+    if (this->force_exact) {
+        this->linediffer->time_limit = std::chrono::milliseconds::max();
+    } else {
+        this->linediffer->time_limit = std::chrono::milliseconds(2000);
+    }
+    this->diff_is_refresh = refresh;
+    this->on_diff_progress(0);
+    // Edits made while the diffs are worked out start them over
+    this->linediffer->set_sequences_iter(texts);
     this->_connect_buffer_handlers();
-    this->_set_merge_action_sensitivity();
 
     std::vector<Glib::RefPtr<Gsv::Language>> langs;
     for (int i = 0; i < this->num_panes; i++) {
@@ -1740,6 +1755,52 @@ void FileDiff::_diff_files(bool refresh) {
     }
 }
 
+void FileDiff::on_diff_progress(float progress) {
+    guint context = this->statusbar->get_context_id("diff");
+    boost::format fmt(_("[%s] Computing differences (%d%%)"));
+    fmt % this->label_text % int(progress * 100);
+    this->statusbar->remove_all_messages(context);
+    this->statusbar->push(fmt.str(), context);
+}
+
+void FileDiff::on_diffs_ready() {
+    this->statusbar->remove_all_messages(this->statusbar->get_context_id("diff"));
+    if (this->linediffer->is_approximate()) {
+        this->_prompt_approximate_diff();
+    }
+
+    if (not this->diff_is_refresh) {
+        // Diffs started over after an edit mustn't move the cursor again
+        this->diff_is_refresh = true;
+        std::array<int, 3> tmp = this->linediffer->locate_chunk(1, 0);
+        int chunk = tmp[0];
+        int prev = tmp[1];
+        int next_ = tmp[2];
+        this->cursor->next = chunk;
+        if (this->cursor->next < 0) {
+            this->cursor->next = next_;
+        }
+        for (Glib::RefPtr<Gtk::TextBuffer> buf : this->textbuffer) {
+            buf->place_cursor(buf->begin());
+        }
+
+        if (this->cursor->next >= 0) {
+            this->scheduler.add_task([this] () { this->next_diff(GDK_SCROLL_DOWN, true); }, true);
+        } else {
+            Glib::RefPtr<Gtk::TextBuffer> buf;
+            if (this->num_panes > 1) {
+                buf = this->textbuffer[1];
+            } else {
+                buf = this->textbuffer[0];
+            }
+            this->on_cursor_position_changed(buf, 0, true);
+        }
+    }
+
+    this->queue_draw();
+    this->_set_merge_action_sensitivity();
+}
+
 void FileDiff::_set_files_internal(std::vector<std::string> files) {
     this->_load_files(files, this->textbuffer);
     this->_diff_files();
@@ -1832,19 +1893,19 @@ void FileDiff::_set_merge_action_sensitivity() {
 }
 
 bool process_matches(difflib::chunk_t match, std::vector<int> offsets) {
-    if (std::get<0>(match) != "equal") {
+    if (match.tag != difflib::Tag::equal) {
         return true;
     }
     // Always keep matches occurring at the start or end
     bool start_or_end = (
-        (std::get<1>(match) == 0 and std::get<3>(match) == 0) or
-        (std::get<2>(match) == offsets[0] and std::get<4>(match) == offsets[1]));
+        (match.i1 == 0 and match.j1 == 0) or
+        (match.i2 == offsets[0] and match.j2 == offsets[1]));
     if (start_or_end) {
         return false;
     }
     // Remove equal matches of size less than 3
-    bool too_short = ((std::get<2>(match) - std::get<1>(match) < 3) or
-                      (std::get<4>(match) - std::get<3>(match) < 3));
+    bool too_short = ((match.i2 - match.i1 < 3) or
+                      (match.j2 - match.j1 < 3));
     return too_short;
 }
 
@@ -1884,8 +1945,8 @@ void apply_highlight(std::pair<Glib::RefPtr<MeldBuffer>, Glib::RefPtr<MeldBuffer
         Gtk::TextBuffer::iterator end = starts.first;
         int offset = start.get_offset();
         for (difflib::chunk_t o : matches) {
-            start.set_offset(offset + std::get<1 + 2 * 0>(o));
-            end.set_offset(offset + std::get<2 + 2 * 0>(o));
+            start.set_offset(offset + o.i1);
+            end.set_offset(offset + o.i2);
             bufs.first->apply_tag(tags.first, start, end);
         }
     }
@@ -1894,25 +1955,36 @@ void apply_highlight(std::pair<Glib::RefPtr<MeldBuffer>, Glib::RefPtr<MeldBuffer
         Gtk::TextBuffer::iterator end = starts.second;
         int offset = start.get_offset();
         for (difflib::chunk_t o : matches) {
-            start.set_offset(offset + std::get<1 + 2 * 1>(o));
-            end.set_offset(offset + std::get<2 + 2 * 1>(o));
+            start.set_offset(offset + o.j1);
+            end.set_offset(offset + o.j2);
             bufs.second->apply_tag(tags.second, start, end);
         }
     }
 }
 
-void FileDiff::on_diffs_changed(std::tuple<std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::pair<difflib::chunk_t, difflib::chunk_t>> chunk_changes) {
-    std::set<std::pair<difflib::chunk_t, difflib::chunk_t>> removed_chunks = std::get<0>(chunk_changes);
-    std::set<std::pair<difflib::chunk_t, difflib::chunk_t>> added_chunks = std::get<1>(chunk_changes);
-    std::pair<difflib::chunk_t, difflib::chunk_t> modified_chunks = std::get<2>(chunk_changes);
-
+void FileDiff::on_diffs_changed(const ChunkDelta& delta) {
     // We need to clear removed and modified chunks, and need to
-    // re-highlight added and modified chunks.
-    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> need_clearing(removed_chunks.begin(), removed_chunks.end());
-    std::sort(need_clearing.begin(), need_clearing.end());
+    // re-highlight added and modified chunks. Both lists come out of
+    // the delta in order.
+    const MergeCache& old_changes = this->linediffer->previous_changes();
+    const MergeCache& changes = this->linediffer->all_changes();
+    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> need_clearing;
+    for (const std::pair<size_t, size_t>& range : delta.removed) {
+        for (size_t i = range.first; i < range.second; i++) {
+            need_clearing.push_back(old_changes[i]);
+        }
+    }
     std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> need_highlighting;
-    need_highlighting.push_back(modified_chunks);
-    std::sort(need_highlighting.begin(), need_highlighting.end());
+    for (const std::pair<size_t, size_t>& range : delta.added) {
+        for (size_t i = range.first; i < range.second; i++) {
+            need_highlighting.push_back(changes[i]);
+        }
+    }
+    std::pair<difflib::chunk_t, difflib::chunk_t> modified_chunks(difflib::EMPTY_CHUNK, difflib::EMPTY_CHUNK);
+    if (delta.modified >= 0) {
+        modified_chunks = changes[delta.modified];
+        need_highlighting.push_back(modified_chunks);
+    }
 
     std::vector<Glib::RefPtr<Gtk::TextBuffer::Tag>> alltags;
     for (Glib::RefPtr<MeldBuffer> b : this->textbuffer) {
@@ -1922,7 +1994,7 @@ void FileDiff::on_diffs_changed(std::tuple<std::set<std::pair<difflib::chunk_t,
     for (std::pair<difflib::chunk_t, difflib::chunk_t> chunk : need_clearing) {
         for (int i = 0; i < 2; i++) {
             difflib::chunk_t c = (i == 0) ? chunk.first : chunk.second;
-            if (c == difflib::EMPTY_CHUNK or std::get<0>(c) != "replace") {
+            if (c == difflib::EMPTY_CHUNK or c.tag != difflib::Tag::replace) {
                 continue;
             }
             int to_idx;
@@ -1934,8 +2006,8 @@ void FileDiff::on_diffs_changed(std::tuple<std::set<std::pair<difflib::chunk_t,
             std::pair<Glib::RefPtr<MeldBuffer>, Glib::RefPtr<MeldBuffer>> bufs(this->textbuffer[1], this->textbuffer[to_idx]);
             std::pair<Glib::RefPtr<Gtk::TextBuffer::Tag>, Glib::RefPtr<Gtk::TextBuffer::Tag>> tags(alltags[1], alltags[to_idx]);
 
-            std::pair<Gtk::TextBuffer::iterator, Gtk::TextBuffer::iterator> starts(bufs.first->get_iter_at_line_or_eof(std::get<1>(c)), bufs.second->get_iter_at_line_or_eof(std::get<3>(c)));
-            std::pair<Gtk::TextBuffer::iterator, Gtk::TextBuffer::iterator> ends(bufs.first->get_iter_at_line_or_eof(std::get<2>(c)), bufs.second->get_iter_at_line_or_eof(std::get<4>(c)));
+            std::pair<Gtk::TextBuffer::iterator, Gtk::TextBuffer::iterator> starts(bufs.first->get_iter_at_line_or_eof(c.i1), bufs.second->get_iter_at_line_or_eof(c.j1));
+            std::pair<Gtk::TextBuffer::iterator, Gtk::TextBuffer::iterator> ends(bufs.first->get_iter_at_line_or_eof(c.i2), bufs.second->get_iter_at_line_or_eof(c.j2));
 
             bufs.first->remove_tag(tags.first, starts.first, ends.first);
             bufs.second->remove_tag(tags.second, starts.second, ends.second);
@@ -1951,7 +2023,9 @@ void FileDiff::on_diffs_changed(std::tuple<std::set<std::pair<difflib::chunk_t,
             } else {
                 c = chunk.second;
             }
-            if (c == difflib::EMPTY_CHUNK or std::get<0>(c) != "replace") {
+            // Moves are never re-diffed: find_moves() splits them out of
+            // replace chunks, and near-identical ones stay plain moves
+            if (c == difflib::EMPTY_CHUNK or c.tag != difflib::Tag::replace) {
                 continue;
             }
             int to_idx;
@@ -1963,8 +2037,8 @@ void FileDiff::on_diffs_changed(std::tuple<std::set<std::pair<difflib::chunk_t,
             std::pair<Glib::RefPtr<MeldBuffer>, Glib::RefPtr<MeldBuffer>> bufs (this->textbuffer[1], this->textbuffer[to_idx]);
             std::pair<Glib::RefPtr<Gtk::TextBuffer::Tag>, Glib::RefPtr<Gtk::TextBuffer::Tag>> tags(alltags[1], alltags[to_idx]);
 
-            std::pair<Gtk::TextBuffer::iterator, Gtk::TextBuffer::iterator> starts(bufs.first->get_iter_at_line_or_eof(std::get<1>(c)), bufs.second->get_iter_at_line_or_eof(std::get<3>(c)));
-            std::pair<Gtk::TextBuffer::iterator, Gtk::TextBuffer::iterator> ends(bufs.first->get_iter_at_line_or_eof(std::get<2>(c)), bufs.second->get_iter_at_line_or_eof(std::get<4>(c)));
+            std::pair<Gtk::TextBuffer::iterator, Gtk::TextBuffer::iterator> starts(bufs.first->get_iter_at_line_or_eof(c.i1), bufs.second->get_iter_at_line_or_eof(c.j1));
+            std::pair<Gtk::TextBuffer::iterator, Gtk::TextBuffer::iterator> ends(bufs.first->get_iter_at_line_or_eof(c.i2), bufs.second->get_iter_at_line_or_eof(c.j2));
 
             // We don't use this->buffer_texts here, as removing line
             // breaks messes with inline highlighting in CRLF cases
@@ -1998,8 +2072,6 @@ void FileDiff::on_diffs_changed(std::tuple<std::set<std::pair<difflib::chunk_t,
         }
     }
 
-    this->_cached_match->clean(this->linediffer->diff_count());
-
     this->_set_merge_action_sensitivity();
     if (this->linediffer->sequences_identical()) {
         bool error_message = false;
@@ -2098,6 +2170,39 @@ void FileDiff::_prompt_long_highlighting() {
     }
 }
 
+void FileDiff::on_msgarea_approximate_response(int /*Gtk::ResponseType*/ respid) {
+    for (MsgAreaController* mgr : this->msgarea_mgr) {
+        if (mgr->get_msg_id() == FileDiff::MSG_APPROXIMATE) {
+            mgr->clear();
+        }
+    }
+    if (respid == Gtk::RESPONSE_OK) {
+        this->force_exact = true;
+        this->refresh_comparison();
+    }
+}
+
+void FileDiff::_prompt_approximate_diff() {
+    for (size_t index = 0; index < this->msgarea_mgr.size(); index++) {
+        MsgAreaController* mgr = this->msgarea_mgr[index];
+        Gtk::InfoBar* msgarea = mgr->new_from_text_and_icon(
+            Gtk::Stock::INFO,
+            _("Comparison is approximate"),
+            _("These files took too long to compare exactly, so some "
+              "changes may be shown as larger than they really are. "
+              "You can have Meld compare them exactly, though this may "
+              "be slow."));
+        mgr->set_msg_id(FileDiff::MSG_APPROXIMATE);
+        Gtk::Button* button = msgarea->add_button(_("Hide"), Gtk::RESPONSE_CLOSE);
+        if (index == 0) {
+            button->property_label() = _("Hi_de");
+        }
+        msgarea->add_button(_("Compare exactly"), Gtk::RESPONSE_OK);
+        msgarea->signal_response().connect(sigc::mem_fun(this, &FileDiff::on_msgarea_approximate_response));
+        msgarea->show_all();
+    }
+}
+
 void FileDiff::on_msgarea_identical_response(int /*Gtk::ResponseType*/ respid) {
     for (MsgAreaController* mgr : this->msgarea_mgr) {
         mgr->clear();
@@ -2153,15 +2258,15 @@ bool FileDiff::on_textview_draw(const Cairo::RefPtr<Cairo::Context>& context, Me
     context->set_line_width(1.0);
 
     for (difflib::chunk_t change : this->linediffer->single_changes(pane, bounds)) {
-        int ypos0 = textview->get_y_for_line_num(std::get<1>(change)) - visible.get_y();
-        int ypos1 = textview->get_y_for_line_num(std::get<2>(change)) - visible.get_y();
+        int ypos0 = textview->get_y_for_line_num(change.i1) - visible.get_y();
+        int ypos1 = textview->get_y_for_line_num(change.i2) - visible.get_y();
 
         context->rectangle(-0.5, ypos0 - 0.5, width + 1, ypos1 - ypos0);
-        if (std::get<1>(change) != std::get<2>(change)) {
-            Gdk::RGBA tmp = this->fill_colors[std::get<0>(change)];
+        if (change.i1 != change.i2) {
+            Gdk::RGBA tmp = this->fill_colors[difflib::tag_name(change.tag)];
             context->set_source_rgba(tmp.get_red(), tmp.get_green(), tmp.get_blue(), tmp.get_alpha());
             context->fill_preserve();
-            if (std::get<0>(this->linediffer->locate_chunk(pane, std::get<1>(change))) == this->cursor->chunk) {
+            if (std::get<0>(this->linediffer->locate_chunk(pane, change.i1)) == this->cursor->chunk) {
                 Gdk::RGBA highlight = this->fill_colors["current-chunk-highlight"];
                 context->set_source_rgba(highlight.get_red(), highlight.get_green(), highlight.get_blue(),
                                          highlight.get_alpha());
@@ -2169,7 +2274,7 @@ bool FileDiff::on_textview_draw(const Cairo::RefPtr<Cairo::Context>& context, Me
             }
         }
 
-        Gdk::RGBA tmp = this->line_colors[std::get<0>(change)];
+        Gdk::RGBA tmp = this->line_colors[difflib::tag_name(change.tag)];
         context->set_source_rgba(tmp.get_red(), tmp.get_green(), tmp.get_blue(), tmp.get_alpha());
         context->stroke();
     }
@@ -2657,19 +2762,19 @@ void FileDiff::_sync_vscroll(Glib::RefPtr<const Gtk::Adjustment> adjustment, int
             int oend = this->textbuffer[i]->get_line_count();
             // look for the chunk containing 'line'
             for (difflib::chunk_t c : this->linediffer->pair_changes(master, i)) {
-                if (std::get<1>(c) >= line) {
-                    mend = std::get<1>(c);
-                    oend = std::get<3>(c);
+                if (c.i1 >= line) {
+                    mend = c.i1;
+                    oend = c.j1;
                     break;
-                } else if (std::get<2>(c) >= line) {
-                    mbegin = std::get<1>(c);
-                    mend = std::get<2>(c);
-                    obegin = std::get<3>(c);
-                    oend = std::get<4>(c);
+                } else if (c.i2 >= line) {
+                    mbegin = c.i1;
+                    mend = c.i2;
+                    obegin = c.j1;
+                    oend = c.j2;
                     break;
                 } else {
-                    mbegin = std::get<2>(c);
-                    obegin = std::get<4>(c);
+                    mbegin = c.i2;
+                    obegin = c.j2;
                 }
             }
             int fraction = (line - mbegin) / ((mend - mbegin) or 1);
@@ -2713,14 +2818,14 @@ std::function<std::vector<std::tuple<Glib::ustring, int, int>>()> FileDiff::coor
         std::vector<std::tuple<Glib::ustring, int, int>> result;
         for (difflib::chunk_t c : this->linediffer->single_changes(i)) {
             int y0, _dummy;
-            this->textview[buf_index]->get_line_yrange(this->textbuffer[buf_index]->get_iter_at_line(std::get<1>(c)), y0, _dummy);
-            if (std::get<1>(c) == std::get<2>(c)) {
+            this->textview[buf_index]->get_line_yrange(this->textbuffer[buf_index]->get_iter_at_line(c.i1), y0, _dummy);
+            if (c.i1 == c.i2) {
                 y = y0;
                 h = 0;
             } else {
-                this->textview[buf_index]->get_line_yrange(this->textbuffer[buf_index]->get_iter_at_line(std::get<2>(c) - 1), y, h);
+                this->textview[buf_index]->get_line_yrange(this->textbuffer[buf_index]->get_iter_at_line(c.i2 - 1), y, h);
             }
-            result.push_back(std::tuple<Glib::ustring, int, int>(std::get<0>(c), y0 / max_y, (y + h) / max_y));
+            result.push_back(std::tuple<Glib::ustring, int, int>(difflib::tag_name(c.tag), y0 / max_y, (y + h) / max_y));
         }
         return result;
     };
@@ -2807,8 +2912,8 @@ void FileDiff::next_diff(GdkScrollDirection direction, bool centered) {
 
     // Warp the cursor to the first line of next chunk
     Glib::RefPtr<MeldBuffer> buf = this->textbuffer[pane];
-    if (this->cursor->line != std::get<1>(chunk)) {
-        buf->place_cursor(buf->get_iter_at_line(std::get<1>(chunk)));
+    if (this->cursor->line != chunk.i1) {
+        buf->place_cursor(buf->get_iter_at_line(chunk.i1));
     }
     float tolerance = centered ? 0.0 : 0.2;
     this->textview[pane]->scroll_to(
@@ -2818,27 +2923,27 @@ void FileDiff::next_diff(GdkScrollDirection direction, bool centered) {
 void FileDiff::copy_chunk(int src, int dst, const difflib::chunk_t& chunk, bool copy_up) {
     Glib::RefPtr<MeldBuffer> b0 = this->textbuffer[src];
     Glib::RefPtr<MeldBuffer> b1 = this->textbuffer[dst];
-    Gtk::TextBuffer::iterator start = b0->get_iter_at_line_or_eof(std::get<1>(chunk));
-    Gtk::TextBuffer::iterator end = b0->get_iter_at_line_or_eof(std::get<2>(chunk));
+    Gtk::TextBuffer::iterator start = b0->get_iter_at_line_or_eof(chunk.i1);
+    Gtk::TextBuffer::iterator end = b0->get_iter_at_line_or_eof(chunk.i2);
     Glib::ustring t0 = b0->get_text(start, end, false);
 
     Gtk::TextBuffer::iterator  dst_start;
     Glib::RefPtr<Gtk::TextBuffer::Mark> mark0;
     Gtk::TextBuffer::iterator new_end;
     if (copy_up) {
-        if (std::get<2>(chunk) >= b0->get_line_count() and
-            std::get<3>(chunk) < b1->get_line_count()) {
+        if (chunk.i2 >= b0->get_line_count() and
+            chunk.j1 < b1->get_line_count()) {
             // TODO: We need to insert a linebreak here, but there is no
             // way to be certain what kind of linebreak to use.
             t0 = t0 + "\n";
         }
-        dst_start = b1->get_iter_at_line_or_eof(std::get<3>(chunk));
+        dst_start = b1->get_iter_at_line_or_eof(chunk.j1);
         mark0 = b1->create_mark("", dst_start, true);
-        new_end = b1->insert_at_line(std::get<3>(chunk), t0);
+        new_end = b1->insert_at_line(chunk.j1, t0);
     } else { // copy down
-        dst_start = b1->get_iter_at_line_or_eof(std::get<4>(chunk));
+        dst_start = b1->get_iter_at_line_or_eof(chunk.j2);
         mark0 = b1->create_mark("", dst_start, true);
-        new_end = b1->insert_at_line(std::get<4>(chunk), t0);
+        new_end = b1->insert_at_line(chunk.j2, t0);
     }
 
     Glib::RefPtr<Gtk::TextBuffer::Mark> mark1 = b1->create_mark("", new_end, true);
@@ -2855,15 +2960,15 @@ void FileDiff::copy_chunk(int src, int dst, const difflib::chunk_t& chunk, bool
 void FileDiff::replace_chunk(int src, int dst, const difflib::chunk_t& chunk) {
     Glib::RefPtr<MeldBuffer> b0 = this->textbuffer[src];
     Glib::RefPtr<MeldBuffer> b1 = this->textbuffer[dst];
-    Gtk::TextBuffer::iterator src_start = b0->get_iter_at_line_or_eof(std::get<1>(chunk));
-    Gtk::TextBuffer::iterator src_end = b0->get_iter_at_line_or_eof(std::get<2>(chunk));
-    Gtk::TextBuffer::iterator dst_start = b1->get_iter_at_line_or_eof(std::get<3>(chunk));
-    Gtk::TextBuffer::iterator dst_end = b1->get_iter_at_line_or_eof(std::get<4>(chunk));
+    Gtk::TextBuffer::iterator src_start = b0->get_iter_at_line_or_eof(chunk.i1);
+    Gtk::TextBuffer::iterator src_end = b0->get_iter_at_line_or_eof(chunk.i2);
+    Gtk::TextBuffer::iterator dst_start = b1->get_iter_at_line_or_eof(chunk.j1);
+    Gtk::TextBuffer::iterator dst_end = b1->get_iter_at_line_or_eof(chunk.j2);
     Glib::ustring t0 = b0->get_text(src_start, src_end, false);
     Glib::RefPtr<Gtk::TextBuffer::Mark> mark0 = b1->create_mark("", dst_start, true);
     this->on_textbuffer_begin_user_action();
     b1->erase(dst_start, dst_end);
-    Gtk::TextBuffer::iterator new_end = b1->insert_at_line(std::get<3>(chunk), t0);
+    Gtk::TextBuffer::iterator new_end = b1->insert_at_line(chunk.j1, t0);
     this->on_textbuffer_end_user_action();
     Glib::RefPtr<Gtk::TextBuffer::Mark> mark1 = b1->create_mark("", new_end, true);
     // FIXME: If the inserted chunk ends up being an insert chunk, then
@@ -2878,11 +2983,11 @@ void FileDiff::replace_chunk(int src, int dst, const difflib::chunk_t& chunk) {
 
 void FileDiff::delete_chunk(int src, const difflib::chunk_t& chunk) {
     Glib::RefPtr<MeldBuffer> b0 = this->textbuffer[src];
-    Gtk::TextBuffer::iterator it = b0->get_iter_at_line_or_eof(std::get<1>(chunk));
-    if (std::get<2>(chunk) >= b0->get_line_count()) {
+    Gtk::TextBuffer::iterator it = b0->get_iter_at_line_or_eof(chunk.i1);
+    if (chunk.i2 >= b0->get_line_count()) {
         it.backward_char();
     }
-    b0->erase(it, b0->get_iter_at_line_or_eof(std::get<2>(chunk)));
+    b0->erase(it, b0->get_iter_at_line_or_eof(chunk.i2));
     Glib::RefPtr<Gtk::TextBuffer::Mark> mark0 = b0->create_mark("", it, true);
     Glib::RefPtr<Gtk::TextBuffer::Mark> mark1 = b0->create_mark("", it, true);
     // TODO: Need a more specific colour here; conflict is wrong
@@ -44,25 +44,39 @@
 class LinkMap;
 
 /*!
- * Simple class for caching diff results, with LRU-based eviction
+ * Inline matching for a comparison, through a cache shared by all of them
  *
- * Results from the SequenceMatcher are cached and timestamped, and
- * subsequently evicted based on least-recent generation/usage. The LRU-based
- * eviction is overly simplistic, but is okay for our usage pattern.
+ * Results are kept in shared_cache(), by the content of both texts, so
+ * reopening a comparison or showing the same change in another tab finds
+ * them again. The cache evicts least recently used results once they
+ * take more than its byte budget.
  */
 class CachedSequenceMatcher {
 private:
-    static Glib::Threads::Thread* process_pool;
-    std::map<std::pair<Glib::ustring, Glib::ustring>, std::pair<difflib::chunk_list_t, time_t>> cache;
+    typedef InlineMatchCache::key_type key_type;
+    /*! Callbacks waiting for each match the worker pool is working out */
+    std::map<key_type, std::vector<std::function<void(difflib::chunk_list_t)>>> pending;
+    /*! Matches the pool has finished, waiting to be delivered */
+    struct Inbox;
+    std::shared_ptr<Inbox> inbox;
+    Glib::Dispatcher dispatcher;
+
+    void on_results();
 public:
     CachedSequenceMatcher();
-    void match(Glib::ustring text1, Glib::ustring textn, std::function<void(difflib::chunk_list_t)> cb);
+    ~CachedSequenceMatcher();
+
+    /*! The results of every comparison, with their hit and miss counts */
+    static InlineMatchCache& shared_cache();
+
     /*!
-     * Clean the cache if necessary
+     * Call cb with the inline opcodes between text1 and textn
      *
-     * @param size_hint: the recommended minimum number of cache entries
+     * Cached matches are given at once. Others are worked out on a
+     * shared pool of threads and given from the main loop once done;
+     * asking again for a match already under way doesn't start another.
      */
-    void clean(size_t size_hint);
+    void match(Glib::ustring text1, Glib::ustring textn, std::function<void(difflib::chunk_list_t)> cb);
 };
 
 class TextviewLineAnimation : Glib::Object {
@@ -129,6 +143,9 @@ private:
     bool _sync_hscroll_lock;
     bool _scroll_lock;
     bool force_highlight;
+    bool force_exact;
+    /*! Whether the diff under way is a refresh, which leaves the cursor be */
+    bool diff_is_refresh;
     std::vector<std::vector<Glib::RefPtr<Gtk::TextBuffer::Mark>>> syncpoints;
     bool in_nested_textview_gutter_expose;
     CachedSequenceMatcher* _cached_match;
@@ -143,7 +160,8 @@ public:
 private:
     std::map<Glib::ustring, Glib::ustring> __gsettings_bindings__ = {
         {"highlight-current-line", "highlight-current-line"},
-        {"ignore-blank-lines", "ignore-blank-lines"}
+        {"ignore-blank-lines", "ignore-blank-lines"},
+        {"diff-algorithm", "diff-algorithm"}
     };
 #if 0
 
@@ -162,6 +180,7 @@ public:
     static const int MSG_SAME = 0;
     static const int MSG_SLOW_HIGHLIGHT = 1;
     static const int MSG_SYNCPOINTS = 2;
+    static const int MSG_APPROXIMATE = 3;
 
     typedef sigc::signal<void, bool, bool> type_signal_next_conflict_changed;
     type_signal_next_conflict_changed signal_next_conflict_changed() {
@@ -291,6 +310,8 @@ public:
     bool on_textview_focus_in_event(GdkEventFocus* event, Gtk::TextView* view);
     bool on_textview_focus_out_event(GdkEventFocus* event);
     void _after_text_modified(Glib::RefPtr<MeldBuffer> buffer, int startline, int sizechange);
+    /*! Snapshots of the lines of each pane's buffer as they are now */
+    std::vector<TextSnapshot> _buffer_snapshots();
     std::string _filter_text(std::string txt);
     void after_text_insert_text(const Gtk::TextBuffer::iterator& it, const Glib::ustring& newtext, int textlen, Glib::RefPtr<MeldBuffer> buf);
     void after_text_delete_range(Glib::RefPtr<MeldBuffer> buffer, Gtk::TextBuffer::iterator it0, Gtk::TextBuffer::iterator it1);
@@ -327,6 +348,8 @@ public:
     Gtk::InfoBar* add_dismissable_msg(int pane, const Gtk::BuiltinStockID icon, std::string primary, std::string secondary);
     void _load_files(std::vector<std::string> files, std::vector<Glib::RefPtr<MeldBuffer>> textbuffers);
     void _diff_files(bool refresh = false);
+    void on_diff_progress(float progress);
+    void on_diffs_ready();
     virtual void _set_files_internal(std::vector<std::string> files);
     void on_file_changed_response(int /*Gtk::ResponseType*/ response_id, int pane);
     void set_meta(std::map<std::string, boost::variant<bool, std::string, int, std::vector<std::string>, VcView*>> meta);
@@ -334,9 +357,11 @@ public:
     /*! Refresh the view by clearing and redoing all comparisons */
     void refresh_comparison();
     void _set_merge_action_sensitivity();
-    void on_diffs_changed(std::tuple<std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::set<std::pair<difflib::chunk_t, difflib::chunk_t>>, std::pair<difflib::chunk_t, difflib::chunk_t>> chunk_changes);
+    void on_diffs_changed(const ChunkDelta& delta);
     void on_msgarea_highlighting_response(int /*Gtk::ResponseType*/ respid);
     void _prompt_long_highlighting();
+    void on_msgarea_approximate_response(int /*Gtk::ResponseType*/ respid);
+    void _prompt_approximate_diff();
     void on_msgarea_identical_response(int /*Gtk::ResponseType*/ respid);
     bool on_textview_draw(const Cairo::RefPtr<Cairo::Context>& context, MeldSourceView* textview);
     void _get_filename_for_saving(int title);
@@ -20,6 +20,7 @@
 #include "misc.h"
 #include "util/compat.h"
 #include "difflib/src/difflib.h"
+#include "matchers.h"
 
 #include "filters.h"
 
@@ -28,6 +29,7 @@ FilterEntry::FilterEntry(std::string label, bool active, std::shared_ptr<std::re
     this->active = active;
     this->filter = filter;
     this->filter_string = filter_string;
+    this->normalisation = NORMALISE_NONE;
 }
 
 std::unique_ptr<std::regex> FilterEntry::_compile_regex(std::string regex) {
@@ -84,7 +86,11 @@ FilterEntry* FilterEntry::parse(std::string string, FilterEntry::Type filter_typ
         active = false;
     }
     std::shared_ptr<std::regex> tmp{std::move(compiled)};
-    return new FilterEntry(name, active, tmp, filter_string);
+    FilterEntry* entry = new FilterEntry(name, active, tmp, filter_string);
+    if (filter_type == FilterEntry::REGEX) {
+        entry->normalisation = FilterEntry::regex_normalisation(filter_string);
+    }
+    return entry;
 }
 
 FilterEntry* FilterEntry::new_from_gsetting(std::tuple<std::string, bool, std::string> elements, FilterEntry::Type filter_type) {
@@ -96,7 +102,11 @@ FilterEntry* FilterEntry::new_from_gsetting(std::tuple<std::string, bool, std::s
         active = false;
     }
     std::shared_ptr<std::regex> tmp{std::move(compiled)};
-    return new FilterEntry(name, active, tmp, filter_string);
+    FilterEntry* entry = new FilterEntry(name, active, tmp, filter_string);
+    if (filter_type == FilterEntry::REGEX) {
+        entry->normalisation = FilterEntry::regex_normalisation(filter_string);
+    }
+    return entry;
 }
 
 std::unique_ptr<std::regex> FilterEntry::compile_filter(std::string filter_string, FilterEntry::Type filter_type) {
@@ -111,9 +121,74 @@ std::unique_ptr<std::regex> FilterEntry::compile_filter(std::string filter_strin
     return compiled;
 }
 
+/*! Whether a regex character class matches spaces and tabs and nothing but whitespace */
+static bool is_space_class(const std::string& cls) {
+    if (cls == "\\s") {
+        return true;
+    }
+    if (cls.size() < 3 or cls.front() != '[' or cls.back() != ']') {
+        return false;
+    }
+    bool space = false;
+    bool tab = false;
+    for (size_t i = 1; i + 1 < cls.size(); i++) {
+        if (cls[i] == ' ') {
+            space = true;
+            continue;
+        }
+        // Otherwise only escapes, and not of the closing bracket
+        if (cls[i] != '\\' or i + 2 >= cls.size()) {
+            return false;
+        }
+        char c = cls[++i];
+        if (c == 's') {
+            space = true;
+            tab = true;
+        } else if (c == 't') {
+            tab = true;
+        } else if (c != 'r' and c != 'f' and c != 'v') {
+            return false;
+        }
+    }
+    return space and tab;
+}
+
+int FilterEntry::regex_normalisation(const std::string& filter_string) {
+    // Dropping empty matches changes nothing, so * and + are alike. The
+    // normalisation treats space, tab, \r, \f and \v alike too, so a
+    // class that leaves out the rarer ones is taken to mean all of them
+    std::string body = filter_string;
+    bool leading = not body.empty() and body.front() == '^';
+    if (leading) {
+        body.erase(0, 1);
+    }
+    bool trailing = not body.empty() and body.back() == '$';
+    if (trailing) {
+        body.pop_back();
+    }
+    if (leading and trailing) {
+        // Blank lines only, which isn't a normalisation
+        return NORMALISE_NONE;
+    }
+    if (body.empty() or (body.back() != '*' and body.back() != '+')) {
+        return NORMALISE_NONE;
+    }
+    body.pop_back();
+    if (not is_space_class(body)) {
+        return NORMALISE_NONE;
+    }
+    if (leading) {
+        return NORMALISE_TRIM_LEADING;
+    } else if (trailing) {
+        return NORMALISE_TRIM_TRAILING;
+    }
+    return NORMALISE_IGNORE_SPACE;
+}
+
 FilterEntry::FilterEntry(const FilterEntry& other) {
     this->label = other.label;
     this->active = other.active;
     this->filter = other.filter;
     this->filter_string = other.filter_string;
+    this->normalisation = other.normalisation;
 }
@@ -36,6 +36,8 @@ public:
     bool active;
     std::shared_ptr<std::regex> filter;
     std::string filter_string;
+    /*! LineNormalisation flags that do this text filter's work as lines are hashed, or NORMALISE_NONE */
+    int normalisation;
 
     FilterEntry(std::string label, bool active, std::shared_ptr<std::regex> filter, std::string filter_string);
 
@@ -49,6 +51,17 @@ public:
 
     static std::unique_ptr<std::regex> compile_filter(std::string filter_string, FilterEntry::Type filter_type);
 
+    /*!
+     * LineNormalisation flags equivalent to a text filter's regex
+     *
+     * Only whitespace filters shaped like the stock ones in the
+     * text-filters schema key are recognised: a class of whitespace
+     * taking in at least spaces and tabs, repeated with * or +, and
+     * anchored with ^ or $ or not at all. Anything else gives
+     * NORMALISE_NONE and is applied as a regex.
+     */
+    static int regex_normalisation(const std::string& filter_string);
+
     FilterEntry(const FilterEntry& other);
 };
 
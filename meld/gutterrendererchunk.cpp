@@ -49,13 +49,13 @@ GutterRendererChunkAction::GutterRendererChunkAction(int from_pane, int to_pane,
 void GutterRendererChunkAction::on_activate(const Gtk::TextIter& start, const Gdk::Rectangle& area, GdkEvent* event) {
     int line = start.get_line();
     int chunk_index = this->linediffer->locate_chunk(this->from_pane, line)[0];
-    if (!chunk_index) {
+    if (chunk_index < 0) {
         return;
     }
 
     // FIXME: This is all chunks, not just those shared with to_pane
     difflib::chunk_t chunk = this->linediffer->get_chunk(chunk_index, this->from_pane);
-    if (std::get<1>(chunk) != line) {
+    if (chunk.i1 != line) {
         return;
     }
 
@@ -101,7 +101,7 @@ bool GutterRendererChunkAction::on_query_activatable(const Gtk::TextIter& start,
     if (chunk_index >= 0) {
         // FIXME: This is all chunks, not just those shared with to_pane
         difflib::chunk_t chunk = this->linediffer->get_chunk(chunk_index, this->from_pane);
-        if (std::get<1>(chunk) == line) {
+        if (chunk.i1 == line) {
             return true;
         }
     }
@@ -116,7 +116,7 @@ void GutterRendererChunkAction::on_query_data(const Gtk::TextIter& start, const
     if (chunk_index >= 0) {
         difflib::chunk_t chunk = this->linediffer->get_chunk(
                     chunk_index, this->from_pane, this->to_pane);
-        if (chunk != difflib::EMPTY_CHUNK and std::get<1>(chunk) == line) {
+        if (chunk != difflib::EMPTY_CHUNK and chunk.i1 == line) {
             int action = this->_classify_change_actions(chunk);
             pixbuf = this->action_map[action];
         }
@@ -148,26 +148,29 @@ int GutterRendererChunkAction::_classify_change_actions(const difflib::chunk_t&
     }
 
     // Reclassify conflict changes, since we treat them the same as a
-    // normal two-way change as far as actions are concerned
-    std::string change_type = std::get<0>(change);
-    if (change_type == "conflict") {
-        if (std::get<1>(change) == std::get<2>(change)) {
-            change_type = "insert";
-        } else if (std::get<3>(change) == std::get<4>(change)) {
-            change_type = "delete";
+    // normal two-way change as far as actions are concerned. Either side
+    // of a move is a plain delete or insert here.
+    difflib::Tag change_type = change.tag;
+    if (change_type == difflib::Tag::move) {
+        change_type = change.i1 == change.i2 ? difflib::Tag::insert : difflib::Tag::delete_;
+    } else if (change_type == difflib::Tag::conflict) {
+        if (change.i1 == change.i2) {
+            change_type = difflib::Tag::insert;
+        } else if (change.j1 == change.j2) {
+            change_type = difflib::Tag::delete_;
         } else {
-            change_type = "replace";
+            change_type = difflib::Tag::replace;
         }
     }
 
     int action = -1;
-    if (change_type == "delete") {
+    if (change_type == difflib::Tag::delete_) {
         if (editable and (this->mode == MODE_DELETE or not other_editable)) {
             action = MODE_DELETE;
         } else if (other_editable) {
             action = MODE_REPLACE;
         }
-    } else if (change_type == "replace") {
+    } else if (change_type == difflib::Tag::replace) {
         if (not editable) {
             if (this->mode == MODE_INSERT || this->mode == MODE_REPLACE) {
                 action = this->mode;
@@ -94,10 +94,10 @@ void LinkMap::do_draw(Cairo::RefPtr<Cairo::Context> context) {
     int right = this->view_indices[1];
     for (difflib::chunk_t c : this->filediff->linediffer->pair_changes(left, right, visible)) {
         // f and t are short for "from" and "to"
-        int f0 = (this->views[0]->get_y_for_line_num(1) - pix_start[0] + y_offset[0]);
-        int f1 = (this->views[0]->get_y_for_line_num(2) - pix_start[0] + y_offset[0]);
-        int t0 = (this->views[1]->get_y_for_line_num(3) - pix_start[1] + y_offset[1]);
-        int t1 = (this->views[1]->get_y_for_line_num(4) - pix_start[1] + y_offset[1]);
+        int f0 = (this->views[0]->get_y_for_line_num(c.i1) - pix_start[0] + y_offset[0]);
+        int f1 = (this->views[0]->get_y_for_line_num(c.i2) - pix_start[0] + y_offset[0]);
+        int t0 = (this->views[1]->get_y_for_line_num(c.j1) - pix_start[1] + y_offset[1]);
+        int t1 = (this->views[1]->get_y_for_line_num(c.j2) - pix_start[1] + y_offset[1]);
 
         // If either endpoint is completely off-screen, we cull for clarity
         if ((t0 < 0 and t1 < 0) or (t0 > height and t1 > height)) {
@@ -128,11 +128,11 @@ void LinkMap::do_draw(Cairo::RefPtr<Cairo::Context> context) {
             context->close_path();
         }
 
-        Gdk::RGBA tmp = this->fill_colors[std::get<0>(c)];
+        Gdk::RGBA tmp = this->fill_colors[difflib::tag_name(c.tag)];
         context->set_source_rgba(tmp.get_red(), tmp.get_green(), tmp.get_blue(), tmp.get_alpha());
         context->fill_preserve();
 
-        int chunk_idx = this->filediff->linediffer->locate_chunk(left, std::get<1>(c))[0];
+        int chunk_idx = this->filediff->linediffer->locate_chunk(left, c.i1)[0];
         if (chunk_idx == this->filediff->cursor->chunk) {
             Gdk::RGBA highlight = this->fill_colors["current-chunk-highlight"];
             context->set_source_rgba(highlight.get_red(), highlight.get_green(), highlight.get_blue(),
@@ -140,7 +140,7 @@ void LinkMap::do_draw(Cairo::RefPtr<Cairo::Context> context) {
             context->fill_preserve();
         }
 
-        tmp = this->line_colors[std::get<0>(c)];
+        tmp = this->line_colors[difflib::tag_name(c.tag)];
         context->set_source_rgba(tmp.get_red(), tmp.get_green(), tmp.get_blue(), tmp.get_alpha());
         context->stroke();
     }
@@ -17,8 +17,22 @@
  */
 
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <array>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <limits>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <boost/functional/hash.hpp>
 #include "difflib/src/difflib.h"
+#include "util/bits.h"
 #include "util/compat.h"
 
 #include "matchers.h"
@@ -34,89 +48,868 @@ void init_worker() {
     signal(SIGINT, SIG_IGN);
 }
 
-difflib::chunk_list_t matcher_worker(std::string text1, std::string textn) {
+difflib::chunk_list_t matcher_worker(const std::string& text1, const std::string& textn) {
+    if (BitParallelSequenceMatcher::fits(text1, textn)) {
+        BitParallelSequenceMatcher matcher(text1, textn);
+        difflib::opcode_range opcodes = matcher.opcodes();
+        return difflib::chunk_list_t(opcodes.begin(), opcodes.end());
+    }
     InlineMyersSequenceMatcher matcher(text1, textn, nullptr);
-    return matcher.get_opcodes();
+    difflib::opcode_range opcodes = matcher.opcodes();
+    return difflib::chunk_list_t(opcodes.begin(), opcodes.end());
 }
 
 
-#if _MYERS_USES_VECTOR
-static int find_common_prefix(std::vector<std::string> a, std::vector<std::string> b) {
-    if (a.empty() or b.empty()) {
-        return 0;
-    }
-    if (a[0] == b[0]) {
-        int pointermax = std::min(a.size(), b.size());
-        int pointermid = pointermax;
-        int pointermin = 0;
-        while (pointermin < pointermid) {
-            std::vector<std::string>::iterator start = a.begin() + pointermin;
-            std::vector<std::string>::iterator end = a.begin() + pointermid;
-            std::vector<std::string> first(start, end);
-            start = b.begin() + pointermin;
-            end = b.begin() + pointermid;
-            std::vector<std::string> second(start, end);
-            if (first == second) {
-                pointermin = pointermid;
-            } else {
-                pointermax = pointermid;
-            }
-            pointermid = int((pointermax - pointermin) / 2 + pointermin);
+// The masks below have one bit per differing byte, so a uint32_t element
+// covers four of them.
+
+size_t common_prefix_length(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (a + i)),
+                                       _mm256_loadu_si256((const __m256i*) (b + i)));
+        unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(eq);
+        if (mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i)),
+                                    _mm_loadu_si128((const __m128i*) (b + i)));
+        unsigned int mask = ~(unsigned int) _mm_movemask_epi8(eq) & 0xffff;
+        if (mask) {
+            return i + lowest_bit(mask);
         }
-        return pointermid;
     }
-    return 0;
+#endif
+    while (i < n and a[i] == b[i]) {
+        i += 1;
+    }
+    return i;
 }
+
+size_t common_suffix_length(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (a + n - i - 32)),
+                                       _mm256_loadu_si256((const __m256i*) (b + n - i - 32)));
+        unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(eq);
+        if (mask) {
+            return i + 31 - highest_bit(mask);
+        }
+    }
 #endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + n - i - 16)),
+                                    _mm_loadu_si128((const __m128i*) (b + n - i - 16)));
+        unsigned int mask = ~(unsigned int) _mm_movemask_epi8(eq) & 0xffff;
+        if (mask) {
+            return i + 15 - highest_bit(mask);
+        }
+    }
+#endif
+    while (i < n and a[n - i - 1] == b[n - i - 1]) {
+        i += 1;
+    }
+    return i;
+}
 
-static int find_common_prefix(std::string a, std::string b) {
-    if (a.empty() or b.empty()) {
-        return 0;
-    }
-    if (a[0] == b[0]) {
-        int pointermax = std::min(a.size(), b.size());
-        int pointermid = pointermax;
-        int pointermin = 0;
-        while (pointermin < pointermid) {
-            if (a.substr(pointermin, pointermid) == b.substr(pointermin, pointermid)) {
-                pointermin = pointermid;
+size_t common_prefix_length(const uint32_t* a, const uint32_t* b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (a + i)),
+                                        _mm256_loadu_si256((const __m256i*) (b + i)));
+        unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(eq);
+        if (mask) {
+            return i + lowest_bit(mask) / 4;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (a + i)),
+                                     _mm_loadu_si128((const __m128i*) (b + i)));
+        unsigned int mask = ~(unsigned int) _mm_movemask_epi8(eq) & 0xffff;
+        if (mask) {
+            return i + lowest_bit(mask) / 4;
+        }
+    }
+#endif
+    while (i < n and a[i] == b[i]) {
+        i += 1;
+    }
+    return i;
+}
+
+size_t common_suffix_length(const uint32_t* a, const uint32_t* b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (a + n - i - 8)),
+                                        _mm256_loadu_si256((const __m256i*) (b + n - i - 8)));
+        unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(eq);
+        if (mask) {
+            return i + 7 - highest_bit(mask) / 4;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (a + n - i - 4)),
+                                     _mm_loadu_si128((const __m128i*) (b + n - i - 4)));
+        unsigned int mask = ~(unsigned int) _mm_movemask_epi8(eq) & 0xffff;
+        if (mask) {
+            return i + 3 - highest_bit(mask) / 4;
+        }
+    }
+#endif
+    while (i < n and a[n - i - 1] == b[n - i - 1]) {
+        i += 1;
+    }
+    return i;
+}
+
+/*! Common prefix of a[a_lo:a_hi] and b[b_lo:b_hi] */
+template <class T>
+static int find_common_prefix(const T& a, int a_lo, int a_hi, const T& b, int b_lo, int b_hi) {
+    return common_prefix_length(a.data() + a_lo, b.data() + b_lo, std::min(a_hi - a_lo, b_hi - b_lo));
+}
+
+/*! Common suffix of a[a_lo:a_hi] and b[b_lo:b_hi] */
+template <class T>
+static int find_common_suffix(const T& a, int a_lo, int a_hi, const T& b, int b_lo, int b_hi) {
+    int n = std::min(a_hi - a_lo, b_hi - b_lo);
+    return common_suffix_length(a.data() + a_hi - n, b.data() + b_hi - n, n);
+}
+
+/*!
+ * The point furthest from both corners of a[a_lo:a_hi] and b[b_lo:b_hi]
+ * reached by the forward (v1) and reverse (v2) paths after d steps, or
+ * (-1, -1) if neither has got anywhere
+ */
+static std::pair<int, int> find_furthest_point(const std::vector<int>& v1, const std::vector<int>& v2, int v_offset, int d,
+                                               int a_lo, int a_hi, int b_lo, int b_hi) {
+    int n = a_hi - a_lo;
+    int m = b_hi - b_lo;
+    int best = 0;
+    std::pair<int, int> point(-1, -1);
+    for (int k = -d; k <= d; k += 2) {
+        int x1 = v1[v_offset + k];
+        int y1 = x1 - k;
+        if (x1 >= 0 and x1 <= n and y1 >= 0 and y1 <= m and x1 + y1 > best and x1 + y1 < n + m) {
+            best = x1 + y1;
+            point = std::pair<int, int>(a_lo + x1, b_lo + y1);
+        }
+        int x2 = v2[v_offset + k];
+        int y2 = x2 - k;
+        if (x2 >= 0 and x2 <= n and y2 >= 0 and y2 <= m and x2 + y2 > best and x2 + y2 < n + m) {
+            best = x2 + y2;
+            point = std::pair<int, int>(a_hi - x2, b_hi - y2);
+        }
+    }
+    return point;
+}
+
+/*!
+ * Find the middle snake of a[a_lo:a_hi] and b[b_lo:b_hi]
+ *
+ * Runs the forward and reverse searches until their furthest reaching
+ * paths overlap, and returns the point (in absolute coordinates) where
+ * the problem can be split in two. The ranges must not share a prefix or
+ * suffix and must both be non-empty.
+ *
+ * If the edit distance searched exceeds max_cost, or the deadline passes,
+ * the point reached by the path that got furthest is returned instead and
+ * approximate is set. If control is cancelled, there is no split at all.
+ */
+template <class T>
+static std::pair<int, int> find_middle_snake(const T& a, int a_lo, int a_hi, const T& b, int b_lo, int b_hi,
+                                             int max_cost, std::chrono::steady_clock::time_point deadline,
+                                             const MatchControl* control, bool& approximate) {
+    int n = a_hi - a_lo;
+    int m = b_hi - b_lo;
+    int max_d = (n + m + 1) / 2;
+    int v_offset = max_d;
+    int v_length = 2 * max_d + 2;
+    std::vector<int> v1(v_length, -1);
+    std::vector<int> v2(v_length, -1);
+    v1[v_offset + 1] = 0;
+    v2[v_offset + 1] = 0;
+    int delta = n - m;
+    // If the total number of characters is odd, the front path collides
+    // with the reverse path.
+    bool front = (delta % 2 != 0);
+    int k1start = 0;
+    int k1end = 0;
+    int k2start = 0;
+    int k2end = 0;
+    for (int d = 0; d < max_d; d++) {
+        if (d % 64 == 0 and control and control->cancelled()) {
+            approximate = true;
+            return std::pair<int, int>(-1, -1);
+        }
+        if (d > 0 and (2 * d > max_cost or (d % 64 == 0 and std::chrono::steady_clock::now() > deadline))) {
+            approximate = true;
+            return find_furthest_point(v1, v2, v_offset, d - 1, a_lo, a_hi, b_lo, b_hi);
+        }
+        for (int k1 = -d + k1start; k1 < d + 1 - k1end; k1 += 2) {
+            int k1_offset = v_offset + k1;
+            int x1;
+            if (k1 == -d or (k1 != d and v1[k1_offset - 1] < v1[k1_offset + 1])) {
+                x1 = v1[k1_offset + 1];
+            } else {
+                x1 = v1[k1_offset - 1] + 1;
+            }
+            int y1 = x1 - k1;
+            while (x1 < n and y1 < m and a[a_lo + x1] == b[b_lo + y1]) {
+                x1 += 1;
+                y1 += 1;
+            }
+            v1[k1_offset] = x1;
+            if (x1 > n) {
+                k1end += 2;
+            } else if (y1 > m) {
+                k1start += 2;
+            } else if (front) {
+                int k2_offset = v_offset + delta - k1;
+                if (k2_offset >= 0 and k2_offset < v_length and v2[k2_offset] != -1) {
+                    int x2 = n - v2[k2_offset];
+                    if (x1 >= x2) {
+                        return std::pair<int, int>(a_lo + x1, b_lo + y1);
+                    }
+                }
+            }
+        }
+        for (int k2 = -d + k2start; k2 < d + 1 - k2end; k2 += 2) {
+            int k2_offset = v_offset + k2;
+            int x2;
+            if (k2 == -d or (k2 != d and v2[k2_offset - 1] < v2[k2_offset + 1])) {
+                x2 = v2[k2_offset + 1];
             } else {
-                pointermax = pointermid;
+                x2 = v2[k2_offset - 1] + 1;
+            }
+            int y2 = x2 - k2;
+            while (x2 < n and y2 < m and a[a_hi - x2 - 1] == b[b_hi - y2 - 1]) {
+                x2 += 1;
+                y2 += 1;
+            }
+            v2[k2_offset] = x2;
+            if (x2 > n) {
+                k2end += 2;
+            } else if (y2 > m) {
+                k2start += 2;
+            } else if (not front) {
+                int k1_offset = v_offset + delta - k2;
+                if (k1_offset >= 0 and k1_offset < v_length and v1[k1_offset] != -1) {
+                    int x1 = v1[k1_offset];
+                    int y1 = v_offset + x1 - k1_offset;
+                    if (x1 >= n - x2) {
+                        return std::pair<int, int>(a_lo + x1, b_lo + y1);
+                    }
+                }
             }
-            pointermid = int((pointermax - pointermin) / 2 + pointermin);
         }
-        return pointermid;
     }
-    return 0;
+    // Nothing in common at all
+    return std::pair<int, int>(-1, -1);
 }
 
+MatchControl::MatchControl(std::function<void()> notify) : cancelled_(false), progress_(0), notified_(0), notify_(notify) {}
 
-static int find_common_suffix(std::string a, std::string b) {
-    if (a.empty() or b.empty()) {
-        return 0;
-    }
-    if (a[-1] == b[-1]) {
-        int pointermax = std::min(a.length(), b.length());
-        int pointermid = pointermax;
-        int pointermin = 0;
-        while (pointermin < pointermid) {
-            std::string a_tail = a.substr(-pointermid,a.length() - pointermin);
-            std::string b_tail = b.substr(-pointermid,b.length() - pointermin);
-            if (a_tail == b_tail) {
-                pointermin = pointermid;
-            } else {
-                pointermax = pointermid;
+void MatchControl::cancel() {
+    this->cancelled_ = true;
+}
+
+bool MatchControl::cancelled() const {
+    return this->cancelled_.load(std::memory_order_relaxed);
+}
+
+float MatchControl::progress() const {
+    return this->progress_;
+}
+
+void MatchControl::report(float progress) {
+    // Only the thread that moves progress on, and then the one that moves
+    // it a percent past the last notification, goes any further
+    float seen = this->progress_.load(std::memory_order_relaxed);
+    do {
+        if (progress <= seen) {
+            return;
+        }
+    } while (not this->progress_.compare_exchange_weak(seen, progress));
+    float notified = this->notified_.load(std::memory_order_relaxed);
+    if (this->notify_ and progress - notified >= 0.01f and this->notified_.compare_exchange_strong(notified, progress)) {
+        this->notify_();
+    }
+}
+
+MatcherPool::MatcherPool(unsigned int workers) : stopping_(false) {
+    if (workers == 0) {
+        // Leave a core to the GUI thread
+        workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+    for (unsigned int i = 0; i < workers; i++) {
+        this->threads_.push_back(std::thread(&MatcherPool::run, this));
+    }
+}
+
+MatcherPool::~MatcherPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->stopping_ = true;
+        this->jobs_.clear();
+    }
+    this->wake_.notify_all();
+    for (std::thread& thread : this->threads_) {
+        thread.join();
+    }
+}
+
+unsigned int MatcherPool::workers() const {
+    return this->threads_.size();
+}
+
+void MatcherPool::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex_);
+            this->wake_.wait(lock, [this] { return this->stopping_ or not this->jobs_.empty(); });
+            if (this->stopping_) {
+                return;
+            }
+            job = std::move(this->jobs_.front());
+            this->jobs_.pop_front();
+        }
+        difflib::chunk_list_t opcodes;
+        try {
+            opcodes = matcher_worker(job.text1, job.textn);
+        } catch (std::exception &) {
+            // Left to escape, this would end the program; an empty
+            // result still lets the owner stop waiting for this pair
+            opcodes.clear();
+        }
+        job.done(opcodes);
+    }
+}
+
+void MatcherPool::submit(const void* owner, const std::string& text1, const std::string& textn, done_type done) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->jobs_.push_back(Job{owner, text1, textn, done});
+    }
+    this->wake_.notify_one();
+}
+
+void MatcherPool::cancel(const void* owner) {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->jobs_.erase(std::remove_if(this->jobs_.begin(), this->jobs_.end(),
+                                     [owner](const Job& job) { return job.owner == owner; }),
+                      this->jobs_.end());
+}
+
+size_t MatcherPool::queued() const {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    return this->jobs_.size();
+}
+
+/*! Finish a 64 bit hash so that every input bit affects every output bit */
+static inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/*! A 64 bit hash of text, eight bytes at a time */
+static uint64_t text_hash64(text_view text) {
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+    uint64_t h = text.size() * k;
+    const char* p = text.data();
+    size_t n = text.size();
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = (h ^ mix64(word)) * k;
+    }
+    uint64_t tail = 0;
+    if (n > 0) {
+        memcpy(&tail, p, n);
+    }
+    return mix64(h ^ mix64(tail));
+}
+
+size_t InlineMatchCache::key_hash::operator()(const key_type& key) const {
+    return key.first ^ (key.second * 0x9E3779B97F4A7C15ull);
+}
+
+InlineMatchCache::InlineMatchCache(size_t budget) : budget_(budget), bytes_(0), stats_{0, 0, 0, 0, 0} {}
+
+InlineMatchCache::key_type InlineMatchCache::key(text_view text1, text_view textn) {
+    return key_type(text_hash64(text1), text_hash64(textn));
+}
+
+bool InlineMatchCache::lookup(const key_type& key, difflib::chunk_list_t& opcodes) {
+    std::unordered_map<key_type, std::list<Entry>::iterator, key_hash>::iterator it = this->index_.find(key);
+    if (it == this->index_.end()) {
+        this->stats_.misses++;
+        return false;
+    }
+    this->stats_.hits++;
+    this->entries_.splice(this->entries_.begin(), this->entries_, it->second);
+    opcodes = it->second->opcodes;
+    return true;
+}
+
+void InlineMatchCache::insert(const key_type& key, const difflib::chunk_list_t& opcodes) {
+    // Charge for the list and hash table nodes along with the opcodes
+    size_t bytes = sizeof(Entry) + 4 * sizeof(void*) + opcodes.size() * sizeof(difflib::chunk_t);
+    std::unordered_map<key_type, std::list<Entry>::iterator, key_hash>::iterator it = this->index_.find(key);
+    if (it != this->index_.end()) {
+        this->bytes_ -= it->second->bytes;
+        this->entries_.erase(it->second);
+        this->index_.erase(it);
+    }
+    if (bytes > this->budget_) {
+        return;
+    }
+    this->evict_to(this->budget_ - bytes);
+    this->entries_.push_front(Entry{key, opcodes, bytes});
+    this->index_[key] = this->entries_.begin();
+    this->bytes_ += bytes;
+}
+
+void InlineMatchCache::evict_to(size_t budget) {
+    while (this->bytes_ > budget) {
+        const Entry& oldest = this->entries_.back();
+        this->bytes_ -= oldest.bytes;
+        this->index_.erase(oldest.key);
+        this->entries_.pop_back();
+        this->stats_.evictions++;
+    }
+}
+
+size_t InlineMatchCache::budget() const {
+    return this->budget_;
+}
+
+void InlineMatchCache::set_budget(size_t budget) {
+    this->budget_ = budget;
+    this->evict_to(budget);
+}
+
+void InlineMatchCache::clear() {
+    this->entries_.clear();
+    this->index_.clear();
+    this->bytes_ = 0;
+    this->stats_ = Stats{0, 0, 0, 0, 0};
+}
+
+InlineMatchCache::Stats InlineMatchCache::stats() const {
+    Stats stats = this->stats_;
+    stats.entries = this->entries_.size();
+    stats.bytes = this->bytes_;
+    return stats;
+}
+
+std::vector<text_view> line_views(text_view text, size_t lo, size_t hi) {
+    std::vector<text_view> result;
+    size_t line = 0;
+    size_t start = 0;
+    size_t i = 0;
+    while (i < text.size() and line < hi) {
+        if (text[i] != '\n' and text[i] != '\r') {
+            i++;
+            continue;
+        }
+        size_t eol = i;
+        if (text[i] == '\r' and i + 1 < text.size() and text[i + 1] == '\n') {
+            i++;
+        }
+        i++;
+        if (line >= lo) {
+            result.push_back(text.substr(start, eol - start));
+        }
+        line++;
+        start = i;
+    }
+    if (start < text.size() and lo <= line and line < hi) {
+        result.push_back(text.substr(start));
+    }
+    return result;
+}
+
+size_t LineInterner::view_hash::operator()(text_view line) const {
+    return boost::hash_range(line.begin(), line.end());
+}
+
+LineInterner::LineInterner() : copied(0), flags(NORMALISE_NONE) {}
+
+int LineInterner::normalisation() const {
+    return this->flags;
+}
+
+void LineInterner::set_normalisation(int flags) {
+    if (flags != this->flags) {
+        this->clear();
+        this->flags = flags;
+    }
+}
+
+static inline bool is_space(char c) {
+    return c == ' ' or c == '\t' or c == '\r' or c == '\f' or c == '\v';
+}
+
+text_view LineInterner::normalise(text_view line) {
+    if (this->flags & NORMALISE_TRIM_LEADING) {
+        while (!line.empty() and is_space(line.front())) {
+            line.remove_prefix(1);
+        }
+    }
+    if (this->flags & NORMALISE_TRIM_TRAILING) {
+        while (!line.empty() and is_space(line.back())) {
+            line.remove_suffix(1);
+        }
+    }
+    if (!(this->flags & (NORMALISE_COLLAPSE_SPACE | NORMALISE_IGNORE_SPACE | NORMALISE_FOLD_CASE))) {
+        return line;
+    }
+    this->scratch.clear();
+    bool in_space = false;
+    for (char c : line) {
+        if (is_space(c)) {
+            if (!(this->flags & NORMALISE_IGNORE_SPACE) and !(in_space and (this->flags & NORMALISE_COLLAPSE_SPACE))) {
+                this->scratch.push_back((this->flags & NORMALISE_COLLAPSE_SPACE) ? ' ' : c);
+            }
+            in_space = true;
+            continue;
+        }
+        in_space = false;
+        if ((this->flags & NORMALISE_FOLD_CASE) and c >= 'A' and c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        this->scratch.push_back(c);
+    }
+    return this->scratch;
+}
+
+uint32_t LineInterner::intern_normalised(text_view key) {
+    std::unordered_map<text_view, uint32_t, view_hash>::const_iterator it = this->ids.find(key);
+    if (it != this->ids.end()) {
+        return it->second;
+    }
+    uint32_t id = this->ids.size();
+    this->lines.push_back(std::string(key.data(), key.size()));
+    this->copied += key.size();
+    this->ids.emplace(text_view(this->lines.back()), id);
+    return id;
+}
+
+uint32_t LineInterner::intern(text_view line) {
+    return this->intern_normalised(this->normalise(line));
+}
+
+line_ids_t LineInterner::intern(std::vector<std::string>::const_iterator begin, std::vector<std::string>::const_iterator end) {
+    line_ids_t result;
+    result.reserve(end - begin);
+    for (std::vector<std::string>::const_iterator it = begin; it != end; ++it) {
+        result.push_back(this->intern(*it));
+    }
+    return result;
+}
+
+line_ids_t LineInterner::intern(const std::vector<std::string>& lines) {
+    return this->intern(lines.begin(), lines.end());
+}
+
+line_ids_t LineInterner::intern_lines(text_view text, size_t lo, size_t hi, std::vector<uint32_t>* line_numbers) {
+    return this->intern_lines(line_views(text, lo, hi), lo, line_numbers);
+}
+
+line_ids_t LineInterner::intern_lines(const std::vector<text_view>& views, size_t lo, std::vector<uint32_t>* line_numbers) {
+    line_ids_t result;
+    for (size_t i = 0; i < views.size(); i++) {
+        text_view key = this->normalise(views[i]);
+        if ((this->flags & NORMALISE_SKIP_BLANK) and key.empty()) {
+            continue;
+        }
+        result.push_back(this->intern_normalised(key));
+        if (line_numbers) {
+            line_numbers->push_back(lo + i);
+        }
+    }
+    return result;
+}
+
+/*! Lines of a text that interned lines lo to hi came from */
+static std::pair<size_t, size_t> map_lines(const std::vector<uint32_t>& lines, size_t start, size_t lo, size_t hi) {
+    if (lo < hi) {
+        return std::pair<size_t, size_t>(lines[lo], lines[hi - 1] + 1);
+    }
+    // An empty range sits right after the line before it
+    size_t at = lo == 0 ? start : lines[lo - 1] + 1;
+    return std::pair<size_t, size_t>(at, at);
+}
+
+difflib::chunk_t map_chunk_lines(const difflib::chunk_t& chunk,
+                                 const std::vector<uint32_t>& a_lines, size_t a_start,
+                                 const std::vector<uint32_t>& b_lines, size_t b_start) {
+    std::pair<size_t, size_t> a = map_lines(a_lines, a_start, chunk.i1, chunk.i2);
+    std::pair<size_t, size_t> b = map_lines(b_lines, b_start, chunk.j1, chunk.j2);
+    return difflib::chunk_t(chunk.tag, a.first, a.second, b.first, b.second);
+}
+
+/*! Call emit(lo, hi, moved) for each run of [lo, hi) that moved, or didn't, as a whole */
+template <class F>
+static void for_each_move_run(const std::vector<char>& moved, size_t lo, size_t hi, F emit) {
+    while (lo < hi) {
+        size_t end = lo + 1;
+        while (end < hi and moved[end] == moved[lo]) {
+            end++;
+        }
+        emit(lo, end, moved[lo] != 0);
+        lo = end;
+    }
+}
+
+/*! Sorted copy of ids[lo:hi], for multiset_ratio() */
+static line_ids_t sorted_ids(const line_ids_t& ids, size_t lo, size_t hi) {
+    line_ids_t result(ids.begin() + lo, ids.begin() + hi);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+/*! quick_ratio() of two sorted sequences: their common elements, in any order */
+static double multiset_ratio(const line_ids_t& a, const line_ids_t& b) {
+    size_t matches = 0;
+    line_ids_t::const_iterator i = a.begin();
+    line_ids_t::const_iterator j = b.begin();
+    while (i != a.end() and j != b.end()) {
+        if (*i < *j) {
+            ++i;
+        } else if (*j < *i) {
+            ++j;
+        } else {
+            matches++;
+            ++i;
+            ++j;
+        }
+    }
+    return 2. * matches / (a.size() + b.size());
+}
+
+difflib::chunk_list_t find_moves(const difflib::chunk_list_t& changes,
+                                 const line_ids_t& a, const line_ids_t& b,
+                                 size_t min_lines, double similarity) {
+    if (min_lines == 0) {
+        return changes;
+    }
+    // Windows sharing a hash are all checked, so repetitive text such as
+    // runs of blank lines is capped like HistogramSequenceMatcher does
+    static const size_t max_candidates = 64;
+    std::vector<char> moved_a(a.size());
+    std::vector<char> moved_b(b.size());
+    bool found = false;
+
+    // Every window of min_lines inserted lines, with the end of its change
+    std::unordered_multimap<size_t, std::pair<size_t, size_t>> windows;
+    for (const difflib::chunk_t& c : changes) {
+        for (size_t j = c.j1; j + min_lines <= c.j2; j++) {
+            windows.emplace(boost::hash_range(b.data() + j, b.data() + j + min_lines),
+                            std::pair<size_t, size_t>(j, c.j2));
+        }
+    }
+    // Deleted runs that were inserted unchanged elsewhere, longest first
+    // where a window matches several places
+    for (const difflib::chunk_t& c : changes) {
+        if (windows.empty()) {
+            break;
+        }
+        size_t i = c.i1;
+        while (i + min_lines <= c.i2) {
+            size_t best_length = 0;
+            size_t best_start = 0;
+            size_t checked = 0;
+            auto candidates = windows.equal_range(boost::hash_range(a.data() + i, a.data() + i + min_lines));
+            for (auto it = candidates.first; it != candidates.second and checked < max_candidates; ++it, ++checked) {
+                size_t j = it->second.first;
+                size_t j_end = it->second.second;
+                size_t length = 0;
+                while (i + length < c.i2 and j + length < j_end and
+                       a[i + length] == b[j + length] and not moved_b[j + length]) {
+                    length++;
+                }
+                if (length >= min_lines and length > best_length) {
+                    best_length = length;
+                    best_start = j;
+                }
+            }
+            if (best_length == 0) {
+                i++;
+                continue;
+            }
+            std::fill(moved_a.begin() + i, moved_a.begin() + i + best_length, 1);
+            std::fill(moved_b.begin() + best_start, moved_b.begin() + best_start + best_length, 1);
+            i += best_length;
+            found = true;
+        }
+    }
+
+    // Whole deleted and inserted runs that are mostly the same lines, in
+    // different changes as within one they are just an edit. Every pair
+    // is compared, so this is skipped when there are too many runs.
+    if (similarity <= 1.0) {
+        static const size_t max_pairs = 4096;
+        std::vector<size_t> deleted;
+        std::vector<size_t> inserted;
+        for (size_t k = 0; k < changes.size(); k++) {
+            const difflib::chunk_t& c = changes[k];
+            if (c.i2 - c.i1 >= min_lines and
+                std::find(moved_a.begin() + c.i1, moved_a.begin() + c.i2, 1) == moved_a.begin() + c.i2) {
+                deleted.push_back(k);
+            }
+            if (c.j2 - c.j1 >= min_lines and
+                std::find(moved_b.begin() + c.j1, moved_b.begin() + c.j2, 1) == moved_b.begin() + c.j2) {
+                inserted.push_back(k);
+            }
+        }
+        if (deleted.size() * inserted.size() <= max_pairs) {
+            std::vector<line_ids_t> inserted_ids;
+            for (size_t k : inserted) {
+                inserted_ids.push_back(sorted_ids(b, changes[k].j1, changes[k].j2));
+            }
+            std::vector<char> paired(inserted.size());
+            for (size_t d : deleted) {
+                const difflib::chunk_t& c = changes[d];
+                line_ids_t deleted_ids = sorted_ids(a, c.i1, c.i2);
+                size_t best = inserted.size();
+                double best_ratio = similarity;
+                for (size_t n = 0; n < inserted.size(); n++) {
+                    if (paired[n] or inserted[n] == d or
+                        difflib::length_ratio(deleted_ids.size(), inserted_ids[n].size()) < best_ratio) {
+                        continue;
+                    }
+                    double ratio = multiset_ratio(deleted_ids, inserted_ids[n]);
+                    if (ratio >= best_ratio) {
+                        best = n;
+                        best_ratio = ratio;
+                    }
+                }
+                if (best == inserted.size()) {
+                    continue;
+                }
+                paired[best] = 1;
+                const difflib::chunk_t& to = changes[inserted[best]];
+                std::fill(moved_a.begin() + c.i1, moved_a.begin() + c.i2, 1);
+                std::fill(moved_b.begin() + to.j1, moved_b.begin() + to.j2, 1);
+                found = true;
             }
-            pointermid = int((pointermax - pointermin) / 2 + pointermin);
         }
-        return pointermid;
     }
-    return 0;
+
+    if (not found) {
+        return changes;
+    }
+    // Split changes that lost lines: what left a, then what arrived in b,
+    // each side's range sitting at the start of the change on the other
+    difflib::chunk_list_t result;
+    result.reserve(changes.size());
+    for (const difflib::chunk_t& c : changes) {
+        bool moves = std::find(moved_a.begin() + c.i1, moved_a.begin() + c.i2, 1) != moved_a.begin() + c.i2 or
+                     std::find(moved_b.begin() + c.j1, moved_b.begin() + c.j2, 1) != moved_b.begin() + c.j2;
+        if (not moves) {
+            result.push_back(c);
+            continue;
+        }
+        for_each_move_run(moved_a, c.i1, c.i2, [&](size_t lo, size_t hi, bool moved) {
+            result.emplace_back(moved ? difflib::Tag::move : difflib::Tag::delete_, lo, hi, c.j1, c.j1);
+        });
+        for_each_move_run(moved_b, c.j1, c.j2, [&](size_t lo, size_t hi, bool moved) {
+            result.emplace_back(moved ? difflib::Tag::move : difflib::Tag::insert, c.i2, c.i2, lo, hi);
+        });
+    }
+    return result;
+}
+
+std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> split_conflict(
+    const line_ids_t& a, const line_ids_t& b, int a_start, int b_start, int mid_start, int mid_end,
+    std::chrono::milliseconds time_limit) {
+    int mid_length = mid_end - mid_start;
+    MyersSequenceMatcher<line_ids_t> matcher(a, b);
+    matcher.set_time_limit(time_limit);
+    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> result;
+    for (const difflib::chunk_t& chunk : matcher.get_opcodes()) {
+        int s1 = mid_start;
+        int e1 = mid_start;
+        if (int(a.size()) == mid_length) {
+            s1 += chunk.i1;
+            e1 += chunk.i2;
+        } else if (int(b.size()) == mid_length) {
+            s1 += chunk.j1;
+            e1 += chunk.j2;
+        }
+        difflib::Tag tag = chunk.tag == difflib::Tag::equal ? difflib::Tag::replace : difflib::Tag::conflict;
+        result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(
+            difflib::chunk_t(tag, s1, e1, a_start + chunk.i1, a_start + chunk.i2),
+            difflib::chunk_t(tag, s1, e1, b_start + chunk.j1, b_start + chunk.j2)));
+    }
+    return result;
+}
+
+size_t LineInterner::size() const {
+    return this->ids.size();
+}
+
+size_t LineInterner::copied_bytes() const {
+    return this->copied;
+}
+
+void LineInterner::clear() {
+    this->ids.clear();
+    this->lines.clear();
+    this->copied = 0;
 }
 
 Snake::Snake(Snake *lastsnake, int x, int y, int snake) : lastsnake(lastsnake), x(x), y(y), snake(snake) {}
 
-MyersSequenceMatcher::MyersSequenceMatcher(std::string a, std::string b, junk_function_type isjunk) : difflib::SequenceMatcher<std::string>(a, b, isjunk) {
+SnakeArena::SnakeArena() : bytes(0), peak(0) {}
+
+Snake* SnakeArena::create(Snake *lastsnake, int x, int y, int snake) {
+    if (this->blocks.empty() or this->blocks.back().size() == this->blocks.back().capacity()) {
+        // Blocks never reallocate, so handed out pointers stay valid
+        size_t count = this->blocks.empty() ? 256 : std::min<size_t>(this->blocks.back().capacity() * 2, 65536);
+        this->blocks.emplace_back();
+        this->blocks.back().reserve(count);
+        this->bytes += count * sizeof(Snake);
+        this->peak = std::max(this->peak, this->bytes);
+    }
+    this->blocks.back().emplace_back(lastsnake, x, y, snake);
+    return &this->blocks.back().back();
+}
+
+void SnakeArena::release() {
+    this->blocks.clear();
+    this->bytes = 0;
+}
+
+size_t SnakeArena::allocated_bytes() const {
+    return this->bytes;
+}
+
+size_t SnakeArena::peak_bytes() const {
+    return this->peak;
+}
+
+template <class T>
+MyersSequenceMatcher<T>::MyersSequenceMatcher(const T& a, const T& b, junk_function_type isjunk) : difflib::SequenceMatcher<T>(a, b, isjunk) {
     if (isjunk) {
         throw NotImplementedError("isjunk is not supported yet");
     }
@@ -124,98 +917,200 @@ MyersSequenceMatcher::MyersSequenceMatcher(std::string a, std::string b, junk_fu
     this->bindex.clear();
     this->common_prefix = this->common_suffix = -1;
     this->lines_discarded = false;
+    this->discarded_a_ = this->discarded_b_ = 0;
+    this->discard_threshold_ = 10;
+    this->linear_space_threshold_ = size_t(1) << 30;
+    this->used_linear_space_ = false;
+    this->time_limit_ = std::chrono::milliseconds::max();
+    this->cost_limit_ = std::numeric_limits<int>::max();
+    this->approximate_ = false;
+    this->control_ = nullptr;
+    this->reports_progress_ = false;
 }
 
-difflib::match_list_t MyersSequenceMatcher::get_matching_blocks() {
+template <class T>
+const difflib::match_list_t& MyersSequenceMatcher<T>::matching_blocks() {
     if (!this->matching_blocks_) {
         this->initialise();
     }
     return *this->matching_blocks_;
 }
 
-difflib::chunk_list_t MyersSequenceMatcher::get_difference_opcodes() {
-    difflib::chunk_list_t result;
-    for (difflib::chunk_t chunk : this->get_opcodes()) {
-        if (std::get<0>(chunk) != "equal") {
-            result.push_back(chunk);
-        }
+template <class T>
+difflib::chunk_list_t MyersSequenceMatcher<T>::get_difference_opcodes() {
+    difflib::opcode_range changes = this->opcodes(true);
+    return difflib::chunk_list_t(changes.begin(), changes.end());
+}
+
+template <class T>
+size_t MyersSequenceMatcher<T>::peak_arena_bytes() const {
+    return this->snakes.peak_bytes();
+}
+
+template <class T>
+size_t MyersSequenceMatcher<T>::linear_space_threshold() const {
+    return this->linear_space_threshold_;
+}
+
+template <class T>
+void MyersSequenceMatcher<T>::set_linear_space_threshold(size_t value) {
+    this->linear_space_threshold_ = value;
+}
+
+template <class T>
+bool MyersSequenceMatcher<T>::used_linear_space() const {
+    return this->used_linear_space_;
+}
+
+template <class T>
+std::chrono::milliseconds MyersSequenceMatcher<T>::time_limit() const {
+    return this->time_limit_;
+}
+
+template <class T>
+void MyersSequenceMatcher<T>::set_time_limit(std::chrono::milliseconds limit) {
+    this->time_limit_ = limit;
+}
+
+template <class T>
+int MyersSequenceMatcher<T>::cost_limit() const {
+    return this->cost_limit_;
+}
+
+template <class T>
+void MyersSequenceMatcher<T>::set_cost_limit(int limit) {
+    this->cost_limit_ = limit;
+}
+
+template <class T>
+bool MyersSequenceMatcher<T>::approximate() const {
+    return this->approximate_;
+}
+
+template <class T>
+void MyersSequenceMatcher<T>::start_budget() {
+    this->approximate_ = false;
+    if (this->time_limit_ == std::chrono::milliseconds::max()) {
+        this->deadline_ = std::chrono::steady_clock::time_point::max();
+    } else {
+        this->deadline_ = std::chrono::steady_clock::now() + this->time_limit_;
     }
-    return result;
 }
 
-std::pair<std::string, std::string> MyersSequenceMatcher::preprocess_remove_prefix_suffix(std::string a, std::string b) {
-    // remove common prefix and common suffix
-    this->common_prefix = this->common_suffix = -1;
-    this->common_prefix = find_common_prefix(a, b);
-    if (this->common_prefix > 0) {
-        a = a.substr(this->common_prefix);
-        b = b.substr(this->common_prefix);
+template <class T>
+void MyersSequenceMatcher<T>::set_control(MatchControl* control, bool report_progress) {
+    this->control_ = control;
+    this->reports_progress_ = report_progress;
+}
+
+template <class T>
+bool MyersSequenceMatcher<T>::cancelled() const {
+    return this->control_ and this->control_->cancelled();
+}
+
+template <class T>
+void MyersSequenceMatcher<T>::report_progress(float progress) {
+    if (this->control_ and this->reports_progress_) {
+        this->control_->report(progress);
     }
+}
 
-    if (a.size() > 0 and b.size() > 0) {
-        this->common_suffix = find_common_suffix(a, b);
-        if (this->common_suffix > 0) {
-            a = a.substr(0, a.length() - this->common_suffix);
-            b = b.substr(0, b.length() - this->common_suffix);
-        }
+template <class T>
+void MyersSequenceMatcher<T>::share_budget(MyersSequenceMatcher<T>& matcher) const {
+    matcher.set_control(this->control_, false);
+    matcher.set_cost_limit(this->cost_limit_);
+    if (this->deadline_ != std::chrono::steady_clock::time_point::max()) {
+        std::chrono::steady_clock::duration left = this->deadline_ - std::chrono::steady_clock::now();
+        matcher.set_time_limit(std::max(std::chrono::milliseconds(0),
+                                        std::chrono::duration_cast<std::chrono::milliseconds>(left)));
     }
-    return std::pair<std::string, std::string>(a, b);
 }
 
-std::pair<std::string, std::vector<int>> MyersSequenceMatcher::index_matching(std::string a, std::string b) {
-    std::set<char> aset;
-    for (char s : a) {
+template <class T>
+std::pair<size_t, size_t> MyersSequenceMatcher<T>::discarded_counts() const {
+    return std::pair<size_t, size_t>(this->discarded_a_, this->discarded_b_);
+}
+
+template <class T>
+size_t MyersSequenceMatcher<T>::discard_threshold() const {
+    return this->discard_threshold_;
+}
+
+template <class T>
+void MyersSequenceMatcher<T>::set_discard_threshold(size_t value) {
+    this->discard_threshold_ = value;
+}
+
+template <class T>
+std::pair<T, T> MyersSequenceMatcher<T>::preprocess_remove_prefix_suffix(const T& a, const T& b) {
+    // remove common prefix and common suffix, scanning in place and
+    // copying only what remains
+    int a_hi = a.size();
+    int b_hi = b.size();
+    this->common_prefix = find_common_prefix(a, 0, a_hi, b, 0, b_hi);
+    this->common_suffix = find_common_suffix(a, this->common_prefix, a_hi, b, this->common_prefix, b_hi);
+    return std::pair<T, T>(T(a.begin() + this->common_prefix, a.end() - this->common_suffix),
+                           T(b.begin() + this->common_prefix, b.end() - this->common_suffix));
+}
+
+template <class T>
+std::pair<T, std::vector<int>> MyersSequenceMatcher<T>::index_matching(const T& a, const T& b) {
+    HashIndex<typename T::value_type> aset(a.size());
+    for (typename T::value_type s : a) {
         aset.insert(s);
     }
-    std::string matches;
+    T matches;
     std::vector<int> index;
     for (size_t i = 0; i < b.size(); i++) {
-        char line = b[i];
-        if (std::find(aset.begin(), aset.end(), line) != aset.end()) {
+        typename T::value_type line = b[i];
+        if (aset.contains(line)) {
             matches.push_back(line);
             index.push_back(i);
         }
     }
-    return std::pair<std::string, std::vector<int>>(matches, index);
+    return std::pair<T, std::vector<int>>(matches, index);
 }
 
-std::pair<std::string, std::string> MyersSequenceMatcher::preprocess_discard_nonmatching_lines(std::string a, std::string b) {
+template <class T>
+std::pair<T, T> MyersSequenceMatcher<T>::preprocess_discard_nonmatching_lines(T a, T b) {
     // discard lines that do not match any line from the other file
     if (a.empty() or b.empty()) {
         this->aindex.clear();
         this->bindex.clear();
-        return std::pair<std::string, std::string>(a, b);
+        return std::pair<T, T>(a, b);
     }
 
-    std::pair<std::string, std::vector<int>> tmp;
+    std::pair<T, std::vector<int>> tmp;
     tmp = index_matching(a, b);
-    std::string indexed_b = tmp.first;
+    T indexed_b = tmp.first;
     this->bindex = tmp.second;
     tmp = index_matching(b, a);
-    std::string indexed_a = tmp.first;
+    T indexed_a = tmp.first;
     this->aindex = tmp.second;
 
-    // We only use the optimised result if it's worthwhile. The constant
+    // We only use the optimised result if it's worthwhile. The threshold
     // represents a heuristic of how many lines constitute 'worthwhile'.
-    this->lines_discarded = (b.size() - indexed_b.size() > 10 or
-                            a.size() - indexed_a.size() > 10);
+    this->discarded_a_ = a.size() - indexed_a.size();
+    this->discarded_b_ = b.size() - indexed_b.size();
+    this->lines_discarded = (this->discarded_b_ > this->discard_threshold_ or
+                             this->discarded_a_ > this->discard_threshold_);
     if (this->lines_discarded) {
         a = indexed_a;
         b = indexed_b;
     }
-    return std::pair<std::string, std::string>(a, b);
+    return std::pair<T, T>(a, b);
 }
 
-std::pair<std::string, std::string> MyersSequenceMatcher::preprocess() {
-    std::pair<std::string, std::string> x = this->preprocess_remove_prefix_suffix(this->a_, this->b_);
+template <class T>
+std::pair<T, T> MyersSequenceMatcher<T>::preprocess() {
+    std::pair<T, T> x = this->preprocess_remove_prefix_suffix(this->a_, this->b_);
     return this->preprocess_discard_nonmatching_lines(x.first, x.second);
 }
 
-void MyersSequenceMatcher::postprocess() {
+template <class T>
+void MyersSequenceMatcher<T>::postprocess() {
     difflib::match_list_t mb;
-    for (difflib::match_t t : *this->matching_blocks_) {
-        mb.push_back(t);
-    }
+    mb.push_back(this->matching_blocks_->back());
     int i = this->matching_blocks_->size() - 2;
     while (i >= 0) {
         difflib::match_t _m = (*this->matching_blocks_)[i];
@@ -229,13 +1124,8 @@ void MyersSequenceMatcher::postprocess() {
             int prev_b = std::get<1>(_m);
             int prev_len = std::get<2>(_m);
             if (prev_b + prev_len == cur_b or prev_a + prev_len == cur_a) {
-                std::string::const_iterator start = this->a_.begin() + (cur_a - prev_len);
-                std::string::const_iterator end = this->a_.begin() + cur_a;
-                std::string prev_slice_a(start, end);
-                start = this->b_.begin() + (cur_b - prev_len);
-                end = this->b_.begin() + cur_b;
-                std::string prev_slice_b(start, end);
-                if (prev_slice_a == prev_slice_b) {
+                if (std::equal(this->a_.begin() + (cur_a - prev_len), this->a_.begin() + cur_a,
+                               this->b_.begin() + (cur_b - prev_len))) {
                     cur_b -= prev_len;
                     cur_a -= prev_len;
                     cur_len += prev_len;
@@ -248,13 +1138,11 @@ void MyersSequenceMatcher::postprocess() {
         mb.push_back(difflib::match_t(cur_a, cur_b, cur_len));
     }
     std::reverse(mb.begin(), mb.end());
-    this->matching_blocks_->clear();
-    for (difflib::match_t m : mb) {
-        this->matching_blocks_->push_back(m);
-    }
+    this->matching_blocks_->swap(mb);
 }
 
-void MyersSequenceMatcher::build_matching_blocks(Snake* lastsnake) {
+template <class T>
+void MyersSequenceMatcher<T>::build_matching_blocks(Snake* lastsnake) {
     std::deque<difflib::match_t> matching_blocks;
 
     int common_prefix = this->common_prefix;
@@ -305,20 +1193,72 @@ void MyersSequenceMatcher::build_matching_blocks(Snake* lastsnake) {
                                 common_suffix));
     }
     matching_blocks.push_back(difflib::match_t(this->a_.size(), this->b_.size(), 0));
-    this->matching_blocks_->clear();
-    for (difflib::match_t m : matching_blocks) {
-        this->matching_blocks_->push_back(m);
-    }
+    this->matching_blocks_.reset(new difflib::match_list_t(matching_blocks.begin(), matching_blocks.end()));
     // clean-up to free memory
     this->aindex.clear();
     this->bindex.clear();
 }
 
-void MyersSequenceMatcher::initialise() {
+template <class T>
+Snake* MyersSequenceMatcher<T>::linear_space_snakes(const T& a, const T& b) {
+    // Work items are either ranges still to be diffed or matches waiting
+    // for the ranges before them; popping them in order keeps the output
+    // sorted without recursion.
+    struct Item {
+        bool match;
+        int a_lo;
+        int a_hi;
+        int b_lo;
+        int b_hi;
+    };
+    Snake* lastsnake = 0;
+    std::vector<Item> stack;
+    stack.push_back(Item{false, 0, int(a.size()), 0, int(b.size())});
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+        if (item.match) {
+            lastsnake = this->snakes.create(lastsnake, item.a_lo, item.b_lo, item.a_hi - item.a_lo);
+            continue;
+        }
+        int a_lo = item.a_lo;
+        int a_hi = item.a_hi;
+        int b_lo = item.b_lo;
+        int b_hi = item.b_hi;
+        int prefix = find_common_prefix(a, a_lo, a_hi, b, b_lo, b_hi);
+        if (prefix) {
+            lastsnake = this->snakes.create(lastsnake, a_lo, b_lo, prefix);
+            a_lo += prefix;
+            b_lo += prefix;
+        }
+        int suffix = find_common_suffix(a, a_lo, a_hi, b, b_lo, b_hi);
+        if (suffix) {
+            a_hi -= suffix;
+            b_hi -= suffix;
+            stack.push_back(Item{true, a_hi, a_hi + suffix, b_hi, b_hi + suffix});
+        }
+        if (a_lo == a_hi or b_lo == b_hi) {
+            continue;
+        }
+        this->report_progress(float(a_lo) / a.size());
+        std::pair<int, int> split = find_middle_snake(a, a_lo, a_hi, b, b_lo, b_hi,
+                                                      this->cost_limit_, this->deadline_, this->control_, this->approximate_);
+        if (split.first < 0) {
+            continue;
+        }
+        stack.push_back(Item{false, split.first, a_hi, split.second, b_hi});
+        stack.push_back(Item{false, a_lo, split.first, b_lo, split.second});
+    }
+    return lastsnake;
+}
 
-    std::pair<std::string, std::string> tmp = this->preprocess();
-    std::string a = tmp.first;
-    std::string b = tmp.second;
+template <class T>
+void MyersSequenceMatcher<T>::initialise() {
+
+    this->start_budget();
+    std::pair<T, T> tmp = this->preprocess();
+    const T& a = tmp.first;
+    const T& b = tmp.second;
     int m = a.size();
     int n = b.size();
     int middle = m + 1;
@@ -328,13 +1268,23 @@ void MyersSequenceMatcher::initialise() {
     int dmax = std::max(middle, delta);
     if (n > 0 and m > 0) {
         int size = n + m + 2;
-        std::vector<std::pair<int, Snake*>> fp;
-        for (int i = 0; i < size; i++) {
-            fp[i] = std::pair<int, Snake*>(-1, 0);
-        }
+        std::vector<std::pair<int, Snake*>> fp(size, std::pair<int, Snake*>(-1, 0));
         int p = -1;
+        this->used_linear_space_ = false;
         while (true) {
             p += 1;
+            // The edit distance is at least |n - m| + 2p from here on; if
+            // keeping every snake alive gets too costly, or the budget is
+            // spent, start over with the linear space engine.
+            int cost = std::abs(n - m) + 2 * p;
+            if (size_t(cost) * size_t(n + m) > this->linear_space_threshold_ or
+                    cost > this->cost_limit_ or std::chrono::steady_clock::now() > this->deadline_ or
+                    this->cancelled()) {
+                this->snakes.release();
+                this->used_linear_space_ = true;
+                lastsnake = this->linear_space_snakes(a, b);
+                break;
+            }
             // move along vertical edge
             int yv = -1;
             Snake *node = 0;
@@ -356,7 +1306,7 @@ void MyersSequenceMatcher::initialise() {
                         yv += 1;
                     }
                     snake = x - snake;
-                    node = new Snake(node, x - snake, yv - snake, snake);
+                    node = this->snakes.create(node, x - snake, yv - snake, snake);
                 }
                 fp[km] = std::pair<int, Snake*>(yv, node);
             }
@@ -366,7 +1316,7 @@ void MyersSequenceMatcher::initialise() {
             for (int km = dmax + p; km > delta; km--) {
                 std::pair<int, Snake*> t = fp[km - 1];
                 if (yh <= t.first) {
-                    yv = t.first;
+                    yh = t.first;
                     node = t.second;
                     yh += 1;
                 }
@@ -380,7 +1330,7 @@ void MyersSequenceMatcher::initialise() {
                         yh += 1;
                     }
                     snake = x - snake;
-                    node = new Snake(node, x - snake, yh - snake, snake);
+                    node = this->snakes.create(node, x - snake, yh - snake, snake);
                 }
                 fp[km] = std::pair<int, Snake*>(yh, node);
             }
@@ -404,9 +1354,10 @@ void MyersSequenceMatcher::initialise() {
                     y += 1;
                 }
                 snake = x - snake;
-                node = new Snake(node, x - snake, y - snake, snake);
+                node = this->snakes.create(node, x - snake, y - snake, snake);
             }
             fp[delta] = std::pair<int, Snake *>(y, node);
+            this->report_progress(float(y) / n);
             if (y >= n) {
                 lastsnake = node;
                 break;
@@ -414,25 +1365,277 @@ void MyersSequenceMatcher::initialise() {
         }
     }
     this->build_matching_blocks(lastsnake);
+    this->snakes.release();
+    this->postprocess();
+}
+
+
+template <class T>
+AnchoredSequenceMatcher<T>::AnchoredSequenceMatcher(const T& a, const T& b, junk_function_type isjunk) : MyersSequenceMatcher<T>(a, b, isjunk) {
+}
+
+template <class T>
+void AnchoredSequenceMatcher<T>::initialise() {
+    // Regions still to be split and anchors waiting for the regions before
+    // them, popped in order so that matches come out sorted.
+    struct Item {
+        bool match;
+        int a_lo;
+        int a_hi;
+        int b_lo;
+        int b_hi;
+    };
+    this->start_budget();
+    const T& a = this->a_;
+    const T& b = this->b_;
+    difflib::match_list_t matches;
+    std::vector<Item> stack;
+    stack.push_back(Item{false, 0, int(a.size()), 0, int(b.size())});
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+        if (item.match) {
+            matches.push_back(difflib::match_t(item.a_lo, item.b_lo, item.a_hi - item.a_lo));
+            continue;
+        }
+        int a_lo = item.a_lo;
+        int a_hi = item.a_hi;
+        int b_lo = item.b_lo;
+        int b_hi = item.b_hi;
+        int prefix = find_common_prefix(a, a_lo, a_hi, b, b_lo, b_hi);
+        if (prefix) {
+            matches.push_back(difflib::match_t(a_lo, b_lo, prefix));
+            a_lo += prefix;
+            b_lo += prefix;
+        }
+        int suffix = find_common_suffix(a, a_lo, a_hi, b, b_lo, b_hi);
+        if (suffix) {
+            a_hi -= suffix;
+            b_hi -= suffix;
+            stack.push_back(Item{true, a_hi, a_hi + suffix, b_hi, b_hi + suffix});
+        }
+        if (a_lo == a_hi or b_lo == b_hi) {
+            continue;
+        }
+
+        if (this->cancelled()) {
+            // Leave the rest as changed
+            this->approximate_ = true;
+            continue;
+        }
+        this->report_progress(float(a_lo) / a.size());
+        difflib::match_list_t anchors = this->find_anchors(a_lo, a_hi, b_lo, b_hi);
+        if (anchors.empty()) {
+            MyersSequenceMatcher<T> matcher(T(a.begin() + a_lo, a.begin() + a_hi),
+                                            T(b.begin() + b_lo, b.begin() + b_hi));
+            this->share_budget(matcher);
+            for (const difflib::match_t& m : matcher.matching_blocks()) {
+                if (std::get<2>(m)) {
+                    matches.push_back(difflib::match_t(a_lo + std::get<0>(m), b_lo + std::get<1>(m), std::get<2>(m)));
+                }
+            }
+            this->approximate_ = this->approximate_ or matcher.approximate();
+            continue;
+        }
+        // Push the gaps and anchors back to front
+        int next_a = a_hi;
+        int next_b = b_hi;
+        for (difflib::match_list_t::reverse_iterator it = anchors.rbegin(); it != anchors.rend(); ++it) {
+            int ai = std::get<0>(*it);
+            int bj = std::get<1>(*it);
+            int size = std::get<2>(*it);
+            stack.push_back(Item{false, ai + size, next_a, bj + size, next_b});
+            stack.push_back(Item{true, ai, ai + size, bj, bj + size});
+            next_a = ai;
+            next_b = bj;
+        }
+        stack.push_back(Item{false, a_lo, next_a, b_lo, next_b});
+    }
+
+    // Join touching matches, as the other matchers report them
+    this->matching_blocks_.reset(new difflib::match_list_t);
+    for (const difflib::match_t& m : matches) {
+        if (!this->matching_blocks_->empty()) {
+            difflib::match_t& last = this->matching_blocks_->back();
+            if (std::get<0>(last) + std::get<2>(last) == std::get<0>(m) and
+                    std::get<1>(last) + std::get<2>(last) == std::get<1>(m)) {
+                std::get<2>(last) += std::get<2>(m);
+                continue;
+            }
+        }
+        this->matching_blocks_->push_back(m);
+    }
+    this->matching_blocks_->push_back(difflib::match_t(a.size(), b.size(), 0));
     this->postprocess();
 }
 
+template <class T>
+PatienceSequenceMatcher<T>::PatienceSequenceMatcher(const T& a, const T& b, junk_function_type isjunk) : AnchoredSequenceMatcher<T>(a, b, isjunk) {
+}
+
+/*!
+ * Lines that occur exactly once in both a[a_lo:a_hi] and b[b_lo:b_hi],
+ * reduced to the longest increasing subsequence of their positions
+ */
+template <class T>
+static difflib::match_list_t find_unique_anchors(const T& a, int a_lo, int a_hi, const T& b, int b_lo, int b_hi) {
+    struct Occurrence {
+        int a_count;
+        int b_count;
+        int a_pos;
+        int b_pos;
+    };
+    std::unordered_map<typename T::value_type, Occurrence> occurrences;
+    for (int i = a_lo; i < a_hi; i++) {
+        Occurrence& o = occurrences.emplace(a[i], Occurrence{0, 0, 0, 0}).first->second;
+        o.a_count += 1;
+        o.a_pos = i;
+    }
+    for (int j = b_lo; j < b_hi; j++) {
+        typename std::unordered_map<typename T::value_type, Occurrence>::iterator it = occurrences.find(b[j]);
+        if (it != occurrences.end()) {
+            it->second.b_count += 1;
+            it->second.b_pos = j;
+        }
+    }
+
+    // Lines unique to both sides, in a order
+    std::vector<std::pair<int, int>> unique;
+    for (int i = a_lo; i < a_hi; i++) {
+        const Occurrence& o = occurrences[a[i]];
+        if (o.a_count == 1 and o.b_count == 1) {
+            unique.push_back(std::pair<int, int>(i, o.b_pos));
+        }
+    }
+
+    // Longest increasing subsequence of their b positions by patience
+    // sorting; piles holds the index of the top card of each pile.
+    std::vector<int> piles;
+    std::vector<int> backpointers(unique.size(), -1);
+    for (size_t k = 0; k < unique.size(); k++) {
+        int b_pos = unique[k].second;
+        std::vector<int>::iterator pile = std::lower_bound(piles.begin(), piles.end(), b_pos,
+            [&unique] (int top, int value) { return unique[top].second < value; });
+        if (pile != piles.begin()) {
+            backpointers[k] = *(pile - 1);
+        }
+        if (pile == piles.end()) {
+            piles.push_back(k);
+        } else {
+            *pile = k;
+        }
+    }
+
+    difflib::match_list_t anchors;
+    for (int k = piles.empty() ? -1 : piles.back(); k >= 0; k = backpointers[k]) {
+        anchors.push_back(difflib::match_t(unique[k].first, unique[k].second, 1));
+    }
+    std::reverse(anchors.begin(), anchors.end());
+    return anchors;
+}
+
+template <class T>
+difflib::match_list_t PatienceSequenceMatcher<T>::find_anchors(int a_lo, int a_hi, int b_lo, int b_hi) {
+    return find_unique_anchors(this->a_, a_lo, a_hi, this->b_, b_lo, b_hi);
+}
 
-InlineMyersSequenceMatcher::InlineMyersSequenceMatcher(std::string a, std::string b, junk_function_type isjunk) : MyersSequenceMatcher(a, b, isjunk) {
+template <class T>
+HistogramSequenceMatcher<T>::HistogramSequenceMatcher(const T& a, const T& b, junk_function_type isjunk) : AnchoredSequenceMatcher<T>(a, b, isjunk) {
 }
 
+template <class T>
+difflib::match_list_t HistogramSequenceMatcher<T>::find_anchors(int a_lo, int a_hi, int b_lo, int b_hi) {
+    const T& a = this->a_;
+    const T& b = this->b_;
+    std::unordered_map<typename T::value_type, std::vector<int>> positions;
+    for (int i = a_lo; i < a_hi; i++) {
+        positions[a[i]].push_back(i);
+    }
 
-std::pair<std::string, std::vector<int>> InlineMyersSequenceMatcher::index_matching_kmers(std::string a, std::string b) {
-    std::set<std::string> aset;
-    for (size_t i = 0; i < a.size() - 2; i++) {
-        aset.insert(a.substr(i, i + 3));
+    int best_a = -1;
+    int best_b = -1;
+    int best_size = 0;
+    size_t best_count = max_chain_length + 1;
+    int j = b_lo;
+    while (j < b_hi) {
+        typename std::unordered_map<typename T::value_type, std::vector<int>>::const_iterator it = positions.find(b[j]);
+        if (it == positions.end() or it->second.size() > max_chain_length or it->second.size() > best_count) {
+            j += 1;
+            continue;
+        }
+        int next_j = j + 1;
+        for (int i : it->second) {
+            // Grow the common run around (i, j), tracking how often its
+            // rarest line occurs in a
+            int as = i;
+            int bs = j;
+            int ae = i + 1;
+            int be = j + 1;
+            size_t count = it->second.size();
+            while (as > a_lo and bs > b_lo and a[as - 1] == b[bs - 1]) {
+                as -= 1;
+                bs -= 1;
+                count = std::min(count, positions[a[as]].size());
+            }
+            while (ae < a_hi and be < b_hi and a[ae] == b[be]) {
+                count = std::min(count, positions[a[ae]].size());
+                ae += 1;
+                be += 1;
+            }
+            if (count < best_count or (count == best_count and ae - as > best_size)) {
+                best_a = as;
+                best_b = bs;
+                best_size = ae - as;
+                best_count = count;
+            }
+            next_j = std::max(next_j, be);
+        }
+        j = next_j;
+    }
+
+    difflib::match_list_t anchors;
+    if (best_size > 0) {
+        anchors.push_back(difflib::match_t(best_a, best_b, best_size));
+    }
+    return anchors;
+}
+
+template <class T>
+std::unique_ptr<MyersSequenceMatcher<T>> make_matcher(const std::string& algorithm, const T& a, const T& b) {
+    if (algorithm == "patience") {
+        return std::unique_ptr<MyersSequenceMatcher<T>>(new PatienceSequenceMatcher<T>(a, b));
+    } else if (algorithm == "histogram") {
+        return std::unique_ptr<MyersSequenceMatcher<T>>(new HistogramSequenceMatcher<T>(a, b));
+    }
+    // Without sync points this is plain Myers, split across threads for
+    // large inputs
+    return std::unique_ptr<MyersSequenceMatcher<T>>(new SyncPointMyersSequenceMatcher<T>(a, b));
+}
+
+
+InlineMyersSequenceMatcher::InlineMyersSequenceMatcher(const std::string& a, const std::string& b, junk_function_type isjunk) : MyersSequenceMatcher<std::string>(a, b, isjunk) {
+}
+
+
+std::pair<std::string, std::vector<int>> InlineMyersSequenceMatcher::index_matching_kmers(const std::string& a, const std::string& b) {
+    // Roll each 3-mer into the low 24 bits of an integer, so that no
+    // substring is ever built and equal keys mean equal k-mers.
+    HashIndex<uint32_t> aset(a.size());
+    uint32_t kmer = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        kmer = ((kmer << 8) | (unsigned char) a[i]) & 0xffffff;
+        if (i >= 2) {
+            aset.insert(kmer);
+        }
     }
     std::string matches;
     std::vector<int> index;
     size_t next_poss_match = 0;
-    // Start from where we can get a valid triple
-    for (size_t i = 2; i < b.size(); i++) {
-        if (std::find(aset.begin(), aset.end(), b.substr(i - 2, i + 1)) == aset.end()) {
+    kmer = 0;
+    for (size_t i = 0; i < b.size(); i++) {
+        kmer = ((kmer << 8) | (unsigned char) b[i]) & 0xffffff;
+        // Start from where we can get a valid triple
+        if (i < 2 or !aset.contains(kmer)) {
             continue;
         }
         // Make sure we don't re-record matches from overlapping kmers
@@ -462,10 +1665,12 @@ std::pair<std::string, std::string> InlineMyersSequenceMatcher::preprocess_disca
     std::string indexed_a = tmp.first;
     this->aindex = tmp.second;
 
-    // We only use the optimised result if it's worthwhile. The constant
+    // We only use the optimised result if it's worthwhile. The threshold
     // represents a heuristic of how many lines constitute 'worthwhile'.
-    this->lines_discarded = (b.size() - indexed_b.size() > 10 or
-                            a.size() - indexed_a.size() > 10);
+    this->discarded_a_ = a.size() - indexed_a.size();
+    this->discarded_b_ = b.size() - indexed_b.size();
+    this->lines_discarded = (this->discarded_b_ > this->discard_threshold_ or
+                             this->discarded_a_ > this->discard_threshold_);
     if (this->lines_discarded) {
         a = indexed_a;
         b = indexed_b;
@@ -473,9 +1678,79 @@ std::pair<std::string, std::string> InlineMyersSequenceMatcher::preprocess_disca
     return std::pair<std::string, std::string>(a, b);
 }
 
+BitParallelSequenceMatcher::BitParallelSequenceMatcher(const std::string& a, const std::string& b, junk_function_type isjunk) : MyersSequenceMatcher<std::string>(a, b, isjunk) {
+    if (!fits(a, b)) {
+        throw ValueError("sequences too long for BitParallelSequenceMatcher");
+    }
+}
+
+bool BitParallelSequenceMatcher::fits(const std::string& a, const std::string& b) {
+    return a.size() <= max_length and b.size() <= max_length;
+}
+
+void BitParallelSequenceMatcher::initialise() {
+    // A bit vector of max_length bits, as two 64 bit words
+    typedef std::array<uint64_t, 2> bits_t;
+    const std::string& a = this->a_;
+    const std::string& b = this->b_;
+    const int m = a.size();
+    const int n = b.size();
+
+    // match[c] has bit i set where a[i] == c
+    bits_t match[256] = {};
+    for (int i = 0; i < m; i++) {
+        match[static_cast<unsigned char>(a[i])][i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    // After j characters of b, bit i of column[j] is clear exactly where
+    // LCS(a[0:i+1], b[0:j]) is one more than LCS(a[0:i], b[0:j]).
+    std::vector<bits_t> column(n + 1);
+    column[0] = bits_t{{~uint64_t(0), ~uint64_t(0)}};
+    for (int j = 0; j < n; j++) {
+        const bits_t& v = column[j];
+        const bits_t& pm = match[static_cast<unsigned char>(b[j])];
+        bits_t u = {{v[0] & pm[0], v[1] & pm[1]}};
+        // (v + u) | (v - u), carrying and borrowing across the words
+        uint64_t sum0 = v[0] + u[0];
+        uint64_t sum1 = v[1] + u[1] + (sum0 < v[0]);
+        uint64_t diff0 = v[0] - u[0];
+        uint64_t diff1 = v[1] - u[1] - (v[0] < u[0]);
+        column[j + 1] = bits_t{{sum0 | diff0, sum1 | diff1}};
+    }
 
-SyncPointMyersSequenceMatcher::SyncPointMyersSequenceMatcher(std::string a, std::string b, junk_function_type isjunk, std::vector<std::pair<int, int>> *syncpoints) : MyersSequenceMatcher(a, b, isjunk) {
+    // Trace back from the end: equal characters are always part of some
+    // LCS, and otherwise we can step to a[0:i-1] without losing anything
+    // exactly when bit i - 1 is set.
+    std::deque<difflib::match_t> blocks;
+    int i = m;
+    int j = n;
+    while (i > 0 and j > 0) {
+        if (a[i - 1] == b[j - 1]) {
+            i -= 1;
+            j -= 1;
+            if (!blocks.empty() and std::get<0>(blocks.front()) == size_t(i + 1) and std::get<1>(blocks.front()) == size_t(j + 1)) {
+                blocks.front() = difflib::match_t(i, j, std::get<2>(blocks.front()) + 1);
+            } else {
+                blocks.push_front(difflib::match_t(i, j, 1));
+            }
+        } else if (column[j][(i - 1) / 64] & (uint64_t(1) << ((i - 1) % 64))) {
+            i -= 1;
+        } else {
+            j -= 1;
+        }
+    }
+    blocks.push_back(difflib::match_t(m, n, 0));
+    this->matching_blocks_.reset(new difflib::match_list_t(blocks.begin(), blocks.end()));
+    this->postprocess();
+}
+
+
+template <class T>
+SyncPointMyersSequenceMatcher<T>::SyncPointMyersSequenceMatcher(const T& a, const T& b, junk_function_type isjunk, std::vector<std::pair<int, int>> *syncpoints) : MyersSequenceMatcher<T>(a, b, isjunk) {
     this->syncpoints = syncpoints;
+    this->auto_split_threshold_ = 50000;
+    this->max_workers_ = std::max(1u, std::thread::hardware_concurrency());
+    this->region_count_ = 0;
 }
 
 template <class T = std::string>
@@ -488,101 +1763,177 @@ public:
     Chunk(int ai, int bi, T a, T b) : ai(ai), bi(bi), a(a), b(b) {}
 };
 
-void SyncPointMyersSequenceMatcher::initialise() {
-    if (!this->syncpoints or this->syncpoints->empty()) {
-        MyersSequenceMatcher::initialise();
-    } else {
-        std::vector<Chunk<std::string>> chunks;
-        size_t ai = 0;
-        size_t bi = 0;
-        for (std::pair<int, int> tmp : *this->syncpoints) {
-            int aj = tmp.first;
-            int bj = tmp.second;
-            chunks.push_back(Chunk<std::string>(ai, bi, this->a_.substr(ai, aj-ai), this->b_.substr(bi, bj-bi)));
-            ai = aj;
-            bi = bj;
-        }
-        if (ai < this->a_.size() or bi < this->b_.size()) {
-            chunks.push_back(Chunk<std::string>(ai, bi, this->a_.substr(ai), this->b_.substr(bi)));
-        }
-
-        this->split_matching_blocks.clear();
-        this->matching_blocks_->clear();
-        for (Chunk<std::string> c : chunks) {
-            int ai = c.ai;
-            int bi = c.bi;
-            std::string a = c.a;
-            std::string b = c.b;
-            MyersSequenceMatcher matcher(a, b, this->is_junk_);
-            matcher.initialise();
-            difflib::match_list_t tmp = matcher.get_matching_blocks();
-            std::deque<difflib::match_t> blocks = std::deque<difflib::match_t>(tmp.begin(), tmp.end());
-            std::vector<difflib::match_t> matching_blocks(blocks.size());
-            int l = matching_blocks.size() - 1;
-            if (l >= 0 and blocks.size() > 1) {
-                int aj = std::get<0>(matching_blocks[l]);
-                int bj = std::get<1>(matching_blocks[l]);
-                int bl = std::get<2>(matching_blocks[l]);
-                if (aj + bl == ai and bj + bl == bi and
-                        std::get<0>(blocks[0]) == 0 and std::get<1>(blocks[0]) == 0) {
-                    difflib::match_t block = blocks.front();
-                    blocks.pop_front();
-                    matching_blocks[l] = difflib::match_t(aj, bj, bl + std::get<2>(block));
+/*!
+ * Run job(0) to job(count - 1) on up to workers threads
+ *
+ * Jobs are handed out in order from a shared counter. The first
+ * exception thrown by a job is rethrown here once all threads are done.
+ */
+static void parallel_for(size_t count, unsigned int workers, const std::function<void(size_t)>& job) {
+    workers = std::min<size_t>(workers, count);
+    if (workers <= 1) {
+        for (size_t k = 0; k < count; k++) {
+            job(k);
+        }
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto run = [&] () {
+        for (size_t k = next++; k < count; k = next++) {
+            try {
+                job(k);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
                 }
             }
-            for (size_t i = 0; i < blocks.size() - 1; i++) {
-                difflib::match_t m = blocks[i];
-                int x = std::get<0>(m);
-                int y = std::get<1>(m);
-                int l = std::get<2>(m);
-                matching_blocks.push_back(difflib::match_t(ai + x, bi + y, l));
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int w = 1; w < workers; w++) {
+        threads.push_back(std::thread(run));
+    }
+    run();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+template <class T>
+std::vector<std::pair<int, int>> SyncPointMyersSequenceMatcher<T>::find_split_points() {
+    std::vector<std::pair<int, int>> points;
+    const int n = this->a_.size();
+    const int m = this->b_.size();
+    if (this->max_workers_ <= 1 or size_t(n + m) < this->auto_split_threshold_) {
+        return points;
+    }
+    // Several regions per worker keep the threads busy when the changes
+    // are unevenly spread, but regions must stay large enough that their
+    // own prefix and suffix trimming does most of the work.
+    const int spacing = std::max<int>(4096, (n + m) / (this->max_workers_ * 4));
+    int last = 0;
+    for (const difflib::match_t& anchor : find_unique_anchors(this->a_, 0, n, this->b_, 0, m)) {
+        int i = std::get<0>(anchor);
+        int j = std::get<1>(anchor);
+        if (i + j - last >= spacing and (n - i) + (m - j) >= spacing) {
+            points.push_back(std::pair<int, int>(i, j));
+            last = i + j;
+        }
+    }
+    return points;
+}
+
+template <class T>
+void SyncPointMyersSequenceMatcher<T>::initialise() {
+    bool user_syncpoints = this->syncpoints and !this->syncpoints->empty();
+    std::vector<std::pair<int, int>> points;
+    if (user_syncpoints) {
+        points = *this->syncpoints;
+    } else {
+        points = this->find_split_points();
+    }
+    this->split_matching_blocks.clear();
+    if (points.empty()) {
+        this->region_count_ = 1;
+        MyersSequenceMatcher<T>::initialise();
+        return;
+    }
+
+    std::vector<Chunk<T>> chunks;
+    size_t ai = 0;
+    size_t bi = 0;
+    for (std::pair<int, int> tmp : points) {
+        int aj = tmp.first;
+        int bj = tmp.second;
+        chunks.push_back(Chunk<T>(ai, bi, T(this->a_.begin() + ai, this->a_.begin() + aj), T(this->b_.begin() + bi, this->b_.begin() + bj)));
+        ai = aj;
+        bi = bj;
+    }
+    if (ai < this->a_.size() or bi < this->b_.size()) {
+        chunks.push_back(Chunk<T>(ai, bi, T(this->a_.begin() + ai, this->a_.end()), T(this->b_.begin() + bi, this->b_.end())));
+    }
+    this->region_count_ = chunks.size();
+
+    // Regions are independent, so only the stitching below is sequential
+    this->start_budget();
+    std::vector<difflib::match_list_t> results(chunks.size());
+    std::vector<char> approximate(chunks.size(), false);
+    // The region matchers don't report progress themselves, as each one
+    // would start over from 0; regions finished count instead
+    std::atomic<size_t> finished(0);
+    parallel_for(chunks.size(), this->max_workers_, [this, &chunks, &results, &approximate, &finished] (size_t k) {
+        MyersSequenceMatcher<T> matcher(chunks[k].a, chunks[k].b, this->is_junk_);
+        this->share_budget(matcher);
+        results[k] = matcher.matching_blocks();
+        approximate[k] = matcher.approximate();
+        this->report_progress(float(finished.fetch_add(1) + 1) / chunks.size());
+    });
+    this->approximate_ = std::find(approximate.begin(), approximate.end(), true) != approximate.end();
+
+    this->matching_blocks_.reset(new difflib::match_list_t);
+    for (size_t k = 0; k < chunks.size(); k++) {
+        const Chunk<T>& c = chunks[k];
+        int ai = c.ai;
+        int bi = c.bi;
+        const T& a = c.a;
+        const T& b = c.b;
+        const difflib::match_list_t& tmp = results[k];
+        std::deque<difflib::match_t> blocks = std::deque<difflib::match_t>(tmp.begin(), tmp.end());
+        std::vector<difflib::match_t> matching_blocks;
+        int l = this->matching_blocks_->size() - 1;
+        if (l >= 0 and blocks.size() > 1) {
+            int aj = std::get<0>((*this->matching_blocks_)[l]);
+            int bj = std::get<1>((*this->matching_blocks_)[l]);
+            int bl = std::get<2>((*this->matching_blocks_)[l]);
+            if (aj + bl == ai and bj + bl == bi and
+                    std::get<0>(blocks[0]) == 0 and std::get<1>(blocks[0]) == 0) {
+                difflib::match_t block = blocks.front();
+                blocks.pop_front();
+                (*this->matching_blocks_)[l] = difflib::match_t(aj, bj, bl + std::get<2>(block));
             }
-            this->matching_blocks_->insert(this->matching_blocks_->end(), matching_blocks.begin(), matching_blocks.end());
-#if 0
+        }
+        for (size_t i = 0; i + 1 < blocks.size(); i++) {
+            difflib::match_t m = blocks[i];
+            int x = std::get<0>(m);
+            int y = std::get<1>(m);
+            int l = std::get<2>(m);
+            matching_blocks.push_back(difflib::match_t(ai + x, bi + y, l));
+        }
+        this->matching_blocks_->insert(this->matching_blocks_->end(), matching_blocks.begin(), matching_blocks.end());
+        if (user_syncpoints) {
             // Split matching blocks each need to be terminated to get our
             // split chunks correctly created
-            this->split_matching_blocks.append(
-                matching_blocks + [(ai + a.length(), bi + b.length(), 0)]);
-#endif
-        }
-        this->matching_blocks_->push_back(difflib::match_t(this->a_.size(), this->b_.size(), 0));
-    }
-}
-
-difflib::chunk_list_t SyncPointMyersSequenceMatcher::get_opcodes() {
-    // This is just difflib.SequenceMatcher.get_opcodes in which we instead
-    // iterate over our internal set of split matching blocks.
-    if (this->opcodes_) {
-        return *this->opcodes_;
-    }
-    int i = 0;
-    int j = 0;
-    this->opcodes_.reset(new difflib::chunk_list_t);
-    this->get_matching_blocks();
-    for (difflib::match_list_t matching_blocks : this->split_matching_blocks) {
-        for (difflib::match_t m : matching_blocks) {
-            int ai = std::get<0>(m);
-            int bj = std::get<1>(m);
-            int size = std::get<2>(m);
-            std::string tag = "";
-            if (i < ai and j < bj) {
-                tag = "replace";
-            } else if (i < ai) {
-                tag = "delete";
-            } else if (j < bj) {
-                tag = "insert";
-            }
-            if (!tag.empty()) {
-                opcodes_->push_back(difflib::chunk_t(tag, i, ai, j, bj));
-            }
-            i = ai+size;
-            j = bj+size;
-            // the list of matching blocks is terminated by a
-            // sentinel with size 0
-            if (size) {
-                opcodes_->push_back(difflib::chunk_t("equal", ai, i, bj, j));
-            }
+            this->split_matching_blocks.insert(this->split_matching_blocks.end(), matching_blocks.begin(), matching_blocks.end());
+            this->split_matching_blocks.push_back(difflib::match_t(ai + a.size(), bi + b.size(), 0));
         }
     }
-    return *opcodes_;
+    this->matching_blocks_->push_back(difflib::match_t(this->a_.size(), this->b_.size(), 0));
+}
+
+template <class T>
+const difflib::match_list_t& SyncPointMyersSequenceMatcher<T>::opcode_blocks() {
+    // Like difflib.SequenceMatcher.get_opcodes, but walking the split
+    // blocks, whose sentinels keep opcodes from crossing sync points.
+    const difflib::match_list_t& blocks = this->matching_blocks();
+    if (this->split_matching_blocks.empty()) {
+        return blocks;
+    }
+    return this->split_matching_blocks;
 }
+
+template class MyersSequenceMatcher<std::string>;
+template class MyersSequenceMatcher<line_ids_t>;
+template class SyncPointMyersSequenceMatcher<std::string>;
+template class SyncPointMyersSequenceMatcher<line_ids_t>;
+template class PatienceSequenceMatcher<std::string>;
+template class PatienceSequenceMatcher<line_ids_t>;
+template class HistogramSequenceMatcher<std::string>;
+template class HistogramSequenceMatcher<line_ids_t>;
+template std::unique_ptr<MyersSequenceMatcher<std::string>> make_matcher(const std::string&, const std::string&, const std::string&);
+template std::unique_ptr<MyersSequenceMatcher<line_ids_t>> make_matcher(const std::string&, const line_ids_t&, const line_ids_t&);
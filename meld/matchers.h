@@ -19,12 +19,236 @@
 #ifndef __MELD__MATCHERS_H__
 #define __MELD__MATCHERS_H__
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <boost/utility/string_view.hpp>
 #include "difflib/src/difflib.h"
 
+/*! A pane reduced to one integer ID per line, see LineInterner */
+typedef std::vector<uint32_t> line_ids_t;
+
+/*!
+ * Borrowed text: a whole pane, or one of its lines
+ *
+ * A view never owns its characters. Whoever makes one keeps the text
+ * alive and unchanged until the call it is passed to returns, and
+ * anything kept beyond that call is copied out of it: LineInterner
+ * copies each distinct line once, and matchers own their line IDs.
+ */
+typedef boost::string_view text_view;
+
+/*!
+ * Lines lo to hi of text, split as splitlines() does but without copying
+ *
+ * Line ends are not included. Only the text up to line hi is scanned.
+ */
+extern std::vector<text_view> line_views(text_view text, size_t lo, size_t hi);
+
 extern void init_worker();
 
-extern difflib::chunk_list_t matcher_worker(std::string text1, std::string textn);
+/*!
+ * Length of the common prefix (or suffix) of a[0:n] and b[0:n]
+ *
+ * These scan in place, 16 or 32 bytes at a time with SSE2 or AVX2 where
+ * the compiler targets them, and byte by byte otherwise. The uint32_t
+ * versions work on interned line IDs or line hashes.
+ */
+extern size_t common_prefix_length(const char* a, const char* b, size_t n);
+extern size_t common_suffix_length(const char* a, const char* b, size_t n);
+extern size_t common_prefix_length(const uint32_t* a, const uint32_t* b, size_t n);
+extern size_t common_suffix_length(const uint32_t* a, const uint32_t* b, size_t n);
+
+extern difflib::chunk_list_t matcher_worker(const std::string& text1, const std::string& textn);
+
+/*! Ways to normalise lines before they are compared, as bit flags */
+enum LineNormalisation {
+    NORMALISE_NONE = 0,
+    NORMALISE_TRIM_LEADING = 1 << 0,
+    NORMALISE_TRIM_TRAILING = 1 << 1,
+    /*! Compare every run of whitespace as a single space */
+    NORMALISE_COLLAPSE_SPACE = 1 << 2,
+    /*! Leave out all whitespace */
+    NORMALISE_IGNORE_SPACE = 1 << 3,
+    /*! Compare ASCII letters regardless of case */
+    NORMALISE_FOLD_CASE = 1 << 4,
+    /*! Leave out lines that are empty once normalised, see intern_lines() */
+    NORMALISE_SKIP_BLANK = 1 << 5
+};
+
+/*!
+ * Map lines of text to small integer IDs
+ *
+ * Every distinct line is hashed once into a table shared by all of the
+ * panes of a comparison, so that equal lines in different panes get the
+ * same ID. Matchers can then run over line_ids_t sequences and compare
+ * whole lines with a single integer comparison.
+ *
+ * Lines are normalised as set_normalisation() says before they are
+ * hashed, so lines differing only in, say, whitespace share an ID while
+ * the text itself stays as it is for display.
+ */
+class LineInterner {
+private:
+    struct view_hash {
+        size_t operator()(text_view line) const;
+    };
+    /*! The table's own copy of every distinct line, keyed by views of it */
+    std::deque<std::string> lines;
+    std::unordered_map<text_view, uint32_t, view_hash> ids;
+    size_t copied;
+    int flags;
+    /*! Where normalise() rewrites lines that trimming alone can't */
+    std::string scratch;
+
+    text_view normalise(text_view line);
+    uint32_t intern_normalised(text_view key);
+public:
+    LineInterner();
+
+    int normalisation() const;
+
+    /*! Set LineNormalisation flags; changing them empties the table */
+    void set_normalisation(int flags);
+
+    uint32_t intern(text_view line);
+
+    line_ids_t intern(std::vector<std::string>::const_iterator begin, std::vector<std::string>::const_iterator end);
+
+    line_ids_t intern(const std::vector<std::string>& lines);
+
+    /*!
+     * IDs of lines lo to hi of a whole text, see line_views()
+     *
+     * With NORMALISE_SKIP_BLANK, blank lines get no ID at all. If
+     * line_numbers is given, it receives the line number in text of each
+     * ID, for map_chunk_lines().
+     */
+    line_ids_t intern_lines(text_view text, size_t lo, size_t hi, std::vector<uint32_t>* line_numbers = nullptr);
+
+    /*! IDs of lines already split out, the first of them being line lo */
+    line_ids_t intern_lines(const std::vector<text_view>& lines, size_t lo, std::vector<uint32_t>* line_numbers = nullptr);
+
+    /*! Number of distinct lines seen so far */
+    size_t size() const;
+
+    /*!
+     * Bytes of text copied into the table so far
+     *
+     * Only lines never seen before are copied, so re-interning the lines
+     * around an edit adds just the length of the new lines.
+     */
+    size_t copied_bytes() const;
+
+    void clear();
+};
+
+/*!
+ * Map a chunk between interned lines back to the lines of the texts
+ *
+ * a_lines and b_lines are the line numbers intern_lines() gave for the
+ * chunk's sides, which started at a_start and b_start. Skipped blank
+ * lines inside a change become part of it, and those at its ends do not.
+ */
+extern difflib::chunk_t map_chunk_lines(const difflib::chunk_t& chunk,
+                                        const std::vector<uint32_t>& a_lines, size_t a_start,
+                                        const std::vector<uint32_t>& b_lines, size_t b_start);
+
+/*!
+ * Split the moved lines out of the difference opcodes between a and b
+ *
+ * Runs of at least min_lines lines that are deleted and inserted again
+ * unchanged are found by hashing every min_lines long window of inserted
+ * lines. Whole deleted and inserted runs of that length in different
+ * changes are paired too when their lines are at least similarity alike,
+ * as quick_ratio() has it; a similarity above 1 turns this off.
+ *
+ * Each side of a move becomes a Tag::move chunk, whose range on the
+ * other pane is empty and sits where the change was. Whatever else the
+ * change held is left as deletes and inserts. The result is ordered as
+ * changes are, so it can stand in for them; min_lines of 0 leaves them
+ * as they are.
+ */
+extern difflib::chunk_list_t find_moves(const difflib::chunk_list_t& changes,
+                                        const line_ids_t& a, const line_ids_t& b,
+                                        size_t min_lines, double similarity = 0.8);
+
+/*!
+ * Split a conflict into the lines both sides agree on and those they don't
+ *
+ * a and b are the lines of the two sides, from a_start and b_start, that
+ * replaced lines mid_start to mid_end of the middle text. Runs of lines
+ * equal on both sides become replace chunks and the rest conflicts, each
+ * as the pair of chunks to a and to b. Their middle lines follow a or b,
+ * whichever has as many lines as the middle, or are empty at mid_start.
+ * The matcher settles for an approximate result after time_limit.
+ */
+extern std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> split_conflict(
+    const line_ids_t& a, const line_ids_t& b, int a_start, int b_start, int mid_start, int mid_end,
+    std::chrono::milliseconds time_limit);
+
+/*!
+ * Open addressing hash set for the discard prefilters
+ *
+ * The table is sized for the expected number of keys up front and
+ * probed linearly, so building it is a single allocation and a lookup
+ * usually touches one cache line.
+ */
+template <class K>
+class HashIndex {
+private:
+    std::vector<K> keys;
+    std::vector<uint8_t> used;
+    size_t mask;
+
+    size_t slot(const K& key) const {
+        // Fibonacci hashing spreads out the identity hashes std::hash
+        // gives integers
+        return (uint64_t(std::hash<K>()(key)) * 0x9E3779B97F4A7C15ull >> 20) & this->mask;
+    }
+
+public:
+    HashIndex(size_t expected) {
+        size_t capacity = 16;
+        while (capacity < expected * 2) {
+            capacity *= 2;
+        }
+        this->keys.resize(capacity);
+        this->used.resize(capacity, 0);
+        this->mask = capacity - 1;
+    }
+
+    void insert(const K& key) {
+        size_t i = this->slot(key);
+        while (this->used[i]) {
+            if (this->keys[i] == key) {
+                return;
+            }
+            i = (i + 1) & this->mask;
+        }
+        this->keys[i] = key;
+        this->used[i] = 1;
+    }
+
+    bool contains(const K& key) const {
+        size_t i = this->slot(key);
+        while (this->used[i]) {
+            if (this->keys[i] == key) {
+                return true;
+            }
+            i = (i + 1) & this->mask;
+        }
+        return false;
+    }
+};
 
 class Snake {
 public:
@@ -35,7 +259,182 @@ public:
     Snake(Snake *lastsnake, int x, int y, int snake);
 };
 
-class MyersSequenceMatcher : public difflib::SequenceMatcher<std::string> {
+/*!
+ * Bump allocator for the snakes of a single matcher run
+ *
+ * Snakes are only ever added while the O(NP) search runs, and are all
+ * dropped together once the matching blocks have been built. They are
+ * therefore carved out of a handful of geometrically growing blocks
+ * rather than being allocated (and leaked) one at a time.
+ */
+class SnakeArena {
+private:
+    std::vector<std::vector<Snake>> blocks;
+    size_t bytes;
+    size_t peak;
+public:
+    SnakeArena();
+
+    Snake* create(Snake *lastsnake, int x, int y, int snake);
+
+    /*! Free every snake at once; previously returned pointers become invalid */
+    void release();
+
+    /*! Bytes currently reserved for snakes */
+    size_t allocated_bytes() const;
+
+    /*! Largest value allocated_bytes() reached, kept across release() */
+    size_t peak_bytes() const;
+};
+
+/*!
+ * Lets another thread follow a matcher's run and stop it
+ *
+ * The matcher stores how far through its search it has got, as a
+ * fraction, and calls notify each time that moves on by a percent or
+ * more. Once cancel() is called it gives up at its next check, leaving
+ * the regions it hadn't finished as changed and approximate() set.
+ * notify is called from the matcher's thread, or from those its regions
+ * run on when they are matched in parallel; the rest may be used from
+ * any thread.
+ */
+class MatchControl {
+private:
+    std::atomic<bool> cancelled_;
+    std::atomic<float> progress_;
+    std::atomic<float> notified_;
+    std::function<void()> notify_;
+public:
+    explicit MatchControl(std::function<void()> notify = nullptr);
+
+    void cancel();
+    bool cancelled() const;
+
+    /*! How far the run has got, from 0 to 1; it only ever grows */
+    float progress() const;
+
+    /*! Note progress, from any of the matcher's threads */
+    void report(float progress);
+};
+
+/*!
+ * A fixed set of threads running matcher_worker() for inline highlighting
+ *
+ * Jobs run in the order they were submitted, and each one's done is
+ * called with its opcodes on the worker's thread, or with none if the
+ * matcher threw; handing them back to the GUI thread is up to the
+ * caller. Jobs are submitted on behalf of an owner, so that an owner
+ * going away can drop those not yet started.
+ */
+class MatcherPool {
+public:
+    typedef std::function<void(const difflib::chunk_list_t&)> done_type;
+private:
+    struct Job {
+        const void* owner;
+        std::string text1;
+        std::string textn;
+        done_type done;
+    };
+    std::deque<Job> jobs_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+    std::vector<std::thread> threads_;
+
+    void run();
+public:
+    /*! Run jobs on workers threads, or if 0 on one fewer than there are cores */
+    explicit MatcherPool(unsigned int workers = 0);
+    /*! Drop the jobs not yet started and wait for the running ones */
+    ~MatcherPool();
+
+    unsigned int workers() const;
+
+    void submit(const void* owner, const std::string& text1, const std::string& textn, done_type done);
+
+    /*! Drop the jobs of owner not yet started; running ones still finish */
+    void cancel(const void* owner);
+
+    /*! Number of jobs waiting for a worker */
+    size_t queued() const;
+};
+
+/*!
+ * Inline matches by content, least recently used out first, within a byte budget
+ *
+ * Entries are keyed by 64 bit hashes of both texts rather than by the
+ * texts themselves, so a lookup hashes each text once and compares two
+ * integers, and the cache holds no copies of the text. Each entry is
+ * charged for its opcodes plus a fixed overhead, and the least recently
+ * used entries are dropped as soon as the total passes the budget.
+ * Lookups and evictions are O(1).
+ *
+ * A cache can be shared by any number of comparisons, but is not
+ * synchronised: use it from one thread.
+ */
+class InlineMatchCache {
+public:
+    typedef std::pair<uint64_t, uint64_t> key_type;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+private:
+    struct key_hash {
+        size_t operator()(const key_type& key) const;
+    };
+    struct Entry {
+        key_type key;
+        difflib::chunk_list_t opcodes;
+        size_t bytes;
+    };
+    /*! Most recently used first */
+    std::list<Entry> entries_;
+    std::unordered_map<key_type, std::list<Entry>::iterator, key_hash> index_;
+    size_t budget_;
+    size_t bytes_;
+    Stats stats_;
+
+    void evict_to(size_t budget);
+public:
+    explicit InlineMatchCache(size_t budget);
+
+    /*! The key the match between text1 and textn is stored under */
+    static key_type key(text_view text1, text_view textn);
+
+    /*! Copy the opcodes under key to opcodes and mark them used; false if there are none */
+    bool lookup(const key_type& key, difflib::chunk_list_t& opcodes);
+
+    /*! Store opcodes under key, unless they alone are over budget */
+    void insert(const key_type& key, const difflib::chunk_list_t& opcodes);
+
+    size_t budget() const;
+    /*! Change the budget, dropping entries to fit in it */
+    void set_budget(size_t budget);
+
+    /*! Drop every entry and start the counts again */
+    void clear();
+
+    /*! Hits, misses and evictions since construction or clear(), and what is held now */
+    Stats stats() const;
+};
+
+/*!
+ * Myers diff over any indexable sequence
+ *
+ * T is either std::string, for character-level inline matching, or
+ * line_ids_t, for matching lines interned with a LineInterner.
+ */
+template <class T = std::string>
+class MyersSequenceMatcher : public difflib::SequenceMatcher<T> {
+public:
+    using junk_function_type = typename difflib::SequenceMatcher<T>::junk_function_type;
+
 protected:
 
     std::vector<int> aindex;
@@ -43,27 +442,101 @@ protected:
     int common_prefix;
     int common_suffix;
     bool lines_discarded;
+    size_t discarded_a_;
+    size_t discarded_b_;
+    size_t discard_threshold_;
+    SnakeArena snakes;
+    size_t linear_space_threshold_;
+    bool used_linear_space_;
+    std::chrono::milliseconds time_limit_;
+    int cost_limit_;
+    std::chrono::steady_clock::time_point deadline_;
+    bool approximate_;
+    MatchControl* control_;
+    bool reports_progress_;
+
+    /*! Start the clock for time_limit() and forget the last result */
+    void start_budget();
+
+    /*! Give matcher whatever is left of this run's budget, and its control */
+    void share_budget(MyersSequenceMatcher<T>& matcher) const;
+
+    bool cancelled() const;
+
+    void report_progress(float progress);
 
 public:
 
-    MyersSequenceMatcher(std::string a, std::string b, junk_function_type isjunk = nullptr);
+    MyersSequenceMatcher(const T& a, const T& b, junk_function_type isjunk = nullptr);
 
-    virtual difflib::match_list_t get_matching_blocks();
+    virtual const difflib::match_list_t& matching_blocks();
 
     difflib::chunk_list_t get_difference_opcodes();
 
-    std::pair<std::string, std::string> preprocess_remove_prefix_suffix(std::string a, std::string b);
+    /*! Peak memory used by the snake graph while matching, in bytes */
+    size_t peak_arena_bytes() const;
 
-    std::pair<std::string, std::vector<int>> index_matching(std::string a, std::string b);
+    /*!
+     * Above this estimate of D * N (edit distance times the length of
+     * both inputs) the O(NP) search, whose memory grows with D, gives up
+     * and the linear space engine is used instead.
+     */
+    size_t linear_space_threshold() const;
+    void set_linear_space_threshold(size_t value);
 
-    virtual std::pair<std::string, std::string> preprocess_discard_nonmatching_lines(std::string a, std::string b);
+    /*! Whether the last run used the linear space engine */
+    bool used_linear_space() const;
+
+    /*!
+     * Budget for a single run, as wall-clock time and as the largest
+     * edit distance to search for; both are unlimited by default.
+     *
+     * Once either runs out the linear space engine takes over and splits
+     * the remaining regions at the furthest reaching path found so far
+     * rather than at the middle snake, much like GNU diff's
+     * --speed-large-files. The result is still a valid alignment, but
+     * not necessarily a minimal one.
+     */
+    std::chrono::milliseconds time_limit() const;
+    void set_time_limit(std::chrono::milliseconds limit);
+    int cost_limit() const;
+    void set_cost_limit(int limit);
+
+    /*! Whether the last run ran out of budget, see time_limit() */
+    bool approximate() const;
+
+    /*!
+     * Report progress to, and be stopped by, control, which must outlive
+     * the run. Only the matcher called reports progress; any it splits
+     * the work with just check for cancellation.
+     */
+    void set_control(MatchControl* control, bool report_progress = true);
+
+    /*!
+     * Number of elements of a and b that matched nothing in the other
+     * sequence during preprocessing, whether or not they were dropped
+     */
+    std::pair<size_t, size_t> discarded_counts() const;
+
+    /*!
+     * Non-matching elements are only dropped when more than this many
+     * were found on either side, as remapping the result has a cost too
+     */
+    size_t discard_threshold() const;
+    void set_discard_threshold(size_t value);
+
+    std::pair<T, T> preprocess_remove_prefix_suffix(const T& a, const T& b);
+
+    std::pair<T, std::vector<int>> index_matching(const T& a, const T& b);
+
+    virtual std::pair<T, T> preprocess_discard_nonmatching_lines(T a, T b);
 
     /*!
      * Pre-processing optimizations:
      * 1) remove common prefix and common suffix
      * 2) remove lines that do not match
      */
-    std::pair<std::string, std::string> preprocess();
+    std::pair<T, T> preprocess();
 
     /*!
      * Perform some post-processing cleanup to reduce 'chaff' and make
@@ -84,6 +557,16 @@ public:
      */
     void build_matching_blocks(Snake* lastsnake);
 
+    /*!
+     * Divide and conquer implementation of the linear space refinement
+     * from Eugene W. Myers ("An O(ND) Difference Algorithm and Its
+     * Variations", 1986, section 4b). Memory is O(N) regardless of D.
+     *
+     * Returns the same snake chain as the O(NP) search would, so that
+     * build_matching_blocks() can be used on the result.
+     */
+    Snake* linear_space_snakes(const T& a, const T& b);
+
     /*!
      * Optimized implementation of the O(NP) algorithm described by Sun Wu,
      * Udi Manber, Gene Myers, Webb Miller
@@ -93,28 +576,175 @@ public:
     virtual void initialise();
 };
 
-class InlineMyersSequenceMatcher : public MyersSequenceMatcher {
+/*!
+ * Base for matchers that split the problem at anchor matches
+ *
+ * Each region left between anchors is split again, until no anchors can
+ * be found; what remains is handed to the plain Myers search.
+ */
+template <class T = std::string>
+class AnchoredSequenceMatcher : public MyersSequenceMatcher<T> {
 public:
+    using junk_function_type = typename MyersSequenceMatcher<T>::junk_function_type;
 
-    InlineMyersSequenceMatcher(std::string a, std::string b, junk_function_type isjunk);
+    AnchoredSequenceMatcher(const T& a, const T& b, junk_function_type isjunk = nullptr);
 
-    std::pair<std::string, std::vector<int>> index_matching_kmers(std::string a, std::string b);
+    virtual void initialise();
+
+protected:
+    /*!
+     * Return sorted, non-overlapping matches inside a[a_lo:a_hi] and
+     * b[b_lo:b_hi] to split that region at, or nothing to fall back to
+     * Myers for it.
+     */
+    virtual difflib::match_list_t find_anchors(int a_lo, int a_hi, int b_lo, int b_hi) = 0;
+};
+
+/*!
+ * Patience diff, as described by Bram Cohen
+ *
+ * Anchors on lines that occur exactly once in both regions, keeping the
+ * longest increasing subsequence of them.
+ */
+template <class T = std::string>
+class PatienceSequenceMatcher : public AnchoredSequenceMatcher<T> {
+public:
+    using junk_function_type = typename AnchoredSequenceMatcher<T>::junk_function_type;
+
+    PatienceSequenceMatcher(const T& a, const T& b, junk_function_type isjunk = nullptr);
+
+protected:
+    virtual difflib::match_list_t find_anchors(int a_lo, int a_hi, int b_lo, int b_hi);
+};
+
+/*!
+ * Histogram diff, as found in JGit and git
+ *
+ * An extension of patience diff that anchors on the common run whose
+ * rarest line occurs least often in a, so that it also copes with
+ * regions that have no unique lines.
+ */
+template <class T = std::string>
+class HistogramSequenceMatcher : public AnchoredSequenceMatcher<T> {
+public:
+    using junk_function_type = typename AnchoredSequenceMatcher<T>::junk_function_type;
+
+    /*! Lines occurring more often than this in a are never anchors */
+    static const size_t max_chain_length = 64;
+
+    HistogramSequenceMatcher(const T& a, const T& b, junk_function_type isjunk = nullptr);
+
+protected:
+    virtual difflib::match_list_t find_anchors(int a_lo, int a_hi, int b_lo, int b_hi);
+};
+
+/*!
+ * Create a matcher for the named algorithm
+ *
+ * algorithm is one of "myers", "patience" or "histogram", as in the
+ * diff-algorithm setting; anything else gives Myers.
+ */
+template <class T>
+std::unique_ptr<MyersSequenceMatcher<T>> make_matcher(const std::string& algorithm, const T& a, const T& b);
+
+class InlineMyersSequenceMatcher : public MyersSequenceMatcher<std::string> {
+public:
+
+    InlineMyersSequenceMatcher(const std::string& a, const std::string& b, junk_function_type isjunk);
+
+    std::pair<std::string, std::vector<int>> index_matching_kmers(const std::string& a, const std::string& b);
 
     virtual std::pair<std::string, std::string> preprocess_discard_nonmatching_lines(std::string a, std::string b);
 };
 
-class SyncPointMyersSequenceMatcher : public MyersSequenceMatcher {
+/*!
+ * Character matcher for short strings, using bit-parallel LCS
+ *
+ * Each column of the LCS table for a is kept as a bit vector of up to
+ * max_length bits (Allison and Dix, 1986; Hyyrö, 2004), and is computed
+ * from the previous one with a handful of word operations per character
+ * of b. Any table entry is then a popcount away, which is all the
+ * traceback needs. This beats the k-mer indexing and snake building of
+ * InlineMyersSequenceMatcher when both sides are this short, which is
+ * the case for most inline highlighting.
+ */
+class BitParallelSequenceMatcher : public MyersSequenceMatcher<std::string> {
+public:
+    /*! Longest a or b that this matcher accepts */
+    static const size_t max_length = 128;
+
+    BitParallelSequenceMatcher(const std::string& a, const std::string& b, junk_function_type isjunk = nullptr);
+
+    /*! Whether both a and b are short enough for this matcher */
+    static bool fits(const std::string& a, const std::string& b);
+
+    virtual void initialise();
+};
+
+/*!
+ * Myers matcher that diffs regions between sync points separately
+ *
+ * With user sync points, opcodes never cross them. Without any, inputs
+ * of at least auto_split_threshold() lines in total are cut at lines
+ * unique to both sides, and the regions are diffed concurrently on up
+ * to max_workers() threads and stitched back together.
+ */
+template <class T = std::string>
+class SyncPointMyersSequenceMatcher : public MyersSequenceMatcher<T> {
+public:
+    using junk_function_type = typename MyersSequenceMatcher<T>::junk_function_type;
 private:
     std::vector<std::pair<int, int>>* syncpoints;
-    std::vector<difflib::match_list_t> split_matching_blocks;
+    /*! Each sync point region's blocks, terminated by its own sentinel */
+    difflib::match_list_t split_matching_blocks;
+    size_t auto_split_threshold_;
+    unsigned int max_workers_;
+    size_t region_count_;
+
+    /*! Cut points at unique lines, spaced for max_workers_ regions */
+    std::vector<std::pair<int, int>> find_split_points();
 public:
 
-    SyncPointMyersSequenceMatcher(std::string a, std::string b, junk_function_type isjunk = nullptr, std::vector<std::pair<int, int>> *syncpoints = nullptr);
+    SyncPointMyersSequenceMatcher(const T& a, const T& b, junk_function_type isjunk = nullptr, std::vector<std::pair<int, int>> *syncpoints = nullptr);
 
     virtual void initialise();
 
-    virtual difflib::chunk_list_t get_opcodes();
+    size_t auto_split_threshold() const {
+        return this->auto_split_threshold_;
+    }
+
+    void set_auto_split_threshold(size_t threshold) {
+        this->auto_split_threshold_ = threshold;
+    }
+
+    unsigned int max_workers() const {
+        return this->max_workers_;
+    }
+
+    /*! Worker threads for region diffs; 1 diffs them in this thread */
+    void set_max_workers(unsigned int workers) {
+        this->max_workers_ = std::max(1u, workers);
+    }
+
+    /*! Number of regions diffed separately by the last run */
+    size_t region_count() const {
+        return this->region_count_;
+    }
+
+protected:
+    virtual const difflib::match_list_t& opcode_blocks();
 };
 
+extern template class MyersSequenceMatcher<std::string>;
+extern template class MyersSequenceMatcher<line_ids_t>;
+extern template class SyncPointMyersSequenceMatcher<std::string>;
+extern template class SyncPointMyersSequenceMatcher<line_ids_t>;
+extern template class PatienceSequenceMatcher<std::string>;
+extern template class PatienceSequenceMatcher<line_ids_t>;
+extern template class HistogramSequenceMatcher<std::string>;
+extern template class HistogramSequenceMatcher<line_ids_t>;
+extern template std::unique_ptr<MyersSequenceMatcher<std::string>> make_matcher(const std::string&, const std::string&, const std::string&);
+extern template std::unique_ptr<MyersSequenceMatcher<line_ids_t>> make_matcher(const std::string&, const line_ids_t&, const line_ids_t&);
+
 
 #endif
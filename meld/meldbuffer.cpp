@@ -28,6 +28,42 @@ MeldBuffer::MeldBuffer(std::string filename) : Gsv::Buffer() {
     bind_settings(this, __gsettings_bindings__);
     this->data = new MeldBufferData(filename);
     this->user_action_count = 0;
+    // A Gtk.TextBuffer always has at least one, possibly empty, line
+    this->_snapshot = TextSnapshot(std::vector<std::string>(1));
+}
+
+std::vector<std::string> MeldBuffer::_line_texts(int lo, int hi) {
+    std::vector<std::string> lines;
+    for (int line = lo; line < hi; line++) {
+        Gtk::TextBuffer::iterator line_start = this->get_iter_at_line(line);
+        Gtk::TextBuffer::iterator line_end = line_start;
+        if (not line_end.ends_line()) {
+            line_end.forward_to_line_end();
+        }
+        lines.push_back(this->get_text(line_start, line_end, false).raw());
+    }
+    return lines;
+}
+
+void MeldBuffer::on_insert(const iterator& pos, const Glib::ustring& text, int bytes) {
+    int line = pos.get_line();
+    int line_count = this->get_line_count();
+    Gsv::Buffer::on_insert(pos, text, bytes);
+    // The line inserted into becomes itself plus any new lines
+    int lines_added = this->get_line_count() - line_count;
+    this->_snapshot = this->_snapshot.replace(line, line + 1, this->_line_texts(line, line + lines_added + 1));
+}
+
+void MeldBuffer::on_erase(const iterator& range_begin, const iterator& range_end) {
+    int lo = range_begin.get_line();
+    int hi = range_end.get_line();
+    Gsv::Buffer::on_erase(range_begin, range_end);
+    // The lines the range touched are joined into one
+    this->_snapshot = this->_snapshot.replace(lo, hi + 1, this->_line_texts(lo, lo + 1));
+}
+
+TextSnapshot MeldBuffer::snapshot() const {
+    return this->_snapshot;
 }
 
 void MeldBuffer::do_begin_user_action(int *args) {
@@ -23,6 +23,7 @@
 #include <gtksourceviewmm.h>
 #include <functional>
 
+#include "textsnapshot.h"
 #include "undo.h"
 
 class MeldBufferData;
@@ -37,11 +38,31 @@ class MeldBuffer : public Gsv::Buffer {
 
     int user_action_count;
 
+    /*! The buffer's lines, brought up to date by every edit */
+    TextSnapshot _snapshot;
+
+    /*! Text of lines lo to hi, without their line breaks */
+    std::vector<std::string> _line_texts(int lo, int hi);
+
+protected:
+    virtual void on_insert(const iterator& pos, const Glib::ustring& text, int bytes);
+
+    virtual void on_erase(const iterator& range_begin, const iterator& range_end);
+
 public:
     std::vector<sigc::connection> handlers;
     MeldBufferData* data;
     MeldBuffer(std::string filename = "");
 
+    /*!
+     * The lines of the buffer as they are now
+     *
+     * Taking a snapshot is O(1): the buffer's copy is updated in place
+     * of the lines each edit touches, sharing the rest. The result never
+     * changes, so diffs can be worked out from it while the user types.
+     */
+    TextSnapshot snapshot() const;
+
     void do_begin_user_action(int *args);
 
     void do_end_user_action(int *args);
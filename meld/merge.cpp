@@ -28,47 +28,35 @@ AutoMergeDiffer::AutoMergeDiffer() : _Differ() {
 AutoMergeDiffer::~AutoMergeDiffer() {
 }
 
-std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> AutoMergeDiffer::_auto_merge(std::array<difflib::chunk_list_t, 2> _using, std::vector<std::string> texts) {
-    std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> result;
-    for (std::pair<difflib::chunk_t, difflib::chunk_t> p : _Differ::_auto_merge(_using, texts)) {
-        difflib::chunk_t out0 = p.first;
-        difflib::chunk_t out1 = p.second;
-        if (this->auto_merge and std::get<0>(out0) == "conflict") {
-            // we will try to resolve more complex conflicts automatically here... if possible
-            int l0 = std::get<3>(out0);
-            int h0 = std::get<4>(out0);
-            int l1 = std::get<1>(out0);
-            int h1 = std::get<2>(out0);
-            int l2 = std::get<3>(out1);
-            int h2 = std::get<4>(out1);
-            int len0 = h0 - l0;
-            int len1 = h1 - l1;
-            int len2 = h2 - l2;
-            if ((len0 > 0 and len2 > 0) and (len0 == len1 or len2 == len1 or len1 == 0)) {
-                MyersSequenceMatcher matcher(texts[0].substr(l0, h0), texts[2].substr(l2, h2), nullptr);
-#if 0
-                for (difflib::chunk_t chunk : matcher.get_opcodes()) {
-                    int s1 = l1;
-                    int e1 = l1;
-                    if (len0 == len1) {
-                        s1 += std::get<1>(chunk);
-                        e1 += std::get<2>(chunk);
-                    } else if (len2 == len1) {
-                        s1 += std::get<3>(chunk);
-                        e1 += std::get<4>(chunk);
-                    }
-                    if (std::get<0>(chunk) == "equal") {
-                        out0 = difflib::chunk_t("replace", s1, e1, l0 + std::get<1>(chunk), l0 + std::get<2>(chunk));
-                        out1 = difflib::chunk_t("replace", s1, e1, l2 + std::get<3>(chunk), l2 + std::get<4>(chunk));
-                        result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
-                    } else {
-                        out0 = difflib::chunk_t("conflict", s1, e1, l0 + std::get<1>(chunk), l0 + std::get<2>(chunk));
-                        out1 = difflib::chunk_t("conflict", s1, e1, l2 + std::get<3>(chunk), l2 + std::get<4>(chunk));
-                        result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
-                    }
-                }
-#endif
-                return result;
+void AutoMergeDiffer::_auto_merge(const std::array<ChunkSpan, 2>& _using, const std::vector<TextSnapshot>& texts,
+                                  std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>>& result) {
+    _Differ::_auto_merge(_using, texts, result);
+    difflib::chunk_t out0 = result.back().first;
+    difflib::chunk_t out1 = result.back().second;
+    if (this->auto_merge and out0.tag == difflib::Tag::conflict) {
+        // we will try to resolve more complex conflicts automatically here... if possible
+        int l0 = out0.j1;
+        int h0 = out0.j2;
+        int l1 = out0.i1;
+        int h1 = out0.i2;
+        int l2 = out1.j1;
+        int h2 = out1.j2;
+        int len0 = h0 - l0;
+        int len1 = h1 - l1;
+        int len2 = h2 - l2;
+        if ((len0 > 0 and len2 > 0) and (len0 == len1 or len2 == len1 or len1 == 0)) {
+            result.pop_back();
+            // The lines only need IDs for this one comparison, so they
+            // stay out of the differ's table, and blank lines are kept so
+            // that the IDs line up with the text
+            LineInterner interner;
+            interner.set_normalisation(this->normalisation & ~NORMALISE_SKIP_BLANK);
+            line_ids_t lines0 = interner.intern_lines(texts[0].lines(l0, h0), l0);
+            line_ids_t lines2 = interner.intern_lines(texts[2].lines(l2, h2), l2);
+            for (const std::pair<difflib::chunk_t, difflib::chunk_t>& entry : split_conflict(lines0, lines2, l0, l2, l1, h1, this->time_limit)) {
+                result.push_back(entry);
+            }
+            return;
 //                elif len0 > 0 and len2 > 0:
                 // this logic will resolve more conflicts automatically, but unresolved conflicts may sometimes look confusing
                 // as the line numbers in ancestor file will be interpolated and may not reflect the actual changes
@@ -89,91 +77,86 @@ std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> AutoMergeDiffer::_aut
 //                            out1 = ("conflict", l1 + len1 * chunk[maxindex] / maxlen, l1 + len1 * chunk[maxindex + 1] / maxlen, l2 + chunk[3], l2 + chunk[4])
 //                            yield out0, out1
 //                    return
-            } else {
-                // some tricks to resolve even more conflicts automatically
-                // unfortunately the resulting chunks cannot be used to highlight changes
-                // but hey, they are good enough to merge the resulting file :)
-                std::string chunktype = std::get<0>(_using[0][0]);
-                for (difflib::chunk_list_t chunkarr : _using) {
-                    for (difflib::chunk_t chunk : chunkarr) {
-                        if (std::get<0>(chunk) != chunktype) {
-                            chunktype = "";
-                            break;
-                        }
-                    }
-                    if (chunktype.empty()) {
+        } else {
+            // some tricks to resolve even more conflicts automatically
+            // unfortunately the resulting chunks cannot be used to highlight changes
+            // but hey, they are good enough to merge the resulting file :)
+            difflib::Tag chunktype = _using[0].front().tag;
+            for (const ChunkSpan& chunkarr : _using) {
+                for (const difflib::chunk_t& chunk : chunkarr) {
+                    if (chunk.tag != chunktype) {
+                        chunktype = difflib::Tag::none;
                         break;
                     }
                 }
-                if (chunktype == "delete") {
-                    // delete + delete (any length) -> split into delete/conflict
-                    difflib::chunk_t* seq0 = nullptr;
-                    difflib::chunk_t* seq1 = nullptr;
-                    int i0 = 0;
-                    int i1 = 0;
-                    int end0 = 0;
-                    int end1 = 0;
-                    while (true) {
-                        if (!seq0) {
-                            if (_using[0].empty()) {
-                                break;
-                            }
-#if 0
-                            seq0 = _using[0].pop(0);
-#endif
-                            i0 = std::get<1>(*seq0);
-                            end0 = std::get<4>(*seq0);
-                        }
-                        if (!seq1) {
-                            if (_using[1].empty()) {
-                                break;
-                            }
-#if 0
-                            seq1 = _using[1].pop(0);
-#endif
-                            i1 = std::get<1>(*seq1);
-                            end1 = std::get<4>(*seq1);
-                        }
-                        int highstart = std::max(i0, i1);
-                        if (i0 != i1) {
-                            out0 = difflib::chunk_t("conflict", i0 - highstart + i1, highstart, std::get<3>(*seq0) - highstart + i1, std::get<3>(*seq0));
-                            out1 = difflib::chunk_t("conflict", i1 - highstart + i0, highstart, std::get<3>(*seq1) - highstart + i0, std::get<3>(*seq1));
-                            result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
-                        }
-                        int lowend = std::min(std::get<2>(*seq0), std::get<2>(*seq1));
-                        if (highstart != lowend) {
-                            out0 = difflib::chunk_t("delete", highstart, lowend, std::get<3>(*seq0), std::get<4>(*seq0));
-                            out1 = difflib::chunk_t("delete", highstart, lowend, std::get<3>(*seq1), std::get<4>(*seq1));
-                            result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
-                        }
-                        i0 = i1 = lowend;
-                        if (lowend == std::get<2>(*seq0)) {
-                            seq0 = nullptr;
+                if (chunktype == difflib::Tag::none) {
+                    break;
+                }
+            }
+            if (chunktype == difflib::Tag::delete_) {
+                // delete + delete (any length) -> split into delete/conflict
+                result.pop_back();
+                const difflib::chunk_t* seq0 = nullptr;
+                const difflib::chunk_t* seq1 = nullptr;
+                size_t n0 = 0;
+                size_t n1 = 0;
+                int i0 = 0;
+                int i1 = 0;
+                int end0 = 0;
+                int end1 = 0;
+                while (true) {
+                    if (!seq0) {
+                        if (n0 == _using[0].size()) {
+                            break;
                         }
-                        if (lowend == std::get<2>(*seq1)) {
-                            seq1 = nullptr;
+                        seq0 = &_using[0][n0++];
+                        i0 = seq0->i1;
+                        end0 = seq0->j2;
+                    }
+                    if (!seq1) {
+                        if (n1 == _using[1].size()) {
+                            break;
                         }
+                        seq1 = &_using[1][n1++];
+                        i1 = seq1->i1;
+                        end1 = seq1->j2;
                     }
-
-                    if (seq0) {
-                        out0 = difflib::chunk_t("conflict", i0, std::get<2>(*seq0), std::get<3>(*seq0), std::get<4>(*seq0));
-                        out1 = difflib::chunk_t("conflict", i0, std::get<2>(*seq0), end1, end1 + std::get<2>(*seq0) - i0);
+                    int highstart = std::max(i0, i1);
+                    if (i0 != i1) {
+                        out0 = difflib::chunk_t(difflib::Tag::conflict, i0 - highstart + i1, highstart, seq0->j1 - highstart + i1, seq0->j1);
+                        out1 = difflib::chunk_t(difflib::Tag::conflict, i1 - highstart + i0, highstart, seq1->j1 - highstart + i0, seq1->j1);
                         result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
-                    } else if (seq1) {
-                        out0 = difflib::chunk_t("conflict", i1, std::get<2>(*seq1), end0, end0 + std::get<2>(*seq1) - i1);
-                        out1 = difflib::chunk_t("conflict", i1, std::get<2>(*seq1), std::get<3>(*seq1), std::get<4>(*seq1));
+                    }
+                    int lowend = std::min(seq0->i2, seq1->i2);
+                    if (highstart != lowend) {
+                        out0 = difflib::chunk_t(difflib::Tag::delete_, highstart, lowend, seq0->j1, seq0->j2);
+                        out1 = difflib::chunk_t(difflib::Tag::delete_, highstart, lowend, seq1->j1, seq1->j2);
                         result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
                     }
-                    return result;
+                    i0 = i1 = lowend;
+                    if (lowend == seq0->i2) {
+                        seq0 = nullptr;
+                    }
+                    if (lowend == seq1->i2) {
+                        seq1 = nullptr;
+                    }
+                }
+
+                if (seq0) {
+                    out0 = difflib::chunk_t(difflib::Tag::conflict, i0, seq0->i2, seq0->j1, seq0->j2);
+                    out1 = difflib::chunk_t(difflib::Tag::conflict, i0, seq0->i2, end1, end1 + seq0->i2 - i0);
+                    result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
+                } else if (seq1) {
+                    out0 = difflib::chunk_t(difflib::Tag::conflict, i1, seq1->i2, end0, end0 + seq1->i2 - i1);
+                    out1 = difflib::chunk_t(difflib::Tag::conflict, i1, seq1->i2, seq1->j1, seq1->j2);
+                    result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
                 }
             }
         }
-        result.push_back(std::pair<difflib::chunk_t, difflib::chunk_t>(out0, out1));
     }
-    return result;
 }
 
-void AutoMergeDiffer::change_sequence(int sequence, int startidx, int sizechange, std::vector<std::string> texts) {
+void AutoMergeDiffer::change_sequence(int sequence, int startidx, int sizechange, const std::vector<TextSnapshot>& texts) {
     if (sequence == 1) {
         int lo = 0;
         for (int c : this->unresolved) {
@@ -231,27 +214,23 @@ void Merger::initialize(std::vector<BufferLines*> sequences, std::vector<BufferL
 }
 
 int Merger::_apply_change(BufferLines* text, difflib::chunk_t change, std::vector<Glib::ustring>& mergedtext) {
-    const int LO = 1;
-    const int HI = 2;
-    if (std::get<0>(change) == "insert") {
-        for (int i = std::get<LO + 2>(change); i < std::get<HI + 2>(change); i++) {
+    if (change.tag == difflib::Tag::insert) {
+        for (int i = change.j1; i < change.j2; i++) {
             mergedtext.push_back((*text)[i]);
         }
         return 0;
-    } else if (std::get<0>(change) == "replace") {
-        for (int i = std::get<LO + 2>(change); i < std::get<HI + 2>(change); i++) {
+    } else if (change.tag == difflib::Tag::replace) {
+        for (int i = change.j1; i < change.j2; i++) {
             mergedtext.push_back((*text)[i]);
         }
-        return std::get<HI>(change) - std::get<LO>(change);
+        return change.i2 - change.i1;
     } else {
-        return std::get<HI>(change) - std::get<LO>(change);
+        return change.i2 - change.i1;
     }
 }
 
 Glib::ustring Merger::merge_3_files(bool mark_conflicts) {
 
-    const int LO = 1;
-    const int HI = 2;
     this->unresolved.clear();
     int lastline = 0;
     int mergedline = 0;
@@ -259,11 +238,11 @@ Glib::ustring Merger::merge_3_files(bool mark_conflicts) {
     for (std::pair<difflib::chunk_t, difflib::chunk_t> change : this->differ->all_changes()) {
         int low_mark = lastline;
         if (change.first != difflib::EMPTY_CHUNK) {
-            low_mark = std::get<LO>(change.first);
+            low_mark = change.first.i1;
         }
         if (change.second != difflib::EMPTY_CHUNK) {
-            if (std::get<LO>(change.second) > low_mark) {
-                low_mark = std::get<LO>(change.second);
+            if (change.second.i1 > low_mark) {
+                low_mark = change.second.i1;
             }
         }
         for (int i = lastline; i < low_mark; i++) {
@@ -271,8 +250,8 @@ Glib::ustring Merger::merge_3_files(bool mark_conflicts) {
         }
         mergedline += low_mark - lastline;
         lastline = low_mark;
-        if (change.first != difflib::EMPTY_CHUNK and change.second != difflib::EMPTY_CHUNK and std::get<0>(change.first) == "conflict") {
-            int high_mark = std::max(std::get<HI>(change.first), std::get<HI>(change.second));
+        if (change.first != difflib::EMPTY_CHUNK and change.second != difflib::EMPTY_CHUNK and change.first.tag == difflib::Tag::conflict) {
+            int high_mark = std::max(change.first.i2, change.second.i2);
             if (mark_conflicts) {
                 if (low_mark < high_mark) {
                     for (int i = low_mark; i < high_mark; i++) {
@@ -293,12 +272,12 @@ Glib::ustring Merger::merge_3_files(bool mark_conflicts) {
 #if 0
             lastline += this->_apply_change(this->texts[0], change.first, mergedtext);
 #endif
-            mergedline += std::get<HI + 2>(change.first) - std::get<LO + 2>(change.first);
+            mergedline += change.first.j2 - change.first.j1;
         } else {
 #if 0
             lastline += this->_apply_change(this->texts[2], change.second, mergedtext);
 #endif
-            mergedline += std::get<HI + 2>(change.second) - std::get<LO + 2>(change.second);
+            mergedline += change.second.j2 - change.second.j1;
         }
     }
 #if 0
@@ -314,17 +293,15 @@ Glib::ustring Merger::merge_3_files(bool mark_conflicts) {
 }
 
 Glib::ustring Merger::merge_2_files(int fromindex, int toindex) {
-    const int LO = 1;
-    const int HI = 2;
     this->unresolved.clear();
     int lastline = 0;
     std::vector<std::string> mergedtext;
     for (difflib::chunk_t change : this->differ->pair_changes(toindex, fromindex)) {
         int low_mark;
-        if (std::get<0>(change) == "conflict") {
-            low_mark = std::get<HI>(change);
+        if (change.tag == difflib::Tag::conflict) {
+            low_mark = change.i2;
         } else {
-            low_mark = std::get<LO>(change);
+            low_mark = change.i1;
         }
         for (int i = lastline; i < low_mark; i++) {
 #if 0
@@ -332,7 +309,7 @@ Glib::ustring Merger::merge_2_files(int fromindex, int toindex) {
 #endif
         }
         lastline = low_mark;
-        if (std::get<0>(change) != "conflict") {
+        if (change.tag != difflib::Tag::conflict) {
 #if 0
             lastline += this->_apply_change(this->texts[fromindex], change, mergedtext);
 #endif
@@ -33,9 +33,10 @@ public:
     AutoMergeDiffer();
     virtual ~AutoMergeDiffer();
 
-    virtual std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>> _auto_merge(std::array<difflib::chunk_list_t, 2> _using, std::vector<std::string> texts);
+    virtual void _auto_merge(const std::array<ChunkSpan, 2>& _using, const std::vector<TextSnapshot>& texts,
+                             std::vector<std::pair<difflib::chunk_t, difflib::chunk_t>>& result);
 
-    virtual void change_sequence(int sequence, int startidx, int sizechange, std::vector<std::string> texts);
+    virtual void change_sequence(int sequence, int startidx, int sizechange, const std::vector<TextSnapshot>& texts);
 
     int get_unresolved_count();
 };
@@ -0,0 +1,286 @@
+/* Copyright (C) 2002-2006 Stephen Kennedy <stevek@gnome.org>
+ * Copyright (C) 2009, 2012-2013 Kai Willadsen <kai.willadsen@gmail.com>
+ * Copyright (C) 2014 Christoph Brill <egore911@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+#include "textsnapshot.h"
+
+/*! Most lines kept in one leaf; edits copy at most this many */
+static const size_t MAX_LEAF_LINES = 64;
+
+/*!
+ * A leaf, holding lines, or a branch over two subtrees
+ *
+ * Trees are kept AVL balanced: the heights of the two sides of a branch
+ * differ by at most one.
+ */
+struct TextSnapshot::Node {
+    node_ptr left;
+    node_ptr right;
+    std::vector<std::string> lines;
+    size_t count;
+    int height;
+
+    explicit Node(std::vector<std::string> lines) : lines(std::move(lines)), height(0) {
+        this->count = this->lines.size();
+    }
+
+    Node(node_ptr left, node_ptr right) : left(std::move(left)), right(std::move(right)) {
+        this->count = this->left->count + this->right->count;
+        this->height = std::max(this->left->height, this->right->height) + 1;
+    }
+
+    bool is_leaf() const {
+        return not this->left;
+    }
+};
+
+typedef TextSnapshot::node_ptr node_ptr;
+
+static int height(const node_ptr& node) {
+    return node ? node->height : -1;
+}
+
+static size_t count(const node_ptr& node) {
+    return node ? node->count : 0;
+}
+
+static node_ptr make_leaf(std::vector<std::string> lines) {
+    if (lines.empty()) {
+        return node_ptr();
+    }
+    return std::make_shared<const TextSnapshot::Node>(std::move(lines));
+}
+
+static node_ptr make_branch(const node_ptr& left, const node_ptr& right) {
+    return std::make_shared<const TextSnapshot::Node>(left, right);
+}
+
+/*! A branch over left and right, which may differ in height by two */
+static node_ptr balance(const node_ptr& left, const node_ptr& right) {
+    if (height(left) > height(right) + 1) {
+        if (height(left->left) >= height(left->right)) {
+            return make_branch(left->left, make_branch(left->right, right));
+        }
+        return make_branch(make_branch(left->left, left->right->left),
+                           make_branch(left->right->right, right));
+    }
+    if (height(right) > height(left) + 1) {
+        if (height(right->right) >= height(right->left)) {
+            return make_branch(make_branch(left, right->left), right->right);
+        }
+        return make_branch(make_branch(left, right->left->left),
+                           make_branch(right->left->right, right->right));
+    }
+    return make_branch(left, right);
+}
+
+/*!
+ * All the lines of left followed by all of right
+ *
+ * Descends the side of the taller tree to where the other fits, in
+ * O(difference in height). A small leaf is taken all the way down to
+ * the leaf it meets, and merged with it if they fit in one, so that
+ * single line edits don't leave the tree in ever smaller pieces.
+ */
+static node_ptr join(const node_ptr& left, const node_ptr& right) {
+    if (not left) {
+        return right;
+    }
+    if (not right) {
+        return left;
+    }
+    if (left->is_leaf() and right->is_leaf()) {
+        if (left->count + right->count <= MAX_LEAF_LINES) {
+            std::vector<std::string> lines(left->lines);
+            lines.insert(lines.end(), right->lines.begin(), right->lines.end());
+            return make_leaf(std::move(lines));
+        }
+        return make_branch(left, right);
+    }
+    bool small_right = right->is_leaf() and right->count < MAX_LEAF_LINES;
+    bool small_left = left->is_leaf() and left->count < MAX_LEAF_LINES;
+    if (height(left) > height(right) + 1 or (small_right and not left->is_leaf())) {
+        return balance(left->left, join(left->right, right));
+    }
+    if (height(right) > height(left) + 1 or (small_left and not right->is_leaf())) {
+        return balance(join(left, right->left), right->right);
+    }
+    return make_branch(left, right);
+}
+
+/*! A balanced tree over lines lo to hi, in leaves that are at least half full */
+static node_ptr build(const std::vector<std::string>& lines, size_t lo, size_t hi) {
+    if (hi - lo <= MAX_LEAF_LINES) {
+        return make_leaf(std::vector<std::string>(lines.begin() + lo, lines.begin() + hi));
+    }
+    size_t leaves = (hi - lo + MAX_LEAF_LINES - 1) / MAX_LEAF_LINES;
+    size_t mid = lo + (leaves / 2) * (hi - lo) / leaves;
+    return make_branch(build(lines, lo, mid), build(lines, mid, hi));
+}
+
+/*! The first at lines of node, and the rest */
+static std::pair<node_ptr, node_ptr> split(const node_ptr& node, size_t at) {
+    if (not node or at == 0) {
+        return std::pair<node_ptr, node_ptr>(node_ptr(), node);
+    }
+    if (at >= node->count) {
+        return std::pair<node_ptr, node_ptr>(node, node_ptr());
+    }
+    if (node->is_leaf()) {
+        return std::pair<node_ptr, node_ptr>(
+            make_leaf(std::vector<std::string>(node->lines.begin(), node->lines.begin() + at)),
+            make_leaf(std::vector<std::string>(node->lines.begin() + at, node->lines.end())));
+    }
+    size_t left_count = node->left->count;
+    if (at < left_count) {
+        std::pair<node_ptr, node_ptr> parts = split(node->left, at);
+        return std::pair<node_ptr, node_ptr>(parts.first, join(parts.second, node->right));
+    }
+    if (at == left_count) {
+        return std::pair<node_ptr, node_ptr>(node->left, node->right);
+    }
+    std::pair<node_ptr, node_ptr> parts = split(node->right, at - left_count);
+    return std::pair<node_ptr, node_ptr>(join(node->left, parts.first), parts.second);
+}
+
+/*!
+ * node with lines lo to hi replaced
+ *
+ * An edit within one leaf, as almost all typing is, copies just that
+ * leaf and the path to it. Anything wider is cut out and joined up.
+ */
+static node_ptr replace_lines(const node_ptr& node, size_t lo, size_t hi, const std::vector<std::string>& lines) {
+    if (not node) {
+        return build(lines, 0, lines.size());
+    }
+    if (node->is_leaf()) {
+        std::vector<std::string> result(node->lines.begin(), node->lines.begin() + lo);
+        result.insert(result.end(), lines.begin(), lines.end());
+        result.insert(result.end(), node->lines.begin() + hi, node->lines.end());
+        return build(result, 0, result.size());
+    }
+    size_t left_count = node->left->count;
+    if (hi <= left_count) {
+        return join(replace_lines(node->left, lo, hi, lines), node->right);
+    }
+    if (lo >= left_count) {
+        return join(node->left, replace_lines(node->right, lo - left_count, hi - left_count, lines));
+    }
+    std::pair<node_ptr, node_ptr> head = split(node, lo);
+    std::pair<node_ptr, node_ptr> tail = split(head.second, hi - lo);
+    return join(join(head.first, build(lines, 0, lines.size())), tail.second);
+}
+
+static void collect_lines(const node_ptr& node, size_t lo, size_t hi, std::vector<text_view>& out) {
+    if (not node or lo >= hi) {
+        return;
+    }
+    if (node->is_leaf()) {
+        for (size_t i = lo; i < hi; i++) {
+            out.push_back(node->lines[i]);
+        }
+        return;
+    }
+    size_t left_count = node->left->count;
+    if (lo < left_count) {
+        collect_lines(node->left, lo, std::min(hi, left_count), out);
+    }
+    if (hi > left_count) {
+        collect_lines(node->right, std::max(lo, left_count) - left_count, hi - left_count, out);
+    }
+}
+
+static void collect_leaves(const node_ptr& node, std::vector<const TextSnapshot::Node*>& out) {
+    if (not node) {
+        return;
+    }
+    if (node->is_leaf()) {
+        out.push_back(node.get());
+        return;
+    }
+    collect_leaves(node->left, out);
+    collect_leaves(node->right, out);
+}
+
+TextSnapshot::TextSnapshot() {}
+
+TextSnapshot::TextSnapshot(node_ptr root) : root(std::move(root)) {}
+
+TextSnapshot::TextSnapshot(const std::vector<std::string>& lines) : root(build(lines, 0, lines.size())) {}
+
+TextSnapshot TextSnapshot::from_text(text_view text) {
+    std::vector<std::string> lines;
+    for (text_view line : line_views(text, 0, std::numeric_limits<size_t>::max())) {
+        lines.push_back(std::string(line.data(), line.size()));
+    }
+    return TextSnapshot(lines);
+}
+
+size_t TextSnapshot::size() const {
+    return count(this->root);
+}
+
+bool TextSnapshot::empty() const {
+    return not this->root;
+}
+
+text_view TextSnapshot::operator[](size_t line) const {
+    assert(line < this->size());
+    const Node* node = this->root.get();
+    while (not node->is_leaf()) {
+        if (line < node->left->count) {
+            node = node->left.get();
+        } else {
+            line -= node->left->count;
+            node = node->right.get();
+        }
+    }
+    return node->lines[line];
+}
+
+std::vector<text_view> TextSnapshot::lines(size_t lo, size_t hi) const {
+    std::vector<text_view> result;
+    hi = std::min(hi, this->size());
+    if (lo < hi) {
+        result.reserve(hi - lo);
+        collect_lines(this->root, lo, hi, result);
+    }
+    return result;
+}
+
+TextSnapshot TextSnapshot::replace(size_t lo, size_t hi, const std::vector<std::string>& lines) const {
+    assert(lo <= hi and hi <= this->size());
+    return TextSnapshot(replace_lines(this->root, lo, hi, lines));
+}
+
+size_t TextSnapshot::shared_leaves(const TextSnapshot& other) const {
+    std::vector<const Node*> ours;
+    std::vector<const Node*> theirs;
+    collect_leaves(this->root, ours);
+    collect_leaves(other.root, theirs);
+    std::unordered_set<const Node*> seen(ours.begin(), ours.end());
+    size_t shared = 0;
+    for (const Node* leaf : theirs) {
+        shared += seen.count(leaf);
+    }
+    return shared;
+}
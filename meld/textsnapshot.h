@@ -0,0 +1,76 @@
+/* Copyright (C) 2002-2006 Stephen Kennedy <stevek@gnome.org>
+ * Copyright (C) 2009, 2012-2013 Kai Willadsen <kai.willadsen@gmail.com>
+ * Copyright (C) 2014 Christoph Brill <egore911@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MELD__TEXTSNAPSHOT_H__
+#define __MELD__TEXTSNAPSHOT_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "matchers.h"
+
+/*!
+ * An immutable version of the lines of a text
+ *
+ * Lines live in the leaves of a balanced tree whose nodes are never
+ * changed once built. replace() copies only the leaf it edits and the
+ * path to it, and shares every other node with the snapshot it started
+ * from, so taking a snapshot after each edit costs O(log n) rather than
+ * a copy of the text.
+ *
+ * A snapshot is a reference-counted handle: copies are cheap, stay the
+ * same however the text changes afterwards, and may be read from any
+ * thread. Views it hands out are valid for as long as any copy lives.
+ */
+class TextSnapshot {
+public:
+    /*! A node of the tree, see textsnapshot.cpp */
+    struct Node;
+    typedef std::shared_ptr<const Node> node_ptr;
+
+private:
+    node_ptr root;
+
+    explicit TextSnapshot(node_ptr root);
+
+public:
+    /*! A text with no lines at all */
+    TextSnapshot();
+    explicit TextSnapshot(const std::vector<std::string>& lines);
+
+    /*! The lines of a whole text, split as line_views() does */
+    static TextSnapshot from_text(text_view text);
+
+    size_t size() const;
+
+    bool empty() const;
+
+    /*! A line, without its line break, in O(log n) */
+    text_view operator[](size_t line) const;
+
+    /*! Lines lo to hi, clamped to the end of the text */
+    std::vector<text_view> lines(size_t lo, size_t hi) const;
+
+    /*! This text with lines lo to hi replaced; this snapshot is left as it is */
+    TextSnapshot replace(size_t lo, size_t hi, const std::vector<std::string>& lines) const;
+
+    /*! Number of leaves of lines this snapshot has in common with other */
+    size_t shared_leaves(const TextSnapshot& other) const;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/* Copyright (C) 2014 Christoph Brill <egore911@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MELD__UTIL__BITS_H__
+#define __MELD__UTIL__BITS_H__
+
+#include <cstdint>
+
+/* Bit scans, with the compiler's builtins where there are any. mask
+ * must not be 0. */
+
+static inline unsigned int lowest_bit(unsigned int mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    unsigned int bit = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        bit += 1;
+    }
+    return bit;
+#endif
+}
+
+static inline unsigned int highest_bit(unsigned int mask) {
+#if defined(__GNUC__)
+    return 31 - __builtin_clz(mask);
+#else
+    unsigned int bit = 31;
+    while (!(mask & 0x80000000u)) {
+        mask <<= 1;
+        bit -= 1;
+    }
+    return bit;
+#endif
+}
+
+static inline unsigned int lowest_bit(uint64_t mask) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    unsigned int bit = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        bit += 1;
+    }
+    return bit;
+#endif
+}
+
+static inline unsigned int highest_bit(uint64_t mask) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(mask);
+#else
+    unsigned int bit = 63;
+    while (!(mask & (uint64_t(1) << 63))) {
+        mask <<= 1;
+        bit -= 1;
+    }
+    return bit;
+#endif
+}
+
+#endif
@@ -35,6 +35,29 @@ std::vector<std::string> split(const std::string &s, char delim) {
     return result;
 }
 
+std::vector<std::string> splitlines(const std::string &s, bool keepends) {
+    std::vector<std::string> result;
+    size_t start = 0;
+    size_t i = 0;
+    while (i < s.size()) {
+        if (s[i] != '\n' and s[i] != '\r') {
+            i++;
+            continue;
+        }
+        size_t eol = i;
+        if (s[i] == '\r' and i + 1 < s.size() and s[i + 1] == '\n') {
+            i++;
+        }
+        i++;
+        result.push_back(s.substr(start, (keepends ? i : eol) - start));
+        start = i;
+    }
+    if (start < s.size()) {
+        result.push_back(s.substr(start));
+    }
+    return result;
+}
+
 std::vector<std::string> os_listdir(std::string direcotry) {
     boost::filesystem::path someDir(direcotry);
     boost::filesystem::directory_iterator end_iter;
@@ -0,0 +1,338 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+#include "../meld/diffchunks.h"
+
+typedef difflib::chunk_t C;
+
+static C offset(const C& c, int o1, int o2) {
+    return C(c.tag, c.i1 + o1, c.i2 + o1, c.j1 + o2, c.j2 + o2);
+}
+
+TEST(DiffChunksTest, testShiftAndSplice) {
+    const difflib::Tag r = difflib::Tag::replace;
+    DiffChunks chunks({C(r, 0, 1, 0, 1), C(r, 5, 6, 5, 7), C(r, 10, 12, 11, 11)});
+    EXPECT_EQ(3, chunks.size());
+
+    chunks.shift(1, 2, -1);
+    EXPECT_EQ(C(r, 0, 1, 0, 1), chunks[0]);
+    EXPECT_EQ(C(r, 7, 8, 4, 6), chunks[1]);
+    EXPECT_EQ(C(r, 12, 14, 10, 10), chunks[2]);
+
+    // Same number of chunks, so nothing is folded
+    chunks.splice(1, 2, {C(r, 3, 4, 3, 4)});
+    EXPECT_EQ(C(r, 3, 4, 3, 4), chunks[1]);
+    EXPECT_EQ(C(r, 12, 14, 10, 10), chunks[2]);
+
+    chunks.splice(0, 2, {C(r, 2, 3, 2, 3)});
+    difflib::chunk_list_t expected = {C(r, 2, 3, 2, 3), C(r, 12, 14, 10, 10)};
+    EXPECT_EQ(expected, chunks.to_list());
+
+    EXPECT_EQ(0, chunks.locate(false, 0));
+    EXPECT_EQ(1, chunks.locate(false, 3));
+    EXPECT_EQ(1, chunks.locate(true, 9));
+    EXPECT_EQ(2, chunks.locate(true, 10));
+
+    chunks.clear();
+    EXPECT_TRUE(chunks.empty());
+    EXPECT_EQ(0, chunks.locate(false, 0));
+}
+
+TEST(DiffChunksTest, testRandomEdits) {
+    // Against a plain vector, offset eagerly as _change_sequence used to
+    srand(17);
+    for (int run = 0; run < 50; run++) {
+        difflib::chunk_list_t model;
+        for (int i = 0; i < 40; i++) {
+            model.push_back(C(difflib::Tag::replace, i * 10, i * 10 + 3, i * 10, i * 10 + 4));
+        }
+        DiffChunks chunks(model);
+        for (int edit = 0; edit < 100; edit++) {
+            size_t lo = rand() % (model.size() + 1);
+            size_t hi = lo + rand() % (model.size() - lo + 1);
+            int da = rand() % 7 - 3;
+            int db = rand() % 7 - 3;
+            for (size_t i = hi; i < model.size(); i++) {
+                model[i] = offset(model[i], da, db);
+            }
+            chunks.shift(hi, da, db);
+            difflib::chunk_list_t replacement;
+            size_t count = rand() % 2 ? hi - lo : rand() % 3;
+            for (size_t i = 0; i < count; i++) {
+                replacement.push_back(C(difflib::Tag::delete_, rand() % 1000, rand() % 1000, rand() % 1000, rand() % 1000));
+            }
+            model.erase(model.begin() + lo, model.begin() + hi);
+            model.insert(model.begin() + lo, replacement.begin(), replacement.end());
+            chunks.splice(lo, hi, replacement);
+            ASSERT_EQ(model.size(), chunks.size());
+            for (size_t i = 0; i < model.size(); i++) {
+                ASSERT_EQ(model[i], chunks[i]);
+            }
+        }
+        EXPECT_EQ(model, chunks.to_list());
+    }
+}
+
+TEST(DiffChunksTest, testChunkIndex) {
+    ChunkIndex index;
+    EXPECT_EQ((std::array<int, 3>{-1, -1, -1}), index.locate(0));
+    index.add(2, 4, 0);
+    index.add(6, 6, 1);
+    index.add(7, 9, 2);
+    EXPECT_EQ(3, index.size());
+
+    EXPECT_EQ((std::array<int, 3>{-1, -1, 0}), index.locate(1));
+    EXPECT_EQ((std::array<int, 3>{0, -1, 1}), index.locate(2));
+    EXPECT_EQ((std::array<int, 3>{0, -1, 1}), index.locate(3));
+    EXPECT_EQ((std::array<int, 3>{-1, 0, 1}), index.locate(4));
+    // An empty chunk claims the line after it
+    EXPECT_EQ((std::array<int, 3>{1, 0, 2}), index.locate(6));
+    EXPECT_EQ((std::array<int, 3>{2, 1, -1}), index.locate(8));
+    EXPECT_EQ((std::array<int, 3>{-1, 2, -1}), index.locate(9));
+
+    EXPECT_EQ((std::vector<int>{}), index.intersecting(0, 2));
+    EXPECT_EQ((std::vector<int>{0}), index.intersecting(0, 3));
+    EXPECT_EQ((std::vector<int>{0, 1}), index.intersecting(3, 7));
+    EXPECT_EQ((std::vector<int>{1, 2}), index.intersecting(6, 100));
+    EXPECT_EQ((std::vector<int>{}), index.intersecting(4, 6));
+
+    // Against a line by line table, with each chunk's lines overwriting
+    // those of the chunks before it
+    srand(18);
+    for (int run = 0; run < 100; run++) {
+        index.clear();
+        std::vector<std::pair<int, int>> ranges;
+        int line = 0;
+        for (int i = rand() % 20; i > 0; i--) {
+            line += rand() % 3;
+            int end = line + rand() % 3;
+            ranges.push_back(std::pair<int, int>(line, end));
+            index.add(line, end, ranges.size() - 1);
+            line = end;
+        }
+        std::vector<int> table(line + 2, -1);
+        for (size_t i = 0; i < ranges.size(); i++) {
+            int end = std::max(ranges[i].second, ranges[i].first + 1);
+            for (int l = ranges[i].first; l < end; l++) {
+                table[l] = i;
+            }
+        }
+        for (int l = 0; l < int(table.size()); l++) {
+            EXPECT_EQ(table[l], index.locate(l)[0]);
+            std::vector<int> at = index.intersecting(l, l + 1);
+            if (table[l] >= 0) {
+                EXPECT_EQ(table[l], at.back());
+            }
+        }
+    }
+}
+
+TEST(DiffChunksTest, testMergeCache) {
+    typedef std::pair<difflib::chunk_t, difflib::chunk_t> P;
+    const difflib::Tag r = difflib::Tag::replace;
+    const difflib::Tag c = difflib::Tag::conflict;
+    const C none = difflib::EMPTY_CHUNK;
+    // Entries with a side missing, both sides on the same middle lines,
+    // and both sides on different ones as delete/conflict splitting makes
+    std::vector<P> entries = {P(C(r, 0, 1, 0, 2), none), P(none, C(r, 3, 3, 3, 4)),
+                              P(C(c, 5, 7, 6, 6), C(c, 5, 7, 7, 9)), P(C(c, 8, 9, 8, 8), C(c, 9, 9, 11, 11))};
+    for (int i = 0; i < 100; i++) {
+        entries.push_back(P(C(r, 10 + i, 11 + i, 10 + i, 11 + i), none));
+    }
+    entries.push_back(P(none, C(c, 200, 201, 200, 200)));
+
+    MergeCache cache(entries);
+    ASSERT_EQ(entries.size(), cache.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        EXPECT_EQ(entries[i], cache[i]);
+        EXPECT_EQ(entries[i].first, cache.chunk(i, 0));
+        EXPECT_EQ(entries[i].second, cache.chunk(i, 1));
+        EXPECT_EQ(entries[i].first.tag == c or entries[i].second.tag == c, cache.is_conflict(i));
+    }
+    EXPECT_EQ(entries, std::vector<P>(cache.begin(), cache.end()));
+    EXPECT_EQ(entries.size(), size_t(cache.end() - cache.begin()));
+
+    EXPECT_EQ(difflib::Tag::none, cache.tag(1, 0));
+    EXPECT_EQ(3, cache.start(1, 1));
+    EXPECT_EQ(4, cache.end(1, 2));
+    EXPECT_EQ(8, cache.start(3, 1));
+
+    EXPECT_EQ(2, cache.next_conflict(0));
+    EXPECT_EQ(3, cache.next_conflict(3));
+    EXPECT_EQ(entries.size() - 1, cache.next_conflict(4));
+    EXPECT_EQ(entries.size(), cache.next_conflict(entries.size()));
+    EXPECT_GT(sizeof(P) * entries.size(), cache.memory_used());
+
+    cache.clear();
+    EXPECT_TRUE(cache.empty());
+    EXPECT_EQ(0, cache.next_conflict(0));
+    EXPECT_TRUE(cache.begin() == cache.end());
+}
+
+TEST(DiffChunksTest, testMergeCacheShiftAndSplice) {
+    typedef std::pair<difflib::chunk_t, difflib::chunk_t> P;
+    const difflib::Tag tags[] = {difflib::Tag::none, difflib::Tag::replace, difflib::Tag::conflict};
+    // Against a plain vector, offset eagerly
+    srand(19);
+    for (int run = 0; run < 50; run++) {
+        std::vector<P> model;
+        MergeCache cache;
+        for (int edit = 0; edit < 100; edit++) {
+            size_t lo = rand() % (model.size() + 1);
+            size_t hi = lo + rand() % (model.size() - lo + 1);
+            int pane = rand() % 3;
+            int delta = rand() % 7 - 3;
+            for (size_t i = hi; i < model.size(); i++) {
+                if (pane == 1) {
+                    model[i].first = model[i].first.tag == difflib::Tag::none ? model[i].first : offset(model[i].first, delta, 0);
+                    model[i].second = model[i].second.tag == difflib::Tag::none ? model[i].second : offset(model[i].second, delta, 0);
+                } else {
+                    C& chunk = pane == 0 ? model[i].first : model[i].second;
+                    chunk = chunk.tag == difflib::Tag::none ? chunk : offset(chunk, 0, delta);
+                }
+            }
+            cache.shift(hi, pane, delta);
+            std::vector<P> replacement;
+            size_t count = rand() % 2 ? hi - lo : rand() % 4;
+            for (size_t i = 0; i < count; i++) {
+                int start = rand() % 1000;
+                C c0(tags[rand() % 3], start, start + rand() % 3, rand() % 1000, rand() % 1000);
+                // Both sides usually share their middle lines, but not always
+                int split = rand() % 4 == 0 ? rand() % 3 : 0;
+                C c1(tags[1 + rand() % 2], c0.i1 + split, c0.i2 + split, rand() % 1000, rand() % 1000);
+                replacement.push_back(P(c0.tag == difflib::Tag::none ? difflib::EMPTY_CHUNK : c0, c1));
+            }
+            model.erase(model.begin() + lo, model.begin() + hi);
+            model.insert(model.begin() + lo, replacement.begin(), replacement.end());
+            cache.splice(lo, hi, MergeCache(replacement));
+            ASSERT_EQ(model.size(), cache.size());
+            size_t mergeable[2] = {0, 0};
+            size_t previous = cache.size();
+            for (size_t i = 0; i < model.size(); i++) {
+                ASSERT_EQ(model[i], cache[i]);
+                bool conflict = model[i].first.tag == difflib::Tag::conflict or model[i].second.tag == difflib::Tag::conflict;
+                ASSERT_EQ(conflict, cache.is_conflict(i));
+                previous = conflict ? i : previous;
+                ASSERT_EQ(previous, cache.previous_conflict(i));
+                mergeable[0] += model[i].first.tag == difflib::Tag::replace;
+                mergeable[1] += model[i].second.tag == difflib::Tag::replace;
+            }
+            ASSERT_EQ(mergeable[0], cache.mergeable_count(0));
+            ASSERT_EQ(mergeable[1], cache.mergeable_count(1));
+        }
+    }
+
+    MergeCache cache({P(C(difflib::Tag::replace, 2, 3, 2, 3), difflib::EMPTY_CHUNK),
+                      P(difflib::EMPTY_CHUNK, C(difflib::Tag::replace, 6, 6, 6, 7))});
+    cache.shift(1, 1, 2);
+    EXPECT_EQ(0, cache.locate_middle(1));
+    EXPECT_EQ(1, cache.locate_middle(2));
+    EXPECT_EQ(1, cache.locate_middle(7));
+    EXPECT_EQ(2, cache.locate_middle(8));
+}
+
+TEST(DiffChunksTest, testChunkIndexSplice) {
+    // Against an index rebuilt from the shifted and spliced chunks
+    srand(20);
+    for (int run = 0; run < 50; run++) {
+        std::vector<std::pair<int, int>> ranges;
+        ChunkIndex index;
+        for (int edit = 0; edit < 100; edit++) {
+            int lo = rand() % (ranges.size() + 1);
+            int hi = lo + rand() % (ranges.size() - lo + 1);
+            int line = lo > 0 ? ranges[lo - 1].second : 0;
+            int end = hi < int(ranges.size()) ? ranges[hi].first : line + 10;
+            int delta = rand() % 7 - 3;
+            // Keep the later chunks after the new ones
+            delta = std::max(delta, line - end);
+            for (size_t i = hi; i < ranges.size(); i++) {
+                ranges[i].first += delta;
+                ranges[i].second += delta;
+            }
+            index.shift_lines(hi, delta);
+            int limit = end + delta;
+            std::vector<std::pair<int, int>> replacement;
+            int count = rand() % 2 ? hi - lo : rand() % 4;
+            ChunkIndex added;
+            for (int i = 0; i < count; i++) {
+                int start = std::min(line + rand() % 2, limit);
+                line = std::min(start + rand() % 3, limit);
+                replacement.push_back(std::pair<int, int>(start, line));
+                added.add(start, line, lo + i);
+            }
+            ranges.erase(ranges.begin() + lo, ranges.begin() + hi);
+            ranges.insert(ranges.begin() + lo, replacement.begin(), replacement.end());
+            index.splice(lo, hi, count, added);
+
+            ChunkIndex rebuilt;
+            for (size_t i = 0; i < ranges.size(); i++) {
+                rebuilt.add(ranges[i].first, ranges[i].second, i);
+            }
+            ASSERT_EQ(rebuilt.size(), index.size());
+            int last = ranges.empty() ? 0 : ranges.back().second;
+            for (int l = 0; l < last + 2; l++) {
+                ASSERT_EQ(rebuilt.locate(l), index.locate(l));
+                ASSERT_EQ(rebuilt.intersecting(l, l + 2), index.intersecting(l, l + 2));
+            }
+        }
+    }
+}
+
+TEST(DiffChunksTest, testMergeCacheDelta) {
+    typedef std::pair<difflib::chunk_t, difflib::chunk_t> P;
+    const difflib::Tag r = difflib::Tag::replace;
+    const C none = difflib::EMPTY_CHUNK;
+    MergeCache old_cache({P(C(r, 0, 1, 0, 1), none), P(C(r, 4, 5, 4, 6), none),
+                          P(C(r, 8, 9, 9, 9), none), P(none, C(r, 12, 13, 12, 12))});
+    MergeCache new_cache({P(C(r, 0, 1, 0, 1), none), P(C(r, 4, 5, 4, 7), none),
+                          P(C(r, 6, 6, 8, 9), none), P(C(r, 8, 9, 9, 9), none),
+                          P(none, C(r, 12, 13, 12, 12))});
+
+    ChunkDelta delta = merge_cache_delta(old_cache, new_cache, 2);
+    EXPECT_EQ((std::vector<std::pair<size_t, size_t>>{{1, 2}}), delta.removed);
+    EXPECT_EQ((std::vector<std::pair<size_t, size_t>>{{1, 3}}), delta.added);
+    EXPECT_EQ(3, delta.modified);
+    EXPECT_FALSE(delta.empty());
+
+    // The changed entry itself went
+    delta = merge_cache_delta(old_cache, new_cache, 1);
+    EXPECT_EQ(-1, delta.modified);
+
+    delta = merge_cache_delta(old_cache, old_cache, -1);
+    EXPECT_TRUE(delta.empty());
+
+    delta = merge_cache_delta({}, new_cache, -1);
+    EXPECT_EQ((std::vector<std::pair<size_t, size_t>>{{0, 5}}), delta.added);
+    delta = merge_cache_delta(old_cache, {}, -1);
+    EXPECT_EQ((std::vector<std::pair<size_t, size_t>>{{0, 4}}), delta.removed);
+}
+
+TEST(DiffChunksTest, testDiffMerger) {
+    const difflib::Tag r = difflib::Tag::replace;
+    const difflib::Tag i = difflib::Tag::insert;
+    const difflib::Tag d = difflib::Tag::delete_;
+    // Disjoint, overlapping, touching and same-line insert changes
+    difflib::chunk_list_t seq0 = {C(r, 0, 1, 0, 1), C(r, 4, 6, 4, 5), C(i, 10, 10, 9, 11), C(d, 14, 15, 15, 15)};
+    difflib::chunk_list_t seq1 = {C(r, 2, 3, 2, 3), C(r, 5, 8, 5, 7), C(r, 8, 9, 7, 8), C(i, 10, 10, 9, 10),
+                                  C(r, 15, 16, 15, 16)};
+
+    DiffMerger merger(seq0, seq1);
+    std::array<ChunkSpan, 2> group;
+    std::vector<std::pair<size_t, size_t>> sizes;
+    std::vector<C> firsts;
+    while (merger.next(group)) {
+        sizes.push_back(std::pair<size_t, size_t>(group[0].size(), group[1].size()));
+        firsts.push_back(group[0].empty() ? group[1].front() : group[0].front());
+    }
+    std::vector<std::pair<size_t, size_t>> expected_sizes = {{1, 0}, {0, 1}, {1, 1}, {0, 1}, {1, 1}, {1, 0}, {0, 1}};
+    EXPECT_EQ(expected_sizes, sizes);
+    std::vector<C> expected_firsts = {seq0[0], seq1[0], seq0[1], seq1[2], seq0[2], seq0[3], seq1[4]};
+    EXPECT_EQ(expected_firsts, firsts);
+    EXPECT_FALSE(merger.next(group));
+
+    difflib::chunk_list_t none;
+    DiffMerger empty_merger(none, seq1);
+    EXPECT_TRUE(empty_merger.next(group));
+    EXPECT_TRUE(group[0].empty());
+    EXPECT_EQ(seq1[0], group[1].front());
+}
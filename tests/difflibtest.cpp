@@ -7,6 +7,37 @@ TEST(SequenceMatcherTest, testRatio) {
     EXPECT_FLOAT_EQ(0.75, s.ratio());
 }
 
+TEST(SequenceMatcherTest, testJunk) {
+    difflib::SequenceMatcher<std::string> s("private Thread currentThread;", "private volatile Thread currentThread;",
+                                            [](char c) { return c == ' '; });
+    EXPECT_NEAR(0.86567, s.ratio(), 1e-5);
+    difflib::match_list_t blocks = s.get_matching_blocks();
+    ASSERT_EQ(3, blocks.size());
+    EXPECT_EQ(difflib::match_t(0, 0, 8), blocks[0]);
+    EXPECT_EQ(difflib::match_t(8, 17, 21), blocks[1]);
+}
+
+TEST(SequenceMatcherTest, testJunkExtension) {
+    // Matches grow by non-junk on each side first and then by junk, as
+    // in Python's difflib; here "x" stays its own block rather than
+    // being taken along with the junk space in front of "bx"
+    difflib::SequenceMatcher<std::string> s("xx bxx ", "x bx", [](char c) { return c == ' '; });
+    difflib::match_list_t blocks = s.get_matching_blocks();
+    ASSERT_EQ(3, blocks.size());
+    EXPECT_EQ(difflib::match_t(0, 0, 1), blocks[0]);
+    EXPECT_EQ(difflib::match_t(2, 1, 3), blocks[1]);
+    EXPECT_EQ(difflib::match_t(7, 4, 0), blocks[2]);
+}
+
+TEST(SequenceMatcherTest, testSetSeq) {
+    difflib::SequenceMatcher<std::string> s("", "abcd");
+    s.set_seq1("abxcd");
+    EXPECT_NEAR(0.88889, s.ratio(), 1e-5);
+    s.set_seq2("bcde");
+    s.set_seq1("abcd");
+    EXPECT_FLOAT_EQ(0.75, s.ratio());
+}
+
 TEST(SequenceMatcherTest, testGetOpcodes) {
     std::string a = "abcd";
     std::string b = "bcde";
@@ -14,21 +45,85 @@ TEST(SequenceMatcherTest, testGetOpcodes) {
     difflib::chunk_list_t opcodes = s.get_opcodes();
     EXPECT_EQ(3, opcodes.size());
 
-    EXPECT_EQ("delete", std::get<0>(opcodes[0]));
-    EXPECT_EQ(0, std::get<1>(opcodes[0]));
-    EXPECT_EQ(1, std::get<2>(opcodes[0]));
-    EXPECT_EQ(0, std::get<3>(opcodes[0]));
-    EXPECT_EQ(0, std::get<4>(opcodes[0]));
-
-    EXPECT_EQ("equal", std::get<0>(opcodes[1]));
-    EXPECT_EQ(1, std::get<1>(opcodes[1]));
-    EXPECT_EQ(4, std::get<2>(opcodes[1]));
-    EXPECT_EQ(0, std::get<3>(opcodes[1]));
-    EXPECT_EQ(3, std::get<4>(opcodes[1]));
-
-    EXPECT_EQ("insert", std::get<0>(opcodes[2]));
-    EXPECT_EQ(4, std::get<1>(opcodes[2]));
-    EXPECT_EQ(4, std::get<2>(opcodes[2]));
-    EXPECT_EQ(3, std::get<3>(opcodes[2]));
-    EXPECT_EQ(4, std::get<4>(opcodes[2]));
+    EXPECT_EQ(difflib::Tag::delete_, opcodes[0].tag);
+    EXPECT_EQ(0, opcodes[0].i1);
+    EXPECT_EQ(1, opcodes[0].i2);
+    EXPECT_EQ(0, opcodes[0].j1);
+    EXPECT_EQ(0, opcodes[0].j2);
+
+    EXPECT_EQ(difflib::Tag::equal, opcodes[1].tag);
+    EXPECT_EQ(1, opcodes[1].i1);
+    EXPECT_EQ(4, opcodes[1].i2);
+    EXPECT_EQ(0, opcodes[1].j1);
+    EXPECT_EQ(3, opcodes[1].j2);
+
+    EXPECT_EQ(difflib::Tag::insert, opcodes[2].tag);
+    EXPECT_EQ(4, opcodes[2].i1);
+    EXPECT_EQ(4, opcodes[2].i2);
+    EXPECT_EQ(3, opcodes[2].j1);
+    EXPECT_EQ(4, opcodes[2].j2);
+}
+
+TEST(SequenceMatcherTest, testChunkTuples) {
+    difflib::chunk_t chunk(difflib::Tag::delete_, 0, 1, 0, 0);
+    difflib::tuple_chunk_t legacy = difflib::to_tuple(chunk);
+    EXPECT_EQ("delete", std::get<0>(legacy));
+    EXPECT_EQ(1, std::get<2>(legacy));
+    EXPECT_EQ(chunk, difflib::from_tuple(legacy));
+    EXPECT_EQ(difflib::EMPTY_CHUNK, difflib::from_tuple(difflib::tuple_chunk_t("", 0, 0, 0, 0)));
+    EXPECT_EQ(20, sizeof(difflib::chunk_t));
+}
+
+TEST(SequenceMatcherTest, testOpcodeRange) {
+    difflib::SequenceMatcher<std::string> s("qabxcd", "abycdf");
+    difflib::chunk_list_t opcodes = s.get_opcodes();
+    difflib::opcode_range all = s.opcodes();
+    EXPECT_EQ(opcodes, difflib::chunk_list_t(all.begin(), all.end()));
+
+    difflib::chunk_list_t changes;
+    for (const difflib::chunk_t& chunk : s.opcodes(true)) {
+        changes.push_back(chunk);
+    }
+    ASSERT_EQ(3, changes.size());
+    EXPECT_EQ(difflib::chunk_t(difflib::Tag::delete_, 0, 1, 0, 0), changes[0]);
+    EXPECT_EQ(difflib::chunk_t(difflib::Tag::replace, 3, 4, 2, 3), changes[1]);
+    EXPECT_EQ(difflib::chunk_t(difflib::Tag::insert, 6, 6, 5, 6), changes[2]);
+
+    difflib::match_list_t identical = {difflib::match_t(0, 0, 3), difflib::match_t(3, 3, 0)};
+    difflib::opcode_range none(identical, true);
+    EXPECT_TRUE(none.begin() == none.end());
+}
+
+TEST(SequenceMatcherTest, testQuickRatios) {
+    difflib::SequenceMatcher<std::string> s("abcabc", "cbaxx");
+    EXPECT_NEAR(0.18182, s.ratio(), 1e-5);
+    EXPECT_NEAR(0.54545, s.quick_ratio(), 1e-5);
+    EXPECT_NEAR(0.90909, s.real_quick_ratio(), 1e-5);
+    EXPECT_FLOAT_EQ(1.0, difflib::length_ratio(0, 0));
+}
+
+TEST(SequenceMatcherTest, testSketchSimilarity) {
+    std::vector<std::string> original;
+    for (int i = 0; i < 2000; i++) {
+        original.push_back("line " + std::to_string(i));
+    }
+    std::vector<std::string> edited = original;
+    for (int i = 0; i < 2000; i += 100) {
+        edited[i] = "changed";
+    }
+    std::vector<std::string> unrelated;
+    for (int i = 0; i < 2000; i++) {
+        unrelated.push_back("other " + std::to_string(i));
+    }
+
+    difflib::sketch_t a = difflib::make_sketch(original);
+    EXPECT_EQ(128, a.hashes.size());
+    EXPECT_FLOAT_EQ(1.0, difflib::sketch_similarity(a, a));
+    // 20 edits touch 80 of the 1997 shingles: a Jaccard index near 0.92
+    EXPECT_NEAR(0.92, difflib::sketch_similarity(a, difflib::make_sketch(edited)), 0.1);
+    EXPECT_FLOAT_EQ(0.0, difflib::sketch_similarity(a, difflib::make_sketch(unrelated)));
+
+    difflib::sketch_t tiny = difflib::make_sketch(std::string("ab"));
+    EXPECT_EQ(1, tiny.hashes.size());
+    EXPECT_FLOAT_EQ(1.0, difflib::sketch_similarity(tiny, difflib::make_sketch(std::string("ab"))));
 }
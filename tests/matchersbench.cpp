@@ -0,0 +1,491 @@
+/*
+ * Compare the running time of the line matchers on large, repetitive
+ * inputs, of Myers split across worker threads, of the inline matchers
+ * on short lines, of difflib's ratio() on many names, of prefix/suffix
+ * trimming on large, mostly equal texts, of whitespace insensitive line
+ * interning, of merging the two diffs of a three way comparison, of
+ * typing into one, and of the chunk and merge cache representations
+ * themselves, e.g.:
+ *
+ *   ./matchersbench 200000
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <regex>
+#include <set>
+#include <sstream>
+
+#include "../meld/diffchunks.h"
+#include "../meld/diffutil.h"
+#include "../meld/matchers.h"
+#include "../meld/textsnapshot.h"
+
+/*! A log where most lines repeat, with a few unique markers */
+static std::vector<std::string> make_log(size_t lines, unsigned int seed) {
+    static const char* messages[] = {
+        "INFO  request handled",
+        "DEBUG cache hit",
+        "DEBUG cache miss",
+        "WARN  slow query",
+        "INFO  connection closed",
+    };
+    srand(seed);
+    std::vector<std::string> result;
+    for (size_t i = 0; i < lines; i++) {
+        if (i % 97 == 0) {
+            std::ostringstream marker;
+            marker << "INFO  checkpoint " << i;
+            result.push_back(marker.str());
+        } else {
+            result.push_back(messages[rand() % 5]);
+        }
+    }
+    return result;
+}
+
+/*! Apply scattered edits, as between two runs of the same program */
+static std::vector<std::string> mutate(std::vector<std::string> lines, size_t edits, unsigned int seed) {
+    srand(seed);
+    for (size_t e = 0; e < edits; e++) {
+        size_t pos = rand() % lines.size();
+        switch (rand() % 3) {
+        case 0:
+            lines.erase(lines.begin() + pos);
+            break;
+        case 1:
+            lines.insert(lines.begin() + pos, "ERROR unexpected reply");
+            break;
+        default:
+            lines[pos] = "DEBUG cache hit";
+        }
+    }
+    return lines;
+}
+
+static long elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*! Trim two 50 MB texts differing in one byte, in place and bytewise */
+static void bench_prefix_suffix() {
+    const size_t size = 50 * 1024 * 1024;
+    std::string a(size, 'x');
+    for (size_t i = 0; i < size; i += 81) {
+        a[i] = '\n';
+    }
+    std::string b = a;
+    b[size / 2] = 'y';
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t prefix = 0;
+    while (prefix < size and a[prefix] == b[prefix]) {
+        prefix += 1;
+    }
+    size_t suffix = 0;
+    while (suffix < size - prefix and a[size - suffix - 1] == b[size - suffix - 1]) {
+        suffix += 1;
+    }
+    std::cout << "bytewise trim: " << elapsed_us(start) << " us (" << prefix << ", " << suffix << ")" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    prefix = common_prefix_length(a.data(), b.data(), size);
+    suffix = common_suffix_length(a.data() + prefix, b.data() + prefix, size - prefix);
+    std::cout << "vector trim: " << elapsed_us(start) << " us (" << prefix << ", " << suffix << ")" << std::endl;
+}
+
+/*! Inline match many short, slightly edited line pairs with both matchers */
+static void bench_inline() {
+    srand(4);
+    std::vector<std::pair<std::string, std::string>> pairs;
+    for (int p = 0; p < 100000; p++) {
+        std::string a;
+        for (int i = 40 + rand() % 80; i > 0; i--) {
+            a.push_back(' ' + rand() % 64);
+        }
+        std::string b = a;
+        for (int e = 0; e < 3; e++) {
+            b[rand() % b.size()] = '#';
+        }
+        pairs.push_back(std::make_pair(a, b));
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t chunks = 0;
+    for (const std::pair<std::string, std::string>& p : pairs) {
+        InlineMyersSequenceMatcher matcher(p.first, p.second, nullptr);
+        chunks += matcher.get_opcodes().size();
+    }
+    std::cout << "inline myers: " << elapsed_us(start) / 1000 << " ms, " << chunks << " chunks" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    chunks = 0;
+    for (const std::pair<std::string, std::string>& p : pairs) {
+        BitParallelSequenceMatcher matcher(p.first, p.second);
+        chunks += matcher.get_opcodes().size();
+    }
+    std::cout << "inline bit-parallel: " << elapsed_us(start) / 1000 << " ms, " << chunks << " chunks" << std::endl;
+}
+
+/*! Score every pair among a few hundred similar file names, as rename detection does */
+static void bench_ratio() {
+    srand(5);
+    std::vector<std::string> names;
+    for (int n = 0; n < 300; n++) {
+        std::ostringstream name;
+        name << "src/module_" << rand() % 20 << "/component_" << rand() % 1000 << "_handler";
+        name << (rand() % 2 ? ".cpp" : ".h");
+        names.push_back(name.str());
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double total = 0;
+    for (const std::string& a : names) {
+        for (const std::string& b : names) {
+            difflib::SequenceMatcher<std::string> matcher(a, b);
+            total += matcher.ratio();
+        }
+    }
+    std::cout << "ratio, new matcher per pair: " << elapsed_us(start) / 1000 << " ms (" << total << ")" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    total = 0;
+    difflib::SequenceMatcher<std::string> matcher("", "");
+    for (const std::string& b : names) {
+        matcher.set_seq2(b);
+        for (const std::string& a : names) {
+            matcher.set_seq1(a);
+            total += matcher.ratio();
+        }
+    }
+    std::cout << "ratio, reused matcher: " << elapsed_us(start) / 1000 << " ms (" << total << ")" << std::endl;
+}
+
+/*! Intern a 4 MB text as is, ignoring whitespace, and after a regex rewrite */
+static void bench_normalise() {
+    std::string text;
+    for (int i = 0; text.size() < 4 * 1024 * 1024; i++) {
+        text += "    if (value_" + std::to_string(i % 5000) + " == other)  {  \t\n";
+    }
+    size_t lines = std::count(text.begin(), text.end(), '\n');
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    LineInterner plain;
+    size_t ids = plain.intern_lines(text, 0, lines).size();
+    std::cout << "intern plain: " << elapsed_us(start) / 1000 << " ms, " << ids << " lines" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    LineInterner normalised;
+    normalised.set_normalisation(NORMALISE_IGNORE_SPACE);
+    ids = normalised.intern_lines(text, 0, lines).size();
+    std::cout << "intern ignoring whitespace: " << elapsed_us(start) / 1000 << " ms, " << ids << " lines" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    std::string filtered = std::regex_replace(text, std::regex("[ \\t\\r\\f\\v]+"), "");
+    LineInterner rewritten;
+    ids = rewritten.intern_lines(filtered, 0, lines).size();
+    std::cout << "regex rewrite and intern: " << elapsed_us(start) / 1000 << " ms, " << ids << " lines" << std::endl;
+}
+
+/*! Build and compare chunk pairs as the merge cache does, for a given chunk type */
+template <typename Chunk, typename MakeChunk>
+static void bench_chunk_type(const char* name, size_t count, MakeChunk make_chunk) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::pair<Chunk, Chunk>> pairs;
+    for (size_t i = 0; i < count; i++) {
+        pairs.push_back(std::make_pair(make_chunk(i), make_chunk(i + 1)));
+    }
+    long build = elapsed_us(start);
+
+    start = std::chrono::steady_clock::now();
+    std::set<std::pair<Chunk, Chunk>> cache(pairs.begin(), pairs.end());
+    size_t found = 0;
+    for (const std::pair<Chunk, Chunk>& p : pairs) {
+        found += cache.count(p);
+    }
+    long compare = elapsed_us(start);
+
+    std::cout << name << ": " << sizeof(Chunk) << " bytes, build " << build / 1000
+              << " ms, set insert and lookup " << compare / 1000 << " ms, " << found << " found" << std::endl;
+}
+
+static void bench_chunks() {
+    const size_t count = 100000;
+    bench_chunk_type<difflib::tuple_chunk_t>("tuple chunks", count, [](size_t i) {
+        return difflib::tuple_chunk_t(i % 3 ? "replace" : "insert", i, i + 2, i, i + 3);
+    });
+    bench_chunk_type<difflib::chunk_t>("struct chunks", count, [](size_t i) {
+        return difflib::chunk_t(i % 3 ? difflib::Tag::replace : difflib::Tag::insert, i, i + 2, i, i + 3);
+    });
+}
+
+/*! Memory and scan time of a merge cache of count entries, as pairs and as a MergeCache */
+static void bench_merge_cache(size_t count) {
+    typedef std::pair<difflib::chunk_t, difflib::chunk_t> P;
+    const difflib::Tag r = difflib::Tag::replace;
+    const difflib::Tag c = difflib::Tag::conflict;
+    std::vector<P> pairs;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t line = 3 * i;
+        difflib::chunk_t chunk(i % 100 ? r : c, line, line + 1, line, line + 2);
+        pairs.push_back(i % 3 == 0 ? P(chunk, difflib::EMPTY_CHUNK) : i % 3 == 1 ? P(difflib::EMPTY_CHUNK, chunk) : P(chunk, chunk));
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<P> vector_cache;
+    for (const P& p : pairs) {
+        vector_cache.push_back(p);
+    }
+    long build = elapsed_us(start);
+    start = std::chrono::steady_clock::now();
+    size_t conflicts = 0;
+    for (const P& p : vector_cache) {
+        conflicts += p.first.tag == c or p.second.tag == c;
+    }
+    long scan_conflicts = elapsed_us(start);
+    start = std::chrono::steady_clock::now();
+    uint64_t lines = 0;
+    for (const P& p : vector_cache) {
+        if (p.first != difflib::EMPTY_CHUNK) {
+            lines += p.first.j2 - p.first.j1;
+        }
+    }
+    long scan_pane = elapsed_us(start);
+    std::cout << "merge cache, pairs: " << vector_cache.capacity() * sizeof(P) / count << " bytes per entry, build "
+              << build / 1000 << " ms, conflicts " << scan_conflicts << " us (" << conflicts << "), pane 0 "
+              << scan_pane << " us (" << lines << ")" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    MergeCache cache;
+    for (const P& p : pairs) {
+        cache.push_back(p);
+    }
+    build = elapsed_us(start);
+    start = std::chrono::steady_clock::now();
+    conflicts = 0;
+    for (size_t i = cache.next_conflict(0); i < cache.size(); i = cache.next_conflict(i + 1)) {
+        conflicts++;
+    }
+    scan_conflicts = elapsed_us(start);
+    start = std::chrono::steady_clock::now();
+    lines = 0;
+    for (size_t i = 0; i < cache.size(); i++) {
+        if (cache.tag(i, 0) != difflib::Tag::none) {
+            lines += cache.end(i, 0) - cache.start(i, 0);
+        }
+    }
+    scan_pane = elapsed_us(start);
+    std::cout << "merge cache, MergeCache: " << cache.memory_used() / count << " bytes per entry, build "
+              << build / 1000 << " ms, conflicts " << scan_conflicts << " us (" << conflicts << "), pane 0 "
+              << scan_pane << " us (" << lines << ")" << std::endl;
+}
+
+static void bench_keystrokes() {
+    // Typing in a 500k line file with a chunk every 10 lines: locating
+    // the edit and moving every later chunk, eagerly or through DiffChunks
+    const size_t chunk_count = 50000;
+    const size_t keystrokes = 20000;
+    difflib::chunk_list_t eager;
+    for (size_t i = 0; i < chunk_count; i++) {
+        eager.push_back(difflib::chunk_t(difflib::Tag::replace, i * 10, i * 10 + 2, i * 10, i * 10 + 3));
+    }
+    DiffChunks lazy(eager);
+    srand(6);
+    std::vector<std::pair<size_t, int>> edits;
+    for (size_t k = 0; k < keystrokes; k++) {
+        // Mostly typing within a line, sometimes Enter or a deleted line
+        int change = rand() % 10 == 0 ? (rand() % 2 ? 1 : -1) : 0;
+        edits.push_back(std::pair<size_t, int>(rand() % (chunk_count * 10 - 20), change));
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (const std::pair<size_t, int>& edit : edits) {
+        size_t at = std::lower_bound(eager.begin(), eager.end(), edit.first, [](const difflib::chunk_t& c, size_t line) {
+            return c.i2 <= line;
+        }) - eager.begin();
+        for (size_t i = at + 1; i < eager.size(); i++) {
+            eager[i].i1 += edit.second;
+            eager[i].i2 += edit.second;
+        }
+    }
+    std::cout << "keystrokes, eager offsets: " << elapsed_us(start) * 1000 / keystrokes << " ns each" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    for (const std::pair<size_t, int>& edit : edits) {
+        size_t at = lazy.locate(false, edit.first);
+        if (at < lazy.size()) {
+            lazy.shift(at + 1, edit.second, 0);
+            lazy.splice(at, at + 1, {lazy[at]});
+        }
+    }
+    std::cout << "keystrokes, DiffChunks: " << elapsed_us(start) * 1000 / keystrokes << " ns each, "
+              << (lazy.to_list() == eager ? "same" : "different") << " result" << std::endl;
+}
+
+/*! Type into the middle pane of a three way comparison, through _Differ::change_sequence() */
+static void bench_change_sequence(size_t lines) {
+    Glib::init();
+    std::vector<std::string> base = make_log(lines, 3);
+    std::vector<TextSnapshot> texts = {TextSnapshot(mutate(base, lines / 100, 4)), TextSnapshot(base),
+                                       TextSnapshot(mutate(base, lines / 100, 5))};
+    _Differ differ;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    differ.set_sequences_iter(texts);
+    while (differ.busy()) {
+        Glib::MainContext::get_default()->iteration(true);
+    }
+    std::cout << "typing, " << lines << " lines three way: full diff " << elapsed_us(start) / 1000 << " ms, "
+              << differ.diff_count() << " chunks" << std::endl;
+
+    // Middle pane edits re-diff and re-merge both sides
+    const size_t keystrokes = 2000;
+    srand(7);
+    long total = 0;
+    long slowest = 0;
+    for (size_t k = 0; k < keystrokes; k++) {
+        size_t line = rand() % (texts[1].size() - 1);
+        // Mostly typing within a line, sometimes Enter
+        int change = rand() % 10 == 0 ? 1 : 0;
+        texts[1] = texts[1].replace(line, line + 1 - change, {"INFO  typed " + std::to_string(k)});
+        start = std::chrono::steady_clock::now();
+        differ.change_sequence(1, line, change, texts);
+        long took = elapsed_us(start);
+        total += took;
+        slowest = std::max(slowest, took);
+    }
+    std::cout << "typing, change_sequence: " << total / keystrokes << " us per keystroke, slowest "
+              << slowest << " us, " << differ.diff_count() << " chunks" << std::endl;
+}
+
+/*! Group overlapping changes as a literal port of the Python would, popping from the front */
+static size_t merge_by_popping(difflib::chunk_list_t seq0, difflib::chunk_list_t seq1) {
+    std::array<difflib::chunk_list_t*, 2> seq = {{&seq0, &seq1}};
+    size_t groups = 0;
+    while (seq0.size() or seq1.size()) {
+        int high_seq;
+        if (seq0.empty()) {
+            high_seq = 1;
+        } else if (seq1.empty()) {
+            high_seq = 0;
+        } else {
+            high_seq = int(seq0[0].i1 > seq1[0].i1);
+            if (seq0[0].i1 == seq1[0].i1) {
+                if (seq0[0].tag == difflib::Tag::insert) {
+                    high_seq = 0;
+                } else if (seq1[0].tag == difflib::Tag::insert) {
+                    high_seq = 1;
+                }
+            }
+        }
+        difflib::chunk_t high_diff = seq[high_seq]->front();
+        seq[high_seq]->erase(seq[high_seq]->begin());
+        uint32_t high_mark = high_diff.i2;
+        int other_seq = 1 - high_seq;
+        std::array<difflib::chunk_list_t, 2> _using;
+        _using[high_seq].push_back(high_diff);
+        while (not seq[other_seq]->empty()) {
+            difflib::chunk_t other_diff = seq[other_seq]->front();
+            if (high_mark < other_diff.i1) {
+                break;
+            }
+            if (high_mark == other_diff.i1 and
+                not (high_diff.tag == difflib::Tag::insert and other_diff.tag == difflib::Tag::insert)) {
+                break;
+            }
+            _using[other_seq].push_back(other_diff);
+            seq[other_seq]->erase(seq[other_seq]->begin());
+            if (high_mark < other_diff.i2) {
+                std::swap(high_seq, other_seq);
+                high_mark = other_diff.i2;
+            }
+        }
+        groups++;
+    }
+    return groups;
+}
+
+static void bench_merge(size_t lines, size_t edits) {
+    // A three way comparison: both sides edited from a common ancestor
+    LineInterner interner;
+    std::vector<std::string> text1 = make_log(lines, 1);
+    std::vector<std::string> text0 = mutate(text1, edits, 7);
+    std::vector<std::string> text2 = mutate(text1, edits, 8);
+    line_ids_t ids0 = interner.intern(text0);
+    line_ids_t ids1 = interner.intern(text1);
+    line_ids_t ids2 = interner.intern(text2);
+    difflib::chunk_list_t seq0 = MyersSequenceMatcher<line_ids_t>(ids1, ids0).get_difference_opcodes();
+    difflib::chunk_list_t seq1 = MyersSequenceMatcher<line_ids_t>(ids1, ids2).get_difference_opcodes();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t popped = merge_by_popping(seq0, seq1);
+    std::cout << "merge, popping: " << elapsed_us(start) << " us, " << popped << " groups" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    size_t groups = 0;
+    size_t same = 0;
+    DiffMerger merger(seq0, seq1);
+    std::array<ChunkSpan, 2> group;
+    while (merger.next(group)) {
+        groups++;
+        if (group[0].empty() or group[1].empty()) {
+            continue;
+        }
+        // What _auto_merge does with a group: compare the two sides' lines
+        uint32_t lowc = std::min(group[0].front().i1, group[1].front().i1);
+        uint32_t highc = std::max(group[0].back().i2, group[1].back().i2);
+        uint32_t l0 = lowc - group[0].front().i1 + group[0].front().j1;
+        uint32_t h0 = highc - group[0].back().i2 + group[0].back().j2;
+        uint32_t l2 = lowc - group[1].front().i1 + group[1].front().j1;
+        uint32_t h2 = highc - group[1].back().i2 + group[1].back().j2;
+        if (h0 - l0 == h2 - l2 and std::equal(text0.begin() + l0, text0.begin() + h0, text2.begin() + l2)) {
+            same++;
+        }
+    }
+    std::cout << "merge, DiffMerger: " << elapsed_us(start) << " us, " << groups << " groups, "
+              << same << " made the same change" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t lines = argc > 1 ? std::atoi(argv[1]) : 100000;
+    size_t edits = argc > 2 ? std::atoi(argv[2]) : lines / 100;
+
+    LineInterner interner;
+    std::vector<std::string> text_a = make_log(lines, 1);
+    std::vector<std::string> text_b = mutate(text_a, edits, 2);
+    line_ids_t a = interner.intern(text_a);
+    line_ids_t b = interner.intern(text_b);
+
+    std::cout << lines << " lines, " << edits << " edits" << std::endl;
+    for (std::string algorithm : {"myers", "patience", "histogram"}) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::unique_ptr<MyersSequenceMatcher<line_ids_t>> matcher = make_matcher(algorithm, a, b);
+        difflib::chunk_list_t opcodes = matcher->get_difference_opcodes();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        std::cout << algorithm << ": "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                  << " ms, " << opcodes.size() << " chunks" << std::endl;
+    }
+
+    for (unsigned int workers : {1u, 2u, 4u, 8u}) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        SyncPointMyersSequenceMatcher<line_ids_t> matcher(a, b);
+        matcher.set_max_workers(workers);
+        difflib::chunk_list_t opcodes = matcher.get_difference_opcodes();
+        std::cout << "split myers, " << workers << " workers: " << elapsed_us(start) / 1000
+                  << " ms, " << matcher.region_count() << " regions, " << opcodes.size() << " chunks" << std::endl;
+    }
+
+    bench_inline();
+    bench_chunks();
+    bench_keystrokes();
+    bench_merge(lines, edits * 3);
+    bench_merge_cache(lines * 10);
+    bench_change_sequence(lines * 5);
+    bench_ratio();
+    bench_normalise();
+    bench_prefix_suffix();
+    return 0;
+}
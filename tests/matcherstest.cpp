@@ -0,0 +1,670 @@
+#include <gtest/gtest.h>
+
+#include "../meld/matchers.h"
+#include "../meld/util/compat.h"
+
+static void expect_blocks(const difflib::match_list_t& expected, const difflib::match_list_t& blocks) {
+    ASSERT_EQ(expected.size(), blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+        EXPECT_EQ(expected[i], blocks[i]);
+    }
+}
+
+TEST(MatchersTest, testBasicMatcher) {
+    MyersSequenceMatcher<> matcher("abcbdefgabcdefg", "gfabcdefcd");
+    expect_blocks({{0, 2, 3}, {4, 5, 3}, {10, 8, 2}, {15, 10, 0}}, matcher.get_matching_blocks());
+}
+
+TEST(MatchersTest, testPostprocessingCleanup) {
+    MyersSequenceMatcher<> matcher("abcfabgcd", "afabcgabgcabcd");
+    expect_blocks({{0, 2, 3}, {4, 6, 3}, {7, 12, 2}, {9, 14, 0}}, matcher.get_matching_blocks());
+}
+
+TEST(MatchersTest, testInlineMatcher) {
+    InlineMyersSequenceMatcher matcher("red, blue, yellow, white", "black green, hue, white", nullptr);
+    expect_blocks({{17, 16, 7}, {24, 23, 0}}, matcher.get_matching_blocks());
+}
+
+TEST(MatchersTest, testSyncPointMatcher0) {
+    SyncPointMyersSequenceMatcher<> matcher("012a3456c789", "0a3412b5678");
+    expect_blocks({{0, 0, 1}, {3, 1, 3}, {6, 7, 2}, {9, 9, 2}, {12, 11, 0}}, matcher.get_matching_blocks());
+}
+
+TEST(MatchersTest, testSyncPointMatcher1) {
+    std::vector<std::pair<int, int>> syncpoints = {{3, 6}};
+    SyncPointMyersSequenceMatcher<> matcher("012a3456c789", "0a3412b5678", nullptr, &syncpoints);
+    expect_blocks({{0, 0, 1}, {1, 4, 2}, {6, 7, 2}, {9, 9, 2}, {12, 11, 0}}, matcher.get_matching_blocks());
+}
+
+TEST(MatchersTest, testSyncPointMatcher2) {
+    std::vector<std::pair<int, int>> syncpoints = {{3, 2}, {8, 6}};
+    SyncPointMyersSequenceMatcher<> matcher("012a3456c789", "02a341b5678", nullptr, &syncpoints);
+    difflib::match_list_t blocks = matcher.get_matching_blocks();
+    ASSERT_EQ(4, blocks.size());
+    EXPECT_EQ(difflib::match_t(0, 0, 1), blocks[0]);
+    EXPECT_EQ(difflib::match_t(2, 1, 4), blocks[1]);
+}
+
+TEST(MatchersTest, testSyncPointOpcodes) {
+    // A change on each side of the sync point must stay two changes
+    std::vector<std::pair<int, int>> syncpoints = {{2, 2}};
+    SyncPointMyersSequenceMatcher<> matcher("aXYb", "aPQb", nullptr, &syncpoints);
+    difflib::chunk_list_t changes = matcher.get_difference_opcodes();
+    ASSERT_EQ(2, changes.size());
+    EXPECT_EQ(difflib::chunk_t(difflib::Tag::replace, 1, 2, 1, 2), changes[0]);
+    EXPECT_EQ(difflib::chunk_t(difflib::Tag::replace, 2, 3, 2, 3), changes[1]);
+    EXPECT_EQ(4, matcher.get_opcodes().size());
+}
+
+TEST(MatchersTest, testInternedLines) {
+    LineInterner interner;
+    line_ids_t a = interner.intern({"int main() {", "    return 0;", "}"});
+    line_ids_t b = interner.intern({"int main() {", "    foo();", "    return 0;", "}"});
+    EXPECT_EQ(4, interner.size());
+    EXPECT_EQ(a[0], b[0]);
+    EXPECT_EQ(a[2], b[3]);
+
+    MyersSequenceMatcher<line_ids_t> matcher(a, b);
+    difflib::chunk_list_t opcodes = matcher.get_difference_opcodes();
+    ASSERT_EQ(1, opcodes.size());
+    EXPECT_EQ(difflib::chunk_t(difflib::Tag::insert, 1, 1, 1, 2), opcodes[0]);
+}
+
+TEST(MatchersTest, testLineViews) {
+    std::vector<text_view> lines = line_views("a\r\n\nb\rc", 1, 10);
+    ASSERT_EQ(3, lines.size());
+    EXPECT_EQ("", lines[0]);
+    EXPECT_EQ("b", lines[1]);
+    EXPECT_EQ("c", lines[2]);
+    EXPECT_EQ(std::vector<text_view>{"a"}, line_views("a\nb\n", 0, 1));
+    EXPECT_TRUE(line_views("a\nb\n", 2, 3).empty());
+}
+
+TEST(MatchersTest, testIncrementalInternCopies) {
+    // A 10 MB pane of 100000 distinct lines
+    std::string text;
+    for (int i = 0; i < 100000; i++) {
+        text += std::to_string(i) + std::string(100, 'x') + "\n";
+    }
+    LineInterner interner;
+    line_ids_t all = interner.intern_lines(text, 0, 100000);
+    ASSERT_EQ(100000, all.size());
+    size_t copied = interner.copied_bytes();
+    EXPECT_EQ(text.size() - 100000, copied);
+
+    // Re-interning the lines around an edit copies only the edited line
+    size_t pos = text.find("50000x");
+    text[pos + 5] = 'y';
+    line_ids_t edited = interner.intern_lines(text, 49999, 50002);
+    ASSERT_EQ(3, edited.size());
+    EXPECT_EQ(all[49999], edited[0]);
+    EXPECT_NE(all[50000], edited[1]);
+    EXPECT_EQ(all[50001], edited[2]);
+    EXPECT_EQ(copied + 105, interner.copied_bytes());
+}
+
+TEST(MatchersTest, testNormalisedInterning) {
+    LineInterner interner;
+    interner.set_normalisation(NORMALISE_TRIM_LEADING | NORMALISE_TRIM_TRAILING | NORMALISE_COLLAPSE_SPACE);
+    EXPECT_EQ(interner.intern("a  b"), interner.intern("\ta b  "));
+    EXPECT_NE(interner.intern("a b"), interner.intern("ab"));
+
+    interner.set_normalisation(NORMALISE_IGNORE_SPACE | NORMALISE_FOLD_CASE);
+    EXPECT_EQ(0, interner.size());
+    EXPECT_EQ(interner.intern("Foo (x)"), interner.intern("foo(X)"));
+}
+
+TEST(MatchersTest, testSkipBlankLines) {
+    std::string a = "one\n\ntwo\nthree\n";
+    std::string b = "one\ntwo\n  \n\nTHREE\nfour\n";
+    LineInterner interner;
+    interner.set_normalisation(NORMALISE_SKIP_BLANK | NORMALISE_TRIM_TRAILING);
+    std::vector<uint32_t> a_lines;
+    std::vector<uint32_t> b_lines;
+    line_ids_t a_ids = interner.intern_lines(a, 0, 4, &a_lines);
+    line_ids_t b_ids = interner.intern_lines(b, 0, 6, &b_lines);
+    EXPECT_EQ((std::vector<uint32_t>{0, 2, 3}), a_lines);
+    EXPECT_EQ((std::vector<uint32_t>{0, 1, 4, 5}), b_lines);
+
+    // Only the case change and the added line differ
+    MyersSequenceMatcher<line_ids_t> matcher(a_ids, b_ids);
+    difflib::chunk_list_t changes;
+    for (const difflib::chunk_t& c : matcher.opcodes(true)) {
+        changes.push_back(map_chunk_lines(c, a_lines, 0, b_lines, 0));
+    }
+    ASSERT_EQ(1, changes.size());
+    EXPECT_EQ(difflib::chunk_t(difflib::Tag::replace, 3, 4, 4, 6), changes[0]);
+
+    // An insertion sits right after the last line before it
+    EXPECT_EQ(difflib::chunk_t(difflib::Tag::insert, 3, 3, 1, 2),
+              map_chunk_lines(difflib::chunk_t(difflib::Tag::insert, 2, 2, 1, 2), a_lines, 0, b_lines, 0));
+}
+
+TEST(MatchersTest, testSnakeArena) {
+    MyersSequenceMatcher<> identical("abcdef", "abcdef");
+    identical.get_matching_blocks();
+    EXPECT_EQ(0, identical.peak_arena_bytes());
+
+    MyersSequenceMatcher<> matcher("abcbdefgabcdefg", "gfabcdefcd");
+    matcher.get_matching_blocks();
+    EXPECT_LT(0, matcher.peak_arena_bytes());
+
+    SnakeArena arena;
+    Snake *first = arena.create(nullptr, 0, 0, 1);
+    Snake *last = first;
+    for (int i = 1; i < 10000; i++) {
+        last = arena.create(last, i, i, 1);
+    }
+    // Growing the arena must not move earlier snakes
+    int count = 1;
+    Snake *node = last;
+    while (node->lastsnake) {
+        EXPECT_EQ(node->x - 1, node->lastsnake->x);
+        node = node->lastsnake;
+        count += 1;
+    }
+    EXPECT_EQ(first, node);
+    EXPECT_EQ(10000, count);
+    size_t peak = arena.peak_bytes();
+    EXPECT_LE(10000 * sizeof(Snake), peak);
+    arena.release();
+    EXPECT_EQ(0, arena.allocated_bytes());
+    EXPECT_EQ(peak, arena.peak_bytes());
+}
+
+static size_t matched_length(const difflib::match_list_t& blocks) {
+    size_t total = 0;
+    for (const difflib::match_t& m : blocks) {
+        total += std::get<2>(m);
+    }
+    return total;
+}
+
+TEST(MatchersTest, testLinearSpaceMatcher) {
+    MyersSequenceMatcher<> matcher("abcbdefgabcdefg", "gfabcdefcd");
+    matcher.set_linear_space_threshold(0);
+    difflib::match_list_t blocks = matcher.get_matching_blocks();
+    EXPECT_TRUE(matcher.used_linear_space());
+    EXPECT_EQ(difflib::match_t(15, 10, 0), blocks.back());
+    EXPECT_EQ(8, matched_length(blocks));
+
+    // Both engines find a longest common subsequence
+    srand(42);
+    for (int run = 0; run < 50; run++) {
+        line_ids_t a;
+        line_ids_t b;
+        for (int i = 0; i < 200 + rand() % 200; i++) {
+            a.push_back(rand() % 8);
+        }
+        for (int i = 0; i < 200 + rand() % 200; i++) {
+            b.push_back(rand() % 8);
+        }
+        MyersSequenceMatcher<line_ids_t> np(a, b);
+        MyersSequenceMatcher<line_ids_t> linear(a, b);
+        linear.set_linear_space_threshold(0);
+        difflib::match_list_t linear_blocks = linear.get_matching_blocks();
+        EXPECT_FALSE(np.used_linear_space());
+        EXPECT_EQ(matched_length(np.get_matching_blocks()), matched_length(linear_blocks));
+        size_t i = 0;
+        size_t j = 0;
+        for (const difflib::match_t& m : linear_blocks) {
+            EXPECT_LE(i, std::get<0>(m));
+            EXPECT_LE(j, std::get<1>(m));
+            EXPECT_TRUE(std::equal(a.begin() + std::get<0>(m), a.begin() + std::get<0>(m) + std::get<2>(m),
+                                   b.begin() + std::get<1>(m)));
+            i = std::get<0>(m) + std::get<2>(m);
+            j = std::get<1>(m) + std::get<2>(m);
+        }
+    }
+}
+
+template <class T>
+static void expect_valid_blocks(const T& a, const T& b, const difflib::match_list_t& blocks) {
+    ASSERT_FALSE(blocks.empty());
+    EXPECT_EQ(difflib::match_t(a.size(), b.size(), 0), blocks.back());
+    size_t i = 0;
+    size_t j = 0;
+    for (const difflib::match_t& m : blocks) {
+        EXPECT_LE(i, std::get<0>(m));
+        EXPECT_LE(j, std::get<1>(m));
+        EXPECT_TRUE(std::equal(a.begin() + std::get<0>(m), a.begin() + std::get<0>(m) + std::get<2>(m),
+                               b.begin() + std::get<1>(m)));
+        i = std::get<0>(m) + std::get<2>(m);
+        j = std::get<1>(m) + std::get<2>(m);
+    }
+}
+
+TEST(MatchersTest, testPatienceMatcher) {
+    // The unique lines 1 and 5 anchor the match, even though the
+    // repeated 9s would give Myers an equally long alignment.
+    line_ids_t a = {1, 9, 9, 5, 9};
+    line_ids_t b = {9, 1, 9, 5, 9, 9};
+    PatienceSequenceMatcher<line_ids_t> matcher(a, b);
+    difflib::match_list_t blocks = matcher.get_matching_blocks();
+    expect_valid_blocks(a, b, blocks);
+    EXPECT_EQ(difflib::match_t(0, 1, 2), blocks[0]);
+    EXPECT_EQ(difflib::match_t(3, 3, 1), blocks[1]);
+}
+
+/*! Histogram matcher with its anchor search opened up */
+class HistogramAnchors : public HistogramSequenceMatcher<line_ids_t> {
+public:
+    HistogramAnchors(const line_ids_t& a, const line_ids_t& b) : HistogramSequenceMatcher<line_ids_t>(a, b) {}
+    using HistogramSequenceMatcher<line_ids_t>::find_anchors;
+};
+
+TEST(MatchersTest, testHistogramChainLength) {
+    // A line right at the limit still anchors, one past it never does
+    size_t limit = HistogramSequenceMatcher<line_ids_t>::max_chain_length;
+    line_ids_t b = {1};
+    line_ids_t a(limit, 1);
+    EXPECT_EQ(1, HistogramAnchors(a, b).find_anchors(0, a.size(), 0, b.size()).size());
+    a.push_back(1);
+    EXPECT_EQ(0, HistogramAnchors(a, b).find_anchors(0, a.size(), 0, b.size()).size());
+    expect_valid_blocks(a, b, HistogramSequenceMatcher<line_ids_t>(a, b).get_matching_blocks());
+}
+
+TEST(MatchersTest, testAlgorithmsAgreeOnContract) {
+    srand(7);
+    for (int run = 0; run < 50; run++) {
+        line_ids_t a;
+        line_ids_t b;
+        for (int i = 0; i < 100 + rand() % 100; i++) {
+            a.push_back(rand() % 30);
+        }
+        b = a;
+        for (int edit = 0; edit < 10; edit++) {
+            size_t pos = rand() % b.size();
+            if (rand() % 2) {
+                b.erase(b.begin() + pos);
+            } else {
+                b.insert(b.begin() + pos, rand() % 40);
+            }
+        }
+        for (std::string algorithm : {"myers", "patience", "histogram"}) {
+            std::unique_ptr<MyersSequenceMatcher<line_ids_t>> matcher = make_matcher(algorithm, a, b);
+            expect_valid_blocks(a, b, matcher->get_matching_blocks());
+        }
+    }
+}
+
+TEST(MatchersTest, testCommonPrefixSuffixLength) {
+    for (size_t n = 0; n < 100; n++) {
+        for (size_t diff = 0; diff <= n; diff++) {
+            std::string a(n, 'x');
+            std::string b = a;
+            line_ids_t ia(n, 7);
+            line_ids_t ib = ia;
+            if (diff < n) {
+                b[diff] = 'y';
+                ib[diff] = 8;
+            }
+            EXPECT_EQ(diff, common_prefix_length(a.data(), b.data(), n));
+            EXPECT_EQ(diff, common_prefix_length(ia.data(), ib.data(), n));
+            EXPECT_EQ(diff < n ? n - diff - 1 : n, common_suffix_length(a.data(), b.data(), n));
+            EXPECT_EQ(diff < n ? n - diff - 1 : n, common_suffix_length(ia.data(), ib.data(), n));
+        }
+    }
+}
+
+TEST(MatchersTest, testDiscardedCounts) {
+    line_ids_t a = {1, 2, 3, 4, 5};
+    line_ids_t b = {1, 20, 21, 3, 22, 5};
+    MyersSequenceMatcher<line_ids_t> matcher(a, b);
+    matcher.set_discard_threshold(0);
+    expect_valid_blocks(a, b, matcher.get_matching_blocks());
+    // Only the middle 2, 3, 4 / 20, 21, 3, 22 is left after trimming
+    EXPECT_EQ(2, matcher.discarded_counts().first);
+    EXPECT_EQ(3, matcher.discarded_counts().second);
+
+    InlineMyersSequenceMatcher inline_matcher("red, blue, yellow, white", "black green, hue, white", nullptr);
+    inline_matcher.get_matching_blocks();
+    EXPECT_LT(0, inline_matcher.discarded_counts().first);
+    EXPECT_LT(0, inline_matcher.discarded_counts().second);
+
+    HashIndex<uint32_t> index(100);
+    for (uint32_t i = 0; i < 1000; i += 10) {
+        index.insert(i);
+    }
+    EXPECT_TRUE(index.contains(990));
+    EXPECT_FALSE(index.contains(995));
+}
+
+TEST(MatchersTest, testAutoSplitMatcher) {
+    srand(11);
+    line_ids_t a;
+    for (uint32_t i = 0; i < 20000; i++) {
+        // Mostly unique lines, with some repeats between them
+        a.push_back(rand() % 4 ? i : rand() % 16);
+    }
+    line_ids_t b = a;
+    for (int edit = 0; edit < 200; edit++) {
+        size_t pos = rand() % b.size();
+        if (rand() % 2) {
+            b.erase(b.begin() + pos);
+        } else {
+            b.insert(b.begin() + pos, 100000 + edit);
+        }
+    }
+
+    SyncPointMyersSequenceMatcher<line_ids_t> split(a, b);
+    split.set_auto_split_threshold(1000);
+    split.set_max_workers(4);
+    difflib::match_list_t blocks = split.get_matching_blocks();
+    expect_valid_blocks(a, b, blocks);
+    EXPECT_LT(1, split.region_count());
+
+    SyncPointMyersSequenceMatcher<line_ids_t> single(a, b);
+    single.set_auto_split_threshold(1000);
+    single.set_max_workers(1);
+    EXPECT_EQ(matched_length(single.get_matching_blocks()), matched_length(blocks));
+    EXPECT_EQ(1, single.region_count());
+
+    // Regions matched in parallel report progress as they finish, on
+    // their own threads
+    std::atomic<int> notified(0);
+    MatchControl control([&notified] () { notified++; });
+    SyncPointMyersSequenceMatcher<line_ids_t> followed(a, b);
+    followed.set_auto_split_threshold(1000);
+    followed.set_max_workers(4);
+    followed.set_control(&control);
+    followed.get_matching_blocks();
+    EXPECT_EQ(1, control.progress());
+    EXPECT_LT(0, notified);
+}
+
+TEST(MatchersTest, testBudgetedMatcher) {
+    srand(5);
+    line_ids_t a;
+    line_ids_t b;
+    for (int i = 0; i < 2000; i++) {
+        a.push_back(rand() % 20);
+        b.push_back(rand() % 20);
+    }
+
+    MyersSequenceMatcher<line_ids_t> exact(a, b);
+    size_t exact_length = matched_length(exact.get_matching_blocks());
+    EXPECT_FALSE(exact.approximate());
+
+    MyersSequenceMatcher<line_ids_t> cheap(a, b);
+    cheap.set_cost_limit(100);
+    difflib::match_list_t blocks = cheap.get_matching_blocks();
+    expect_valid_blocks(a, b, blocks);
+    EXPECT_TRUE(cheap.approximate());
+    EXPECT_TRUE(cheap.used_linear_space());
+    EXPECT_LT(0, matched_length(blocks));
+    EXPECT_GE(exact_length, matched_length(blocks));
+
+    MyersSequenceMatcher<line_ids_t> late(a, b);
+    late.set_time_limit(std::chrono::milliseconds(0));
+    expect_valid_blocks(a, b, late.get_matching_blocks());
+    EXPECT_TRUE(late.approximate());
+
+    // A small change fits in any budget and stays exact
+    MyersSequenceMatcher<> small("abcdefgh", "abxdefgh");
+    small.set_time_limit(std::chrono::milliseconds(0));
+    EXPECT_EQ(7, matched_length(small.get_matching_blocks()));
+    EXPECT_FALSE(small.approximate());
+}
+
+TEST(MatchersTest, testMatchControl) {
+    srand(5);
+    line_ids_t a;
+    line_ids_t b;
+    for (int i = 0; i < 2000; i++) {
+        a.push_back(rand() % 20);
+        b.push_back(rand() % 20);
+    }
+
+    int notified = 0;
+    MatchControl control([&notified] () { notified++; });
+    MyersSequenceMatcher<line_ids_t> followed(a, b);
+    followed.set_control(&control);
+    size_t exact_length = matched_length(followed.get_matching_blocks());
+    EXPECT_FALSE(followed.approximate());
+    EXPECT_LT(0.5, control.progress());
+    EXPECT_LT(10, notified);
+
+    // Cancelled before it starts, nothing matches but the result is valid
+    MatchControl cancelled;
+    cancelled.cancel();
+    for (std::string algorithm : {"myers", "patience", "histogram"}) {
+        std::unique_ptr<MyersSequenceMatcher<line_ids_t>> matcher = make_matcher(algorithm, a, b);
+        matcher->set_control(&cancelled);
+        difflib::match_list_t blocks = matcher->get_matching_blocks();
+        expect_valid_blocks(a, b, blocks);
+        EXPECT_TRUE(matcher->approximate());
+        EXPECT_GT(exact_length, matched_length(blocks));
+    }
+}
+
+TEST(MatchersTest, testBitParallelMatcher) {
+    BitParallelSequenceMatcher matcher("abcbdefgabcdefg", "gfabcdefcd");
+    difflib::match_list_t blocks = matcher.get_matching_blocks();
+    EXPECT_EQ(8, matched_length(blocks));
+    EXPECT_TRUE(BitParallelSequenceMatcher::fits(std::string(128, 'a'), ""));
+    EXPECT_FALSE(BitParallelSequenceMatcher::fits(std::string(129, 'a'), ""));
+    EXPECT_THROW(BitParallelSequenceMatcher(std::string(129, 'a'), "a"), ValueError);
+
+    // Same LCS as Myers, across the 64 bit word boundary
+    srand(3);
+    for (int run = 0; run < 200; run++) {
+        std::string a;
+        std::string b;
+        int alphabet = 2 + rand() % 20;
+        for (int i = rand() % 129; i > 0; i--) {
+            a.push_back('a' + rand() % alphabet);
+        }
+        for (int i = rand() % 129; i > 0; i--) {
+            b.push_back('a' + rand() % alphabet);
+        }
+        BitParallelSequenceMatcher bits(a, b);
+        MyersSequenceMatcher<> myers(a, b);
+        myers.set_discard_threshold(1000);
+        difflib::match_list_t bit_blocks = bits.get_matching_blocks();
+        expect_valid_blocks(a, b, bit_blocks);
+        EXPECT_EQ(matched_length(myers.get_matching_blocks()), matched_length(bit_blocks));
+    }
+}
+
+TEST(MatchersTest, testFindMoves) {
+    typedef difflib::chunk_t C;
+    const difflib::Tag move = difflib::Tag::move;
+
+    // 6 7 8 moved up, past 2 3 4 5
+    line_ids_t a = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    line_ids_t b = {1, 6, 7, 8, 2, 3, 4, 5, 9};
+    difflib::chunk_list_t changes = MyersSequenceMatcher<line_ids_t>(a, b).get_difference_opcodes();
+    difflib::chunk_list_t expected = {C(move, 1, 1, 1, 4), C(move, 5, 8, 8, 8)};
+    EXPECT_EQ(expected, find_moves(changes, a, b, 3));
+    EXPECT_EQ(changes, find_moves(changes, a, b, 4));
+    EXPECT_EQ(changes, find_moves(changes, a, b, 0));
+
+    // Part of a replace moves, the rest stays a delete and an insert
+    a = {1, 10, 11, 12, 2, 3, 4, 5, 6};
+    b = {1, 20, 2, 3, 4, 5, 10, 11, 12, 6};
+    changes = MyersSequenceMatcher<line_ids_t>(a, b).get_difference_opcodes();
+    difflib::chunk_list_t moves = find_moves(changes, a, b, 3);
+    // Myers may pair the first change either way; only what moved matters
+    size_t moved_a = 0;
+    size_t moved_b = 0;
+    for (const difflib::chunk_t& c : moves) {
+        if (c.tag == move) {
+            moved_a += c.i2 - c.i1;
+            moved_b += c.j2 - c.j1;
+        }
+    }
+    EXPECT_EQ(3, moved_a);
+    EXPECT_EQ(3, moved_b);
+    for (size_t k = 1; k < moves.size(); k++) {
+        EXPECT_LE(moves[k - 1].i2, moves[k].i1);
+        EXPECT_LE(moves[k - 1].j2, moves[k].j1);
+    }
+
+    // Near-identical blocks are paired as a whole, but not within a change
+    a = {1, 20, 21, 22, 23, 24, 2, 3, 4, 5, 6};
+    b = {1, 2, 3, 4, 5, 6, 20, 21, 99, 23, 24};
+    changes = MyersSequenceMatcher<line_ids_t>(a, b).get_difference_opcodes();
+    expected = {C(move, 1, 6, 1, 1), C(move, 11, 11, 6, 11)};
+    EXPECT_EQ(expected, find_moves(changes, a, b, 3));
+    EXPECT_EQ(changes, find_moves(changes, a, b, 3, 0.9));
+    a = {1, 20, 21, 22, 23, 24, 2};
+    b = {1, 20, 21, 99, 23, 24, 2};
+    changes = MyersSequenceMatcher<line_ids_t>(a, b).get_difference_opcodes();
+    EXPECT_EQ(changes, find_moves(changes, a, b, 3));
+}
+
+TEST(MatchersTest, testSplitConflict) {
+    typedef difflib::chunk_t C;
+    typedef std::pair<C, C> P;
+    const difflib::Tag r = difflib::Tag::replace;
+    const difflib::Tag c = difflib::Tag::conflict;
+    const std::chrono::milliseconds forever = std::chrono::milliseconds::max();
+
+    // Both sides replaced lines 10 to 13 and agree but for the middle one;
+    // the middle lines follow the side with as many lines
+    line_ids_t a = {1, 2, 3};
+    line_ids_t b = {1, 9, 3};
+    std::vector<P> expected = {P(C(r, 10, 11, 20, 21), C(r, 10, 11, 30, 31)),
+                               P(C(c, 11, 12, 21, 22), C(c, 11, 12, 31, 32)),
+                               P(C(r, 12, 13, 22, 23), C(r, 12, 13, 32, 33))};
+    EXPECT_EQ(expected, split_conflict(a, b, 20, 30, 10, 13, forever));
+
+    // Both inserted at line 5, one side a line more
+    a = {1, 2};
+    b = {1};
+    expected = {P(C(r, 5, 5, 20, 21), C(r, 5, 5, 30, 31)), P(C(c, 5, 5, 21, 22), C(c, 5, 5, 31, 31))};
+    EXPECT_EQ(expected, split_conflict(a, b, 20, 30, 5, 5, forever));
+
+    // Out of time, the split may not be minimal but still covers both sides
+    a.clear();
+    b.clear();
+    for (uint32_t i = 0; i < 2000; i++) {
+        a.push_back(i % 7);
+        b.push_back(i % 5);
+    }
+    std::vector<P> split = split_conflict(a, b, 0, 0, 0, 2000, std::chrono::milliseconds(0));
+    ASSERT_FALSE(split.empty());
+    EXPECT_EQ(0, split.front().first.j1);
+    EXPECT_EQ(0, split.front().second.j1);
+    EXPECT_EQ(2000, split.back().first.j2);
+    EXPECT_EQ(2000, split.back().second.j2);
+    for (size_t k = 1; k < split.size(); k++) {
+        EXPECT_EQ(split[k - 1].first.j2, split[k].first.j1);
+        EXPECT_EQ(split[k - 1].second.j2, split[k].second.j1);
+        EXPECT_EQ(split[k - 1].first.i2, split[k].first.i1);
+    }
+}
+
+TEST(MatchersTest, testMatcherPool) {
+    std::vector<std::pair<std::string, std::string>> texts;
+    srand(5);
+    for (int i = 0; i < 50; i++) {
+        std::string a;
+        std::string b;
+        for (int j = 0; j < 200; j++) {
+            a += 'a' + rand() % 4;
+            b += 'a' + rand() % 4;
+        }
+        texts.push_back(std::make_pair(a, b));
+    }
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<difflib::chunk_list_t> results(texts.size());
+    size_t done = 0;
+    {
+        MatcherPool pool(3);
+        EXPECT_EQ(3, pool.workers());
+        int owner = 0;
+        for (size_t i = 0; i < texts.size(); i++) {
+            pool.submit(&owner, texts[i].first, texts[i].second, [&, i](const difflib::chunk_list_t& opcodes) {
+                std::lock_guard<std::mutex> lock(mutex);
+                results[i] = opcodes;
+                done++;
+                finished.notify_one();
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return done == texts.size(); });
+        EXPECT_EQ(0, pool.queued());
+    }
+    for (size_t i = 0; i < texts.size(); i++) {
+        EXPECT_EQ(matcher_worker(texts[i].first, texts[i].second), results[i]);
+    }
+
+    // Cancelled jobs that hadn't started never report back
+    std::atomic<int> cancelled_done(0);
+    std::atomic<int> kept_done(0);
+    {
+        MatcherPool pool(1);
+        int cancelled_owner = 0;
+        int kept_owner = 0;
+        for (int i = 0; i < 200; i++) {
+            pool.submit(&cancelled_owner, texts[0].first, texts[0].second,
+                        [&](const difflib::chunk_list_t&) { cancelled_done++; });
+        }
+        pool.submit(&kept_owner, texts[1].first, texts[1].second, [&](const difflib::chunk_list_t&) { kept_done++; });
+        pool.cancel(&cancelled_owner);
+        EXPECT_GE(1, pool.queued());
+        while (kept_done == 0) {
+            std::this_thread::yield();
+        }
+    }
+    EXPECT_GT(200, cancelled_done);
+    EXPECT_EQ(1, kept_done);
+}
+
+TEST(MatchersTest, testInlineMatchCache) {
+    typedef difflib::chunk_t C;
+    const difflib::Tag e = difflib::Tag::equal;
+    difflib::chunk_list_t opcodes = {C(e, 0, 3, 0, 3), C(difflib::Tag::replace, 3, 4, 3, 5)};
+    InlineMatchCache::key_type ab = InlineMatchCache::key("abc", "abd");
+    EXPECT_EQ(ab, InlineMatchCache::key("abc", "abd"));
+    EXPECT_NE(ab, InlineMatchCache::key("abd", "abc"));
+    EXPECT_NE(InlineMatchCache::key("", "a"), InlineMatchCache::key("a", ""));
+    EXPECT_NE(InlineMatchCache::key(std::string(8, 'x'), ""), InlineMatchCache::key(std::string(9, 'x'), ""));
+
+    InlineMatchCache cache(1 << 20);
+    difflib::chunk_list_t found;
+    EXPECT_FALSE(cache.lookup(ab, found));
+    cache.insert(ab, opcodes);
+    EXPECT_TRUE(cache.lookup(ab, found));
+    EXPECT_EQ(opcodes, found);
+    InlineMatchCache::Stats stats = cache.stats();
+    EXPECT_EQ(1, stats.hits);
+    EXPECT_EQ(1, stats.misses);
+    EXPECT_EQ(1, stats.entries);
+
+    // Shrinking the budget drops least recently used entries first
+    for (int i = 0; i < 100; i++) {
+        cache.insert(InlineMatchCache::key(std::to_string(i), "x"), opcodes);
+    }
+    size_t entry_bytes = cache.stats().bytes / 101;
+    EXPECT_TRUE(cache.lookup(ab, found));
+    cache.set_budget(entry_bytes * 10);
+    stats = cache.stats();
+    EXPECT_EQ(10, stats.entries);
+    EXPECT_EQ(91, stats.evictions);
+    EXPECT_GE(cache.budget(), stats.bytes);
+    EXPECT_TRUE(cache.lookup(ab, found));
+    EXPECT_TRUE(cache.lookup(InlineMatchCache::key("99", "x"), found));
+    EXPECT_FALSE(cache.lookup(InlineMatchCache::key("90", "x"), found));
+
+    // Inserting past the budget evicts, and what is over budget alone isn't kept
+    cache.insert(InlineMatchCache::key("new", "x"), opcodes);
+    EXPECT_EQ(10, cache.stats().entries);
+    EXPECT_FALSE(cache.lookup(InlineMatchCache::key("91", "x"), found));
+    cache.insert(InlineMatchCache::key("big", "x"), difflib::chunk_list_t(entry_bytes, opcodes[0]));
+    EXPECT_FALSE(cache.lookup(InlineMatchCache::key("big", "x"), found));
+
+    cache.clear();
+    stats = cache.stats();
+    EXPECT_EQ(0, stats.entries);
+    EXPECT_EQ(0, stats.bytes);
+    EXPECT_EQ(0, stats.hits);
+    EXPECT_EQ(0, stats.misses);
+    EXPECT_EQ(0, stats.evictions);
+    EXPECT_FALSE(cache.lookup(InlineMatchCache::key("new", "x"), found));
+    EXPECT_EQ(1, cache.stats().misses);
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+#include "../meld/textsnapshot.h"
+
+static std::vector<std::string> to_strings(const std::vector<text_view>& views) {
+    std::vector<std::string> result;
+    for (text_view view : views) {
+        result.push_back(std::string(view.data(), view.size()));
+    }
+    return result;
+}
+
+TEST(TextSnapshotTest, testFromText) {
+    TextSnapshot text = TextSnapshot::from_text("a\nb\r\nc");
+    EXPECT_EQ(3, text.size());
+    EXPECT_EQ("b", text[1]);
+    EXPECT_EQ((std::vector<std::string>{"b", "c"}), to_strings(text.lines(1, 10)));
+
+    EXPECT_TRUE(TextSnapshot().empty());
+    EXPECT_TRUE(TextSnapshot().lines(0, 10).empty());
+    EXPECT_EQ(0, TextSnapshot::from_text("").size());
+}
+
+TEST(TextSnapshotTest, testReplaceShares) {
+    std::vector<std::string> lines;
+    for (int i = 0; i < 10000; i++) {
+        lines.push_back(std::to_string(i));
+    }
+    TextSnapshot before(lines);
+    TextSnapshot after = before.replace(5000, 5001, {"typed"});
+
+    EXPECT_EQ("5000", before[5000]);
+    EXPECT_EQ("typed", after[5000]);
+    EXPECT_EQ(10000, after.size());
+    // Only the edited leaf is new
+    size_t leaves = before.shared_leaves(before);
+    EXPECT_EQ(leaves - 1, before.shared_leaves(after));
+
+    TextSnapshot removed = after.replace(100, 9900, {});
+    EXPECT_EQ(200, removed.size());
+    EXPECT_EQ("99", removed[99]);
+    EXPECT_EQ("9900", removed[100]);
+    EXPECT_EQ("typed", after[5000]);
+}
+
+TEST(TextSnapshotTest, testRandomEdits) {
+    srand(11);
+    std::vector<std::string> model;
+    TextSnapshot text;
+    std::vector<std::pair<TextSnapshot, std::vector<std::string>>> versions;
+    for (int edit = 0; edit < 3000; edit++) {
+        size_t lo = model.empty() ? 0 : rand() % (model.size() + 1);
+        size_t hi = std::min(model.size(), lo + (rand() % 4 == 0 ? rand() % 200 : rand() % 2));
+        std::vector<std::string> lines;
+        for (int i = rand() % (rand() % 5 == 0 ? 300 : 3); i > 0; i--) {
+            lines.push_back(std::to_string(edit) + "." + std::to_string(i));
+        }
+        model.erase(model.begin() + lo, model.begin() + hi);
+        model.insert(model.begin() + lo, lines.begin(), lines.end());
+        text = text.replace(lo, hi, lines);
+        ASSERT_EQ(model.size(), text.size());
+        if (edit % 300 == 0) {
+            versions.push_back(std::make_pair(text, model));
+        }
+    }
+    EXPECT_EQ(model, to_strings(text.lines(0, text.size())));
+    for (size_t i = 0; i < model.size(); i += 97) {
+        EXPECT_EQ(model[i], text[i]);
+    }
+    // Older snapshots are untouched by later edits
+    for (const std::pair<TextSnapshot, std::vector<std::string>>& version : versions) {
+        EXPECT_EQ(version.second, to_strings(version.first.lines(0, version.first.size())));
+    }
+}